@@ -0,0 +1,658 @@
+#include "bot_script.h"
+#include "cli_args.h"
+#include "core.h"
+#include "metrics.h"
+#include "net.h"
+#include "net_msgs.h"
+#include "player.h"
+#include "profile.h"
+#include "server.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+
+
+// fast forward benchmark, runs the server's tick loop flat out against bots in this process, over in
+// process sockets and in lockstep with them, so many minutes of play take seconds. It reports ticks per
+// second and what each part of the server costs per tick. Bots either play a script, or replay inputs
+// recorded by an earlier run, so the server does exactly the same work every run, whatever the clock does
+
+
+constexpr uint32 c_bench_max_players			= 4096;
+constexpr uint32 c_bench_recording_magic		= 0x6e6f646f; // "odon"
+constexpr uint32 c_bench_recording_version		= 1;
+constexpr float32 c_bench_join_timeout_s		= 5.0f;
+constexpr uint32 c_bench_sends_per_yield		= 64; // lets the server drain its in process queue, which only holds so many
+
+// a recording is this header then, for every tick, every player's input, quantised as sent
+struct Bench_Recording_Header
+{
+	uint32 magic;
+	uint32 version;
+	uint32 num_players;
+	uint32 num_rooms;
+	uint32 num_ticks;
+	int32 tick_rate;
+	uint32 churn_ticks;
+};
+
+struct Bench_Recorded_Input
+{
+	uint8 keys; // up, down, left, right, jump from the lowest bit
+	float32 pitch;
+	float32 yaw;
+};
+
+struct Bench_Bot
+{
+	Net::Socket sock;
+	bool32 is_joined;
+	uint32 slot;
+	uint32 room_max_players;
+	Net::Snapshot_History snapshot_history;
+	uint32 latest_sequence;
+	uint32 prediction_id;
+	Bot_Script_State script_state;
+	Player_Snapshot_State latest_snapshot_state; // its own, from the latest snapshot
+};
+
+struct Bench_Config
+{
+	uint32 num_players;
+	uint32 num_rooms;
+	uint32 num_ticks;
+	int32 tick_rate;
+	uint32 num_state_encode_workers;
+	uint32 churn_ticks; // every this many ticks a player leaves and joins again, 0 for never
+	Bot_Script script;
+	uint64 seed;
+	const char* record_path;
+	const char* replay_path;
+	uint32 profile_ticks;
+};
+
+static void print_usage(const char* program_name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --players <n>            players in all, up to %u (default 64)\n"
+		"  --rooms <n>              rooms the players are spread over, up to %u (default 1)\n"
+		"  --minutes <n>            minutes of play to simulate (default 10)\n"
+		"  --ticks <n>              or exactly this many ticks\n"
+		"  --tick-rate <hz>         server ticks per second of play, up to %d (default %d)\n"
+		"  --encode-workers <n>     threads encoding state packets, up to %u (default 1)\n"
+		"  --churn <ticks>          a player leaves and joins again this often (default never)\n"
+		"  --script <random|forward|circle|idle>  what the bots do (default random)\n"
+		"  --seed <n>               seeds the random script (default 1)\n"
+		"  --record <path>          save the inputs played, to replay later\n"
+		"  --replay <path>          play inputs saved by --record, which also sets the players, rooms, ticks, tick rate and churn\n"
+		"  --profile <ticks>        capture a trace of the first this many ticks\n",
+		program_name, c_bench_max_players, c_max_rooms, c_max_server_tick_rate, c_default_server_tick_rate, c_max_state_encode_workers);
+}
+
+static void recorded_input_write(Bench_Recorded_Input* recorded, Player_Input* input)
+{
+	recorded->keys = (uint8)((input->up ? 1 : 0) | (input->down ? 2 : 0) | (input->left ? 4 : 0) | (input->right ? 8 : 0) | (input->jump ? 16 : 0));
+	recorded->pitch = input->pitch;
+	recorded->yaw = input->yaw;
+}
+
+static void recorded_input_read(Bench_Recorded_Input* recorded, Player_Input* out_input)
+{
+	out_input->up = (recorded->keys & 1) != 0;
+	out_input->down = (recorded->keys & 2) != 0;
+	out_input->left = (recorded->keys & 4) != 0;
+	out_input->right = (recorded->keys & 8) != 0;
+	out_input->jump = (recorded->keys & 16) != 0;
+	out_input->pitch = recorded->pitch;
+	out_input->yaw = recorded->yaw;
+}
+
+// the whole recording is read up front, so file reads aren't in the timings, 0 if it can't be
+static Bench_Recorded_Input* recording_read(const char* path, Bench_Recording_Header* out_header)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		fprintf(stderr, "couldn't open %s\n", path);
+		return 0;
+	}
+
+	if (fread(out_header, sizeof(*out_header), 1, file) != 1 ||
+		out_header->magic != c_bench_recording_magic ||
+		out_header->version != c_bench_recording_version ||
+		!out_header->num_players || out_header->num_players > c_bench_max_players ||
+		!out_header->num_rooms || out_header->num_rooms > c_max_rooms ||
+		out_header->tick_rate < 1 || out_header->tick_rate > c_max_server_tick_rate)
+	{
+		fprintf(stderr, "%s isn't a recording this version can play\n", path);
+		fclose(file);
+		return 0;
+	}
+
+	uint64 num_inputs = (uint64)out_header->num_players * out_header->num_ticks;
+	Bench_Recorded_Input* inputs = new Bench_Recorded_Input[num_inputs];
+	if (fread(inputs, sizeof(Bench_Recorded_Input), num_inputs, file) != num_inputs)
+	{
+		fprintf(stderr, "%s is cut short\n", path);
+		delete[] inputs;
+		fclose(file);
+		return 0;
+	}
+	fclose(file);
+	return inputs;
+}
+
+static void bench_bot_receive(Bench_Bot* bot, Net::Packet_View* packet_views, uint32 max_packet_views)
+{
+	uint32 num_received;
+	while ((num_received = Net::socket_receive_views(&bot->sock, packet_views, max_packet_views)) > 0)
+	{
+		for (uint32 packet_index = 0; packet_index < num_received; ++packet_index)
+		{
+			uint8* packet = packet_views[packet_index].data;
+			uint32 packet_size = packet_views[packet_index].size;
+			Net::Server_Message message_type;
+			if (!Net::server_msg_type_read(packet, packet_size, &message_type))
+			{
+				continue;
+			}
+
+			switch (message_type)
+			{
+				case Net::Server_Message::Join_Result:
+				{
+					if (bot->is_joined)
+					{
+						break; // a resent join's result
+					}
+
+					bool32 success;
+					int32 server_tick_rate;
+					if (Net::server_msg_join_result_read(packet, packet_size, &success, &bot->slot, &bot->room_max_players, &server_tick_rate))
+					{
+						bot->is_joined = success;
+					}
+				}
+				break;
+
+				case Net::Server_Message::State:
+				{
+					if (!bot->is_joined)
+					{
+						break;
+					}
+
+					uint32 received_sequence;
+					uint32 received_prediction_id;
+					Player_Extra_State received_extra_state;
+					bool32 is_complete;
+					if (Net::server_msg_state_read(
+						packet,
+						packet_size,
+						&bot->snapshot_history,
+						&received_sequence,
+						bot->prediction_id,
+						&received_prediction_id,
+						&received_extra_state,
+						bot->room_max_players,
+						&is_complete) &&
+						is_complete &&
+						received_sequence > bot->latest_sequence)
+					{
+						bot->latest_sequence = received_sequence;
+						Net::Snapshot* snapshot = Net::snapshot_history_get(&bot->snapshot_history, received_sequence);
+						bot->latest_snapshot_state = snapshot->player_snapshot_states[bot->slot];
+					}
+				}
+				break;
+			}
+		}
+		Net::socket_release_views(&bot->sock, num_received);
+	}
+}
+
+static void bench_bot_join(Bench_Bot* bot, uint8* buffer, Net::IP_Endpoint* server_endpoint)
+{
+	bot->is_joined = false;
+	uint32 join_msg_size = Net::client_msg_join_write(buffer);
+	Net::socket_send(&bot->sock, buffer, join_msg_size, server_endpoint);
+}
+
+// ticks the server, then waits for it to be done, everything sent before this is handled first
+static void bench_server_tick(Server_Fast_Forward* fast_forward)
+{
+	uint32 tick_limit = fast_forward->tick_limit.load(std::memory_order_relaxed) + 1;
+	fast_forward->tick_limit.store(tick_limit, std::memory_order_release);
+	while (fast_forward->ticks_done.load(std::memory_order_acquire) < tick_limit)
+	{
+		std::this_thread::yield();
+	}
+}
+
+// fnv-1a over every player's position as they last saw it, so runs playing the same inputs can be compared
+static uint32 bench_checksum(Bench_Bot* bots, uint32 num_players)
+{
+	uint32 hash = 2166136261u;
+	for (uint32 i = 0; i < num_players; ++i)
+	{
+		uint8* bytes = (uint8*)&bots[i].latest_snapshot_state.position;
+		for (uint32 j = 0; j < sizeof(Vec_3f); ++j)
+		{
+			hash = (hash ^ bytes[j]) * 16777619u;
+		}
+	}
+	return hash;
+}
+
+static uint64 metrics_counter_read(Metric_Counter counter)
+{
+	return g_metrics->counters[(uint32)counter].value.load(std::memory_order_relaxed);
+}
+
+int main(int argc, char** argv)
+{
+	Bench_Config config = {};
+	config.num_players = 64;
+	config.num_rooms = 1;
+	config.num_ticks = 0;
+	config.tick_rate = c_default_server_tick_rate;
+	config.num_state_encode_workers = 1;
+	config.churn_ticks = 0;
+	config.script = Bot_Script::Random;
+	config.seed = 1;
+	config.record_path = 0;
+	config.replay_path = 0;
+	config.profile_ticks = 0;
+	float32 minutes = 10.0f;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		uint32 value;
+		if (!strcmp(arg, "--players"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_bench_max_players, &config.num_players))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--rooms"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_max_rooms, &config.num_rooms))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--minutes") && i + 1 < argc)
+		{
+			++i;
+			char* end;
+			minutes = strtof(argv[i], &end);
+			if (end == argv[i] || *end || !(minutes > 0.0f))
+			{
+				fprintf(stderr, "--minutes must be a number more than 0, got %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--ticks"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 0x7fffffff, &config.num_ticks))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--tick-rate"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_max_server_tick_rate, &value))
+			{
+				return 1;
+			}
+			config.tick_rate = (int32)value;
+		}
+		else if (!strcmp(arg, "--encode-workers"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_max_state_encode_workers, &config.num_state_encode_workers))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--churn"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 0x7fffffff, &config.churn_ticks))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--script") && i + 1 < argc)
+		{
+			++i;
+			if (!bot_script_parse(argv[i], &config.script))
+			{
+				fprintf(stderr, "--script must be random, forward, circle or idle, got %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--seed"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 0, 0xffffffff, &value))
+			{
+				return 1;
+			}
+			config.seed = value;
+		}
+		else if (!strcmp(arg, "--record") && i + 1 < argc)
+		{
+			config.record_path = argv[++i];
+		}
+		else if (!strcmp(arg, "--replay") && i + 1 < argc)
+		{
+			config.replay_path = argv[++i];
+		}
+		else if (!strcmp(arg, "--profile"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 1000000, &config.profile_ticks))
+			{
+				return 1;
+			}
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return !strcmp(arg, "--help") ? 0 : 1;
+		}
+	}
+	if (config.record_path && config.replay_path)
+	{
+		fprintf(stderr, "--record and --replay can't be used together\n");
+		return 1;
+	}
+
+	Bench_Recorded_Input* recorded_inputs = 0;
+	if (config.replay_path)
+	{
+		Bench_Recording_Header header;
+		recorded_inputs = recording_read(config.replay_path, &header);
+		if (!recorded_inputs)
+		{
+			return 1;
+		}
+		config.num_players = header.num_players;
+		config.num_rooms = header.num_rooms;
+		config.num_ticks = header.num_ticks;
+		config.tick_rate = header.tick_rate;
+		config.churn_ticks = header.churn_ticks;
+	}
+	else if (!config.num_ticks)
+	{
+		config.num_ticks = (uint32)(minutes * 60.0f * config.tick_rate);
+	}
+	if (config.num_rooms > config.num_players)
+	{
+		config.num_rooms = config.num_players;
+	}
+	uint32 max_clients = (config.num_players + config.num_rooms - 1) / config.num_rooms;
+	if (max_clients > c_max_clients)
+	{
+		fprintf(stderr, "%u players in %u rooms is more than %u a room, use more rooms\n", config.num_players, config.num_rooms, c_max_clients);
+		return 1;
+	}
+
+	FILE* record_file = 0;
+	if (config.record_path)
+	{
+		record_file = fopen(config.record_path, "wb");
+		if (!record_file)
+		{
+			fprintf(stderr, "couldn't open %s to record to\n", config.record_path);
+			return 1;
+		}
+		Bench_Recording_Header header = {};
+		header.magic = c_bench_recording_magic;
+		header.version = c_bench_recording_version;
+		header.num_players = config.num_players;
+		header.num_rooms = config.num_rooms;
+		header.num_ticks = config.num_ticks;
+		header.tick_rate = config.tick_rate;
+		header.churn_ticks = config.churn_ticks;
+		fwrite(&header, sizeof(header), 1, record_file);
+	}
+
+	if (!Net::init())
+	{
+		return 1;
+	}
+
+	Server_Fast_Forward fast_forward;
+	fast_forward.tick_limit.store(0, std::memory_order_relaxed);
+	fast_forward.ticks_done.store(0, std::memory_order_relaxed);
+
+	std::atomic_bool server_should_run = true;
+	Server_Config server_config = {};
+	server_config.port = c_port;
+	server_config.tick_rate = config.tick_rate;
+	server_config.max_clients = max_clients;
+	server_config.num_rooms = config.num_rooms;
+	server_config.num_room_workers = 0;
+	server_config.socket_type = Net::Socket_Type::In_Process;
+	server_config.num_receive_shards = 0;
+	server_config.wait_for_events = false;
+	server_config.num_state_encode_workers = config.num_state_encode_workers;
+	server_config.stats_interval_s = 0.0f;
+	server_config.ticks_profiler = true;
+	server_config.fast_forward = &fast_forward;
+	std::thread server_thread(&server_main, &server_should_run, &server_config);
+	profile_thread_name("bench");
+
+	Linear_Allocator allocator;
+	linear_allocator_create(&allocator, kilobytes(64) + (config.num_players * (sizeof(Bench_Bot) + Net::socket_memory_size(Net::Socket_Type::In_Process) + Net::snapshot_history_memory_size(max_clients))));
+	Bench_Bot* bots = (Bench_Bot*)linear_allocator_alloc(&allocator, sizeof(Bench_Bot) * config.num_players);
+	for (uint32 i = 0; i < config.num_players; ++i)
+	{
+		Bench_Bot* bot = &bots[i];
+		*bot = {};
+		if (!Net::socket(&bot->sock, Net::Socket_Type::In_Process, &allocator))
+		{
+			return 1;
+		}
+		Net::snapshot_history_create(&bot->snapshot_history, max_clients, &allocator);
+		bot->prediction_id = 1;
+		bot_script_init(&bot->script_state, config.seed, i);
+	}
+
+	constexpr uint32 c_max_packet_views = 16;
+	Net::Packet_View packet_views[c_max_packet_views];
+	uint8 buffer[c_packet_budget_per_tick];
+	Net::IP_Endpoint server_endpoint = Net::ip_endpoint(127, 0, 0, 1, c_port);
+
+	// everyone joins before the clock starts, resending joins the server's queue had no room for
+	Timer join_timer = timer();
+	uint32 num_joined = 0;
+	while (num_joined < config.num_players)
+	{
+		if (timer_get_s(&join_timer) > c_bench_join_timeout_s)
+		{
+			fprintf(stderr, "only %u of %u players could join\n", num_joined, config.num_players);
+			server_should_run = false;
+			server_thread.join();
+			return 1;
+		}
+
+		for (uint32 i = 0; i < config.num_players; ++i)
+		{
+			if (!bots[i].is_joined)
+			{
+				bench_bot_join(&bots[i], buffer, &server_endpoint);
+				if ((i % c_bench_sends_per_yield) == c_bench_sends_per_yield - 1)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		num_joined = 0;
+		for (uint32 i = 0; i < config.num_players; ++i)
+		{
+			bench_bot_receive(&bots[i], packet_views, c_max_packet_views);
+			num_joined += bots[i].is_joined ? 1 : 0;
+		}
+	}
+
+	printf("fast forwarding %u ticks, %.1f minutes of play at %d ticks/s, %u players in %u rooms of %u%s%s\n",
+		config.num_ticks, config.num_ticks / (60.0f * config.tick_rate), config.tick_rate, config.num_players, config.num_rooms, max_clients,
+		config.replay_path ? ", replaying " : "", config.replay_path ? config.replay_path : "");
+	fflush(stdout);
+
+	if (config.profile_ticks)
+	{
+		profile_capture_request(config.profile_ticks);
+	}
+
+	float32 seconds_per_tick = 1.0f / config.tick_rate;
+	Bench_Recorded_Input* tick_record = new Bench_Recorded_Input[config.num_players](); // zeroed, padding included, so recordings of the same run are the same bytes
+	uint64 counters_start[(uint32)Metric_Counter::Count];
+	for (uint32 i = 0; i < (uint32)Metric_Counter::Count; ++i)
+	{
+		counters_start[i] = metrics_counter_read((Metric_Counter)i);
+	}
+	uint64 num_inputs_sent = 0;
+	uint64 input_bytes_sent = 0; // to check against what the server handled
+	int64 bots_time = 0;
+	int64 start_time = clock_now();
+	for (uint32 tick = 0; tick < config.num_ticks; ++tick)
+	{
+		int64 bots_start = clock_now();
+
+		// the player leaving joins again straight away, which the server handles before the tick
+		if (config.churn_ticks && tick && !(tick % config.churn_ticks))
+		{
+			Bench_Bot* bot = &bots[(tick / config.churn_ticks) % config.num_players];
+			uint32 leave_msg_size = Net::client_msg_leave_write(buffer);
+			Net::socket_send(&bot->sock, buffer, leave_msg_size, &server_endpoint);
+			bench_bot_join(bot, buffer, &server_endpoint);
+		}
+
+		for (uint32 i = 0; i < config.num_players; ++i)
+		{
+			Bench_Bot* bot = &bots[i];
+
+			// every player has an input every tick, whether it's sent or not, so replays line up
+			Player_Input input;
+			if (recorded_inputs)
+			{
+				recorded_input_read(&recorded_inputs[((uint64)tick * config.num_players) + i], &input);
+			}
+			else
+			{
+				bot_script_update(&bot->script_state, config.script, seconds_per_tick, &input);
+				Net::player_input_quantise(&input);
+				recorded_input_write(&tick_record[i], &input);
+			}
+
+			if (bot->is_joined)
+			{
+				uint32 input_msg_size = Net::client_msg_input_write(buffer, &input, bot->prediction_id, bot->latest_sequence);
+				Net::socket_send(&bot->sock, buffer, input_msg_size, &server_endpoint);
+				++bot->prediction_id;
+				++num_inputs_sent;
+				input_bytes_sent += input_msg_size;
+				if ((num_inputs_sent % c_bench_sends_per_yield) == 0)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+		if (record_file)
+		{
+			fwrite(tick_record, sizeof(Bench_Recorded_Input), config.num_players, record_file);
+		}
+		bots_time += clock_now() - bots_start;
+
+		bench_server_tick(&fast_forward);
+		profile_tick();
+
+		bots_start = clock_now();
+		for (uint32 i = 0; i < config.num_players; ++i)
+		{
+			bench_bot_receive(&bots[i], packet_views, c_max_packet_views);
+		}
+		bots_time += clock_now() - bots_start;
+	}
+	int64 end_time = clock_now();
+
+	uint64 counters[(uint32)Metric_Counter::Count];
+	for (uint32 i = 0; i < (uint32)Metric_Counter::Count; ++i)
+	{
+		counters[i] = metrics_counter_read((Metric_Counter)i) - counters_start[i];
+	}
+
+	float64 elapsed_s = (float64)(end_time - start_time) / clock_frequency();
+	float64 played_s = (float64)config.num_ticks * seconds_per_tick;
+	float64 ns_to_us_per_tick = 0.001 / config.num_ticks;
+	printf("\n  %u ticks in %.3fs, %.0f ticks/s, %.0fx real time\n", config.num_ticks, elapsed_s, config.num_ticks / elapsed_s, played_s / elapsed_s);
+	printf("\n  %-40s %12s %12s\n", "per tick", "us", "us/player");
+	struct Bench_Phase
+	{
+		const char* name;
+		Metric_Counter counter;
+	};
+	Bench_Phase phases[] =
+	{
+		{"dispatch (receive, joins, leaves)",		Metric_Counter::Server_Dispatch_Ns},
+		{"room inbox",								Metric_Counter::Server_Room_Inbox_Ns},
+		{"room simulate (tick_player)",				Metric_Counter::Server_Room_Simulate_Ns},
+		{"room encode (server_msg_state_write)",		Metric_Counter::Server_Room_Encode_Ns},
+		{"room send",								Metric_Counter::Server_Room_Send_Ns}
+	};
+	uint64 server_ns = 0;
+	for (uint32 i = 0; i < sizeof(phases) / sizeof(phases[0]); ++i)
+	{
+		uint64 ns = counters[(uint32)phases[i].counter];
+		server_ns += ns;
+		printf("  %-40s %12.2f %12.3f\n", phases[i].name, ns * ns_to_us_per_tick, ns * ns_to_us_per_tick / config.num_players);
+	}
+	printf("  %-40s %12.2f %12.3f\n", "server in all", server_ns * ns_to_us_per_tick, server_ns * ns_to_us_per_tick / config.num_players);
+	float64 bots_us = bots_time * 1000000.0 / clock_frequency();
+	printf("  %-40s %12.2f %12.3f\n", "bots (inputs, decoding state)", bots_us / config.num_ticks, bots_us / config.num_ticks / config.num_players);
+	float64 wall_us = elapsed_s * 1000000.0;
+	printf("  %-40s %12.2f\n", "handing over between threads", (wall_us - (server_ns / 1000.0) - bots_us) / config.num_ticks);
+	printf("  %-40s %12.2f\n", "wall clock", wall_us / config.num_ticks);
+
+	printf("\n  state sent %.0f bytes/tick\n", (float64)counters[(uint32)Metric_Counter::Server_Msg_State_Bytes] / config.num_ticks);
+	printf("  inputs %llu sent", num_inputs_sent);
+	if (counters[(uint32)Metric_Counter::Client_Msg_Input_Bytes] < input_bytes_sent)
+	{
+		printf(", the rest were dropped by a full in process queue, so this run isn't comparable");
+	}
+	printf("\n");
+	if (config.churn_ticks)
+	{
+		printf("  %llu leaves and rejoins\n", counters[(uint32)Metric_Counter::Server_Leaves]);
+	}
+	printf("  state checksum %08x, runs playing the same inputs should match\n", bench_checksum(bots, config.num_players));
+
+	if (record_file)
+	{
+		fclose(record_file);
+		printf("  recorded to %s\n", config.record_path);
+	}
+
+	for (uint32 i = 0; i < config.num_players; ++i)
+	{
+		uint32 leave_msg_size = Net::client_msg_leave_write(buffer);
+		Net::socket_send(&bots[i].sock, buffer, leave_msg_size, &server_endpoint);
+		Net::socket_close(&bots[i].sock);
+	}
+	server_should_run = false;
+	server_thread.join();
+	profile_shutdown();
+	delete[] tick_record;
+	delete[] recorded_inputs;
+
+	return 0;
+}
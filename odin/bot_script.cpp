@@ -0,0 +1,102 @@
+#include "bot_script.h"
+
+#include <cstring>
+
+
+
+// xorshift64*, as the link emulator
+static uint32 bot_script_random_u32(Bot_Script_State* state)
+{
+	uint64 x = state->random_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	state->random_state = x;
+	return (uint32)((x * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+float32 bot_script_random_f32(Bot_Script_State* state)
+{
+	return (bot_script_random_u32(state) >> 8) / (float32)(1 << 24);
+}
+
+void bot_script_init(Bot_Script_State* state, uint64 seed, uint32 bot_index)
+{
+	*state = {};
+	state->random_state = (seed * 0x9E3779B97F4A7C15ull) + bot_index + 1;
+}
+
+bool32 bot_script_parse(const char* name, Bot_Script* out_script)
+{
+	if (!strcmp(name, "random"))
+	{
+		*out_script = Bot_Script::Random;
+	}
+	else if (!strcmp(name, "forward"))
+	{
+		*out_script = Bot_Script::Forward;
+	}
+	else if (!strcmp(name, "circle"))
+	{
+		*out_script = Bot_Script::Circle;
+	}
+	else if (!strcmp(name, "idle"))
+	{
+		*out_script = Bot_Script::Idle;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+void bot_script_update(Bot_Script_State* state, Bot_Script script, float32 dt, Player_Input* out_input)
+{
+	Player_Input* input = &state->input;
+	switch (script)
+	{
+		case Bot_Script::Random:
+		{
+			state->time_to_change_s -= dt;
+			if (state->time_to_change_s <= 0.0f)
+			{
+				uint32 keys = bot_script_random_u32(state);
+				input->up = keys & 1;
+				input->down = !input->up && (keys & 2);
+				input->left = (keys & 4) && (keys & 8);
+				input->right = !input->left && (keys & 16) && (keys & 32);
+				input->jump = (keys & 0xc0) == 0xc0;
+				input->yaw += (bot_script_random_f32(state) - 0.5f) * c_pi;
+				state->time_to_change_s = 0.25f + (bot_script_random_f32(state) * 0.75f);
+			}
+		}
+		break;
+
+		case Bot_Script::Forward:
+		{
+			input->up = true;
+		}
+		break;
+
+		case Bot_Script::Circle:
+		{
+			input->up = true;
+			input->yaw += c_pi * 0.5f * dt;
+		}
+		break;
+
+		case Bot_Script::Idle:
+		break;
+	}
+
+	if (input->yaw > c_pi)
+	{
+		input->yaw -= 2.0f * c_pi;
+	}
+	else if (input->yaw < -c_pi)
+	{
+		input->yaw += 2.0f * c_pi;
+	}
+	*out_input = *input;
+}
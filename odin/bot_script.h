@@ -0,0 +1,31 @@
+#pragma once
+
+#include "core.h"
+#include "player.h"
+
+
+
+// what a synthetic player does, shared by the bots (odin_bots) and the fast forward benchmark (odin_bench).
+// Scripts only move on with the time they're given, not the clock, so the same seed always plays the same
+enum class Bot_Script : uint8
+{
+	Random, // changes keys and turns every so often
+	Forward,
+	Circle,
+	Idle // sends inputs with nothing pressed
+};
+
+struct Bot_Script_State
+{
+	uint64 random_state;
+	Player_Input input;
+	float32 time_to_change_s; // for random, until it picks new keys
+};
+
+void	bot_script_init(Bot_Script_State* state, uint64 seed, uint32 bot_index);
+// returns false if the name isn't a script
+bool32	bot_script_parse(const char* name, Bot_Script* out_script);
+// moves the script on by dt and returns the input for it, unquantised
+void	bot_script_update(Bot_Script_State* state, Bot_Script script, float32 dt, Player_Input* out_input);
+// in [0, 1), from the same sequence the script uses
+float32	bot_script_random_f32(Bot_Script_State* state);
@@ -0,0 +1,786 @@
+#include "bot_script.h"
+#include "cli_args.h"
+#include "core.h"
+#include "net.h"
+#include "net_msgs.h"
+#include "player.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#ifdef __linux__
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif // #ifdef __linux__
+
+
+
+// headless load generator. Each bot joins the server over a socket of its own and plays like the client
+// does, sending scripted or random inputs, predicting its own movement and reconciling it with the state
+// the server sends back. Bots can be ramped up a few at a time, with a report line per interval, so one
+// run shows how many clients a server keeps up with before state arrives late or predictions go wrong
+
+
+constexpr uint32 c_max_bots						= 4096;
+constexpr float32 c_join_resend_s				= 1.0f;
+constexpr uint32 c_bot_prediction_capacity		= 512;
+constexpr uint32 c_bot_prediction_mask			= c_bot_prediction_capacity - 1;
+constexpr float32 c_max_prediction_error		= 0.001f; // 0.1cm, as the client
+constexpr uint32 c_max_inputs_per_poll			= 8; // a bot further behind than this skips ahead rather than flooding
+constexpr float32 c_keeping_up_state_rate		= 0.95f; // fraction of the server tick rate
+constexpr float32 c_keeping_up_mispredictions	= 0.05f;
+
+enum class Bot_Status : uint8
+{
+	Not_Started,
+	Joining,
+	Joined,
+	Rejected
+};
+
+struct Bot_Stats
+{
+	uint32 num_inputs_sent;
+	uint32 num_states; // complete snapshots
+	uint32 num_state_intervals;
+	float64 state_interval_sum_ms; // time between snapshots, for jitter
+	float64 state_interval_sum_sq_ms;
+	float64 state_interval_max_ms;
+	uint32 num_reconciled; // snapshots which carried one of our predictions to check against
+	uint32 num_mispredicted;
+	float64 error_sum;
+	float64 error_max;
+};
+
+struct Bot_Prediction
+{
+	Player_Input input;
+	Player_Snapshot_State snapshot_state; // after the input
+	Player_Extra_State extra_state;
+};
+
+struct Bot
+{
+	Net::Socket sock;
+	Bot_Status status;
+	int64 first_join_time;
+	int64 last_join_time;
+	int64 join_latency;
+	uint32 slot;
+	uint32 room_max_players;
+	float32 seconds_per_tick;
+	int64 input_interval; // clock ticks
+	int64 next_input_time;
+	Net::Snapshot_History snapshot_history; // allocated once the room size is known
+	bool32 has_snapshot_history;
+	uint32 latest_sequence;
+	int64 first_state_time; // 0 until the first state arrives
+	int64 last_state_time;
+	uint32 prediction_id; // starts at 1, so the server reporting 0 means it hasn't simulated any of ours yet
+	Player_Snapshot_State snapshot_state;
+	Player_Extra_State extra_state;
+	Bot_Prediction* predictions;
+	Bot_Script_State script_state;
+	Bot_Stats interval_stats; // since the last report
+	Bot_Stats total_stats;
+};
+
+struct Bots_Config
+{
+	Net::IP_Endpoint server_endpoint;
+	uint32 num_bots;
+	uint32 ramp_step; // bots started per report interval, 0 to start them all at once
+	float32 duration_s;
+	float32 report_interval_s;
+	float32 input_rate; // inputs per second, 0 for the server's tick rate
+	Bot_Script script;
+	uint64 seed;
+	bool32 per_bot_report;
+};
+
+static std::atomic_bool g_should_run;
+
+static void on_stop_signal(int /*signal*/)
+{
+	g_should_run.store(false, std::memory_order_relaxed);
+}
+
+static void print_usage(const char* program_name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --server <a.b.c.d>       server address (default 127.0.0.1)\n"
+		"  --port <port>            server port (default %hu)\n"
+		"  --bots <n>               bots to run, up to %u (default 100)\n"
+		"  --ramp <n>               start this many more bots each report interval, 0 starts them all at once (default 0)\n"
+		"  --duration <seconds>     how long to run for (default 10)\n"
+		"  --report <seconds>       how often to print a report line (default 1)\n"
+		"  --input-rate <hz>        inputs each bot sends per second, 0 for the server's tick rate (default 0)\n"
+		"  --script <random|forward|circle|idle>  what the bots do (default random)\n"
+		"  --seed <n>               seeds the random script (default 1)\n"
+		"  --per-bot                also report every bot at the end\n",
+		program_name, c_port, c_max_bots);
+}
+
+static void bot_stats_add(Bot_Stats* total, Bot_Stats* stats)
+{
+	total->num_inputs_sent += stats->num_inputs_sent;
+	total->num_states += stats->num_states;
+	total->num_state_intervals += stats->num_state_intervals;
+	total->state_interval_sum_ms += stats->state_interval_sum_ms;
+	total->state_interval_sum_sq_ms += stats->state_interval_sum_sq_ms;
+	if (stats->state_interval_max_ms > total->state_interval_max_ms)
+	{
+		total->state_interval_max_ms = stats->state_interval_max_ms;
+	}
+	total->num_reconciled += stats->num_reconciled;
+	total->num_mispredicted += stats->num_mispredicted;
+	total->error_sum += stats->error_sum;
+	if (stats->error_max > total->error_max)
+	{
+		total->error_max = stats->error_max;
+	}
+}
+
+// standard deviation of the time between snapshots
+static float64 bot_stats_jitter_ms(Bot_Stats* stats)
+{
+	if (stats->num_state_intervals < 2)
+	{
+		return 0.0;
+	}
+	float64 mean = stats->state_interval_sum_ms / stats->num_state_intervals;
+	float64 variance = (stats->state_interval_sum_sq_ms / stats->num_state_intervals) - (mean * mean);
+	return variance > 0.0 ? sqrt(variance) : 0.0;
+}
+
+static void bot_join_send(Bot* bot, uint8* buffer, Net::IP_Endpoint* server_endpoint, int64 now)
+{
+	if (bot->status == Bot_Status::Not_Started)
+	{
+		bot->status = Bot_Status::Joining;
+		bot->first_join_time = now;
+	}
+	bot->last_join_time = now;
+	uint32 join_msg_size = Net::client_msg_join_write(buffer);
+	Net::socket_send(&bot->sock, buffer, join_msg_size, server_endpoint);
+}
+
+static void bot_state_received(Bot* bot, uint32 received_sequence, uint32 received_prediction_id, Player_Extra_State* received_extra_state, int64 now)
+{
+	Bot_Stats* stats = &bot->interval_stats;
+	++stats->num_states;
+	if (bot->last_state_time)
+	{
+		float64 interval_ms = (now - bot->last_state_time) * 1000.0 / clock_frequency();
+		++stats->num_state_intervals;
+		stats->state_interval_sum_ms += interval_ms;
+		stats->state_interval_sum_sq_ms += interval_ms * interval_ms;
+		if (interval_ms > stats->state_interval_max_ms)
+		{
+			stats->state_interval_max_ms = interval_ms;
+		}
+	}
+	else
+	{
+		bot->first_state_time = now;
+	}
+	bot->last_state_time = now;
+
+	// nothing to check until the server has simulated one of ours, and nothing to check against if it's
+	// so far behind the prediction has been overwritten
+	if (!received_prediction_id ||
+		received_prediction_id >= bot->prediction_id ||
+		bot->prediction_id - received_prediction_id > c_bot_prediction_capacity)
+	{
+		return;
+	}
+
+	Net::Snapshot* snapshot = Net::snapshot_history_get(&bot->snapshot_history, received_sequence);
+	Player_Snapshot_State* received_snapshot_state = &snapshot->player_snapshot_states[bot->slot];
+	Bot_Prediction* prediction = &bot->predictions[received_prediction_id & c_bot_prediction_mask];
+	float64 error = sqrt(vec_3f_length_sq(vec_3f_sub(received_snapshot_state->position, prediction->snapshot_state.position)));
+	++stats->num_reconciled;
+	stats->error_sum += error;
+	if (error > stats->error_max)
+	{
+		stats->error_max = error;
+	}
+	if (error <= c_max_prediction_error)
+	{
+		return;
+	}
+
+	// rewind and replay, as the client does
+	++stats->num_mispredicted;
+	bot->snapshot_state = *received_snapshot_state;
+	bot->extra_state = *received_extra_state;
+	for (uint32 replaying_prediction_id = received_prediction_id + 1; replaying_prediction_id < bot->prediction_id; ++replaying_prediction_id)
+	{
+		Bot_Prediction* replaying = &bot->predictions[replaying_prediction_id & c_bot_prediction_mask];
+		tick_player(&bot->snapshot_state, &bot->extra_state, bot->seconds_per_tick, &replaying->input);
+		replaying->snapshot_state = bot->snapshot_state;
+		replaying->extra_state = bot->extra_state;
+	}
+}
+
+static void bot_receive(Bot* bot, Net::Packet_View* packet_views, uint32 max_packet_views, Bots_Config* config, Linear_Allocator* allocator)
+{
+	uint32 num_received;
+	while ((num_received = Net::socket_receive_views(&bot->sock, packet_views, max_packet_views)) > 0)
+	{
+		int64 now = clock_now();
+		for (uint32 packet_index = 0; packet_index < num_received; ++packet_index)
+		{
+			uint8* packet = packet_views[packet_index].data;
+			uint32 packet_size = packet_views[packet_index].size;
+			Net::Server_Message message_type;
+			if (!Net::server_msg_type_read(packet, packet_size, &message_type))
+			{
+				continue;
+			}
+
+			switch (message_type)
+			{
+				case Net::Server_Message::Join_Result:
+				{
+					if (bot->status != Bot_Status::Joining)
+					{
+						break; // a resent join's result
+					}
+
+					bool32 success;
+					int32 server_tick_rate;
+					if (!Net::server_msg_join_result_read(packet, packet_size, &success, &bot->slot, &bot->room_max_players, &server_tick_rate))
+					{
+						break;
+					}
+					if (!success)
+					{
+						bot->status = Bot_Status::Rejected;
+						break;
+					}
+
+					bot->status = Bot_Status::Joined;
+					bot->join_latency = now - bot->first_join_time;
+					bot->seconds_per_tick = 1.0f / server_tick_rate;
+					float32 input_rate = config->input_rate > 0.0f ? config->input_rate : (float32)server_tick_rate;
+					bot->input_interval = (int64)(clock_frequency() / input_rate);
+					// spread the bots' inputs over the interval, rather than them all sending at once
+					bot->next_input_time = now + (int64)(bot_script_random_f32(&bot->script_state) * bot->input_interval);
+					if (!bot->has_snapshot_history)
+					{
+						Net::snapshot_history_create(&bot->snapshot_history, bot->room_max_players, allocator);
+						bot->has_snapshot_history = true;
+					}
+				}
+				break;
+
+				case Net::Server_Message::State:
+				{
+					if (bot->status != Bot_Status::Joined)
+					{
+						break;
+					}
+
+					uint32 received_sequence;
+					uint32 received_prediction_id;
+					Player_Extra_State received_extra_state;
+					bool32 is_complete;
+					if (!Net::server_msg_state_read(
+						packet,
+						packet_size,
+						&bot->snapshot_history,
+						&received_sequence,
+						bot->prediction_id,
+						&received_prediction_id,
+						&received_extra_state,
+						bot->room_max_players,
+						&is_complete))
+					{
+						break; // stale, a duplicate, cut short, or its baseline has already dropped out of history
+					}
+					if (!is_complete || received_sequence <= bot->latest_sequence)
+					{
+						break;
+					}
+					bot->latest_sequence = received_sequence;
+					bot_state_received(bot, received_sequence, received_prediction_id, &received_extra_state, now);
+				}
+				break;
+			}
+		}
+		Net::socket_release_views(&bot->sock, num_received);
+	}
+}
+
+static void bot_inputs_send(Bot* bot, Bot_Script script, uint8* buffer, Net::IP_Endpoint* server_endpoint, int64 now)
+{
+	uint32 num_sent = 0;
+	while (bot->next_input_time <= now)
+	{
+		if (num_sent == c_max_inputs_per_poll)
+		{
+			bot->next_input_time = now + bot->input_interval;
+			break;
+		}
+
+		Player_Input input;
+		bot_script_update(&bot->script_state, script, (float32)bot->input_interval / clock_frequency(), &input);
+		Net::player_input_quantise(&input);
+
+		uint32 input_msg_size = Net::client_msg_input_write(buffer, &input, bot->prediction_id, bot->latest_sequence);
+		Net::socket_send(&bot->sock, buffer, input_msg_size, server_endpoint);
+
+		tick_player(&bot->snapshot_state, &bot->extra_state, bot->seconds_per_tick, &input);
+		Bot_Prediction* prediction = &bot->predictions[bot->prediction_id & c_bot_prediction_mask];
+		prediction->input = input;
+		prediction->snapshot_state = bot->snapshot_state;
+		prediction->extra_state = bot->extra_state;
+		++bot->prediction_id;
+
+		++bot->interval_stats.num_inputs_sent;
+		++num_sent;
+		bot->next_input_time += bot->input_interval;
+	}
+}
+
+// one line per report interval, rates only count bots which had state for the whole interval
+// returns whether the server kept up
+static bool32 report_line_print(Bot* bots, uint32 num_started, float32 elapsed_s, float32 interval_s, float32 busy_fraction)
+{
+	uint32 num_joined = 0;
+	uint32 num_counted = 0;
+	float64 rate_sum = 0.0;
+	float64 rate_min = 0.0;
+	float64 jitter_sum = 0.0;
+	float64 gap_max = 0.0;
+	float64 tick_rate = 0.0;
+	Bot_Stats interval_total = {};
+	for (uint32 i = 0; i < num_started; ++i)
+	{
+		Bot* bot = &bots[i];
+		Bot_Stats* stats = &bot->interval_stats;
+		if (bot->status == Bot_Status::Joined)
+		{
+			++num_joined;
+			tick_rate = 1.0 / bot->seconds_per_tick;
+		}
+		if (bot->total_stats.num_states)
+		{
+			float64 rate = stats->num_states / interval_s;
+			rate_sum += rate;
+			if (!num_counted || rate < rate_min)
+			{
+				rate_min = rate;
+			}
+			jitter_sum += bot_stats_jitter_ms(stats);
+			if (stats->state_interval_max_ms > gap_max)
+			{
+				gap_max = stats->state_interval_max_ms;
+			}
+			++num_counted;
+		}
+		bot_stats_add(&interval_total, stats);
+		bot_stats_add(&bot->total_stats, stats);
+		*stats = {};
+	}
+
+	float64 rate_mean = num_counted ? rate_sum / num_counted : 0.0;
+	float64 mispredicted = interval_total.num_reconciled ? (float64)interval_total.num_mispredicted / interval_total.num_reconciled : 0.0;
+	if (num_counted)
+	{
+		printf("%8.1f %6u %6u %10.1f %10.1f %10.2f %10.1f %8.1f%% %10.4f %7.0f%%\n",
+			elapsed_s, num_started, num_joined, rate_mean, rate_min, jitter_sum / num_counted, gap_max,
+			mispredicted * 100.0, interval_total.num_reconciled ? interval_total.error_sum / interval_total.num_reconciled : 0.0,
+			busy_fraction * 100.0f);
+	}
+	else
+	{
+		printf("%8.1f %6u %6u %10s %10s %10s %10s %9s %10s %7.0f%%\n",
+			elapsed_s, num_started, num_joined, "-", "-", "-", "-", "-", "-", busy_fraction * 100.0f);
+	}
+	fflush(stdout);
+
+	return !num_counted || (rate_mean >= tick_rate * c_keeping_up_state_rate && mispredicted <= c_keeping_up_mispredictions);
+}
+
+static void summary_print(Bot* bots, uint32 num_started, float32 elapsed_s, int64 end_time, uint32 first_behind_bots, float32 busy_fraction)
+{
+	uint32 num_joined = 0;
+	uint32 num_rejected = 0;
+	float64 join_latency_sum_ms = 0.0;
+	float64 join_latency_max_ms = 0.0;
+	float64 rate_sum = 0.0;
+	float64 rate_min = 0.0;
+	float64 jitter_sum = 0.0;
+	float64 jitter_max = 0.0;
+	uint32 num_receiving = 0;
+	float64 tick_rate = 0.0;
+	float64 input_rate = 0.0;
+	Bot_Stats total = {};
+	for (uint32 i = 0; i < num_started; ++i)
+	{
+		Bot* bot = &bots[i];
+		if (bot->status == Bot_Status::Rejected)
+		{
+			++num_rejected;
+		}
+		if (bot->status != Bot_Status::Joined)
+		{
+			continue;
+		}
+
+		++num_joined;
+		tick_rate = 1.0 / bot->seconds_per_tick;
+		input_rate = (float64)clock_frequency() / bot->input_interval;
+		float64 join_latency_ms = bot->join_latency * 1000.0 / clock_frequency();
+		join_latency_sum_ms += join_latency_ms;
+		if (join_latency_ms > join_latency_max_ms)
+		{
+			join_latency_max_ms = join_latency_ms;
+		}
+
+		Bot_Stats* stats = &bot->total_stats;
+		bot_stats_add(&total, stats);
+		if (stats->num_states > 1)
+		{
+			float64 rate = (stats->num_states - 1) / ((end_time - bot->first_state_time) / (float64)clock_frequency());
+			rate_sum += rate;
+			if (!num_receiving || rate < rate_min)
+			{
+				rate_min = rate;
+			}
+			float64 jitter = bot_stats_jitter_ms(stats);
+			jitter_sum += jitter;
+			if (jitter > jitter_max)
+			{
+				jitter_max = jitter;
+			}
+			++num_receiving;
+		}
+	}
+
+	printf("\nafter %.1fs\n", elapsed_s);
+	printf("  bots                 %u started, %u joined, %u rejected (rooms full), %u never heard back\n",
+		num_started, num_joined, num_rejected, num_started - num_joined - num_rejected);
+	if (num_joined)
+	{
+		printf("  join latency         %.2fms mean, %.2fms max\n", join_latency_sum_ms / num_joined, join_latency_max_ms);
+		printf("  server tick rate     %.0f/s, bots sending %.1f inputs/s each, %u inputs in all\n", tick_rate, input_rate, total.num_inputs_sent);
+	}
+	if (num_receiving)
+	{
+		printf("  state per bot        %.2f/s mean, %.2f/s worst\n", rate_sum / num_receiving, rate_min);
+		printf("  state jitter         %.2fms mean, %.2fms worst, longest gap %.1fms\n", jitter_sum / num_receiving, jitter_max, total.state_interval_max_ms);
+	}
+	if (total.num_reconciled)
+	{
+		printf("  reconciliation       %u checked, %.2f%% mispredicted, error %.4f mean, %.4f max\n",
+			total.num_reconciled, total.num_mispredicted * 100.0 / total.num_reconciled, total.error_sum / total.num_reconciled, total.error_max);
+	}
+	printf("  bots busy            %.0f%% of the time, if this is near 100%% the bots rather than the server are the limit\n", busy_fraction * 100.0f);
+	if (first_behind_bots)
+	{
+		printf("  server fell behind at %u bots\n", first_behind_bots);
+	}
+	else if (num_receiving)
+	{
+		printf("  server kept up with %u bots\n", num_joined);
+	}
+}
+
+static void per_bot_report_print(Bot* bots, uint32 num_started, int64 end_time)
+{
+	printf("\n%6s %6s %10s %10s %10s %10s %10s\n", "bot", "slot", "states/s", "jitter ms", "gap ms", "mispred", "err max");
+	for (uint32 i = 0; i < num_started; ++i)
+	{
+		Bot* bot = &bots[i];
+		if (bot->status != Bot_Status::Joined)
+		{
+			printf("%6u %s\n", i, bot->status == Bot_Status::Rejected ? "rejected" : "didn't join");
+			continue;
+		}
+
+		Bot_Stats* stats = &bot->total_stats;
+		float64 rate = stats->num_states > 1 ? (stats->num_states - 1) / ((end_time - bot->first_state_time) / (float64)clock_frequency()) : 0.0;
+		printf("%6u %6u %10.2f %10.2f %10.1f %9.1f%% %10.4f\n",
+			i, bot->slot, rate, bot_stats_jitter_ms(stats), stats->state_interval_max_ms,
+			stats->num_reconciled ? stats->num_mispredicted * 100.0 / stats->num_reconciled : 0.0, stats->error_max);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Bots_Config config = {};
+	config.server_endpoint = Net::ip_endpoint(127, 0, 0, 1, c_port);
+	config.num_bots = 100;
+	config.ramp_step = 0;
+	config.duration_s = 10.0f;
+	config.report_interval_s = 1.0f;
+	config.input_rate = 0.0f;
+	config.script = Bot_Script::Random;
+	config.seed = 1;
+	config.per_bot_report = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		uint32 value;
+		if (!strcmp(arg, "--server") && i + 1 < argc)
+		{
+			++i;
+			uint32 a, b, c, d;
+			char end;
+			if (sscanf(argv[i], "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+			{
+				fprintf(stderr, "--server must be an ipv4 address like 127.0.0.1, got %s\n", argv[i]);
+				return 1;
+			}
+			config.server_endpoint = Net::ip_endpoint((uint8)a, (uint8)b, (uint8)c, (uint8)d, config.server_endpoint.port);
+		}
+		else if (!strcmp(arg, "--port"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 65535, &value))
+			{
+				return 1;
+			}
+			config.server_endpoint.port = (uint16)value;
+		}
+		else if (!strcmp(arg, "--bots"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_max_bots, &config.num_bots))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--ramp"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 0, c_max_bots, &config.ramp_step))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--duration"))
+		{
+			if (!cli_args_parse_float(argc, argv, &i, 0.1f, &config.duration_s))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--report"))
+		{
+			if (!cli_args_parse_float(argc, argv, &i, 0.1f, &config.report_interval_s))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--input-rate"))
+		{
+			if (!cli_args_parse_float(argc, argv, &i, 0.0f, &config.input_rate))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--script") && i + 1 < argc)
+		{
+			++i;
+			if (!bot_script_parse(argv[i], &config.script))
+			{
+				fprintf(stderr, "--script must be random, forward, circle or idle, got %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--seed"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 0, 0xffffffff, &value))
+			{
+				return 1;
+			}
+			config.seed = value;
+		}
+		else if (!strcmp(arg, "--per-bot"))
+		{
+			config.per_bot_report = true;
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return !strcmp(arg, "--help") ? 0 : 1;
+		}
+	}
+
+	if (!Net::init())
+	{
+		return 1;
+	}
+
+	// sockets, predictions and snapshot history for the biggest room a server can have, only what the
+	// room a bot joins needs is touched
+	uint64 bot_memory_size = sizeof(Bot) + Net::socket_memory_size(Net::Socket_Type::Udp) + (sizeof(Bot_Prediction) * c_bot_prediction_capacity) + Net::snapshot_history_memory_size(c_max_clients);
+	Linear_Allocator allocator;
+	linear_allocator_create(&allocator, kilobytes(64) + (bot_memory_size * config.num_bots));
+
+	Bot* bots = (Bot*)linear_allocator_alloc(&allocator, sizeof(Bot) * config.num_bots);
+	for (uint32 i = 0; i < config.num_bots; ++i)
+	{
+		Bot* bot = &bots[i];
+		*bot = {};
+		if (!Net::socket(&bot->sock, Net::Socket_Type::Udp, &allocator))
+		{
+			fprintf(stderr, "couldn't create socket %u, is the file descriptor limit (ulimit -n) high enough?\n", i);
+			return 1;
+		}
+		bot->predictions = (Bot_Prediction*)linear_allocator_alloc(&allocator, sizeof(Bot_Prediction) * c_bot_prediction_capacity);
+		bot->prediction_id = 1;
+		bot_script_init(&bot->script_state, config.seed, i);
+	}
+
+	constexpr uint32 c_max_packet_views = 16;
+	Net::Packet_View packet_views[c_max_packet_views];
+	uint8 buffer[c_packet_budget_per_tick];
+
+#ifdef __linux__
+	// one epoll for every bot's socket, so a poll only touches the bots with packets waiting
+	int epoll_fd = epoll_create1(0);
+	if (epoll_fd == -1)
+	{
+		fprintf(stderr, "epoll_create1() failed: %d\n", errno);
+		return 1;
+	}
+	for (uint32 i = 0; i < config.num_bots; ++i)
+	{
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u32 = i;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, Net::socket_wait_handle(&bots[i].sock), &event);
+	}
+	constexpr uint32 c_max_events = 256;
+	epoll_event events[c_max_events];
+#endif // #ifdef __linux__
+
+	g_should_run.store(true, std::memory_order_relaxed);
+	signal(SIGINT, &on_stop_signal);
+	signal(SIGTERM, &on_stop_signal);
+
+	char server_str[22];
+	Net::ip_endpoint_to_str(server_str, sizeof(server_str), &config.server_endpoint);
+	printf("%u bots against %s", config.num_bots, server_str);
+	if (config.ramp_step)
+	{
+		printf(", %u more every %.1fs", config.ramp_step, config.report_interval_s);
+	}
+	printf(", for %.1fs\n\n", config.duration_s);
+	printf("%8s %6s %6s %10s %10s %10s %10s %9s %10s %8s\n",
+		"time s", "bots", "joined", "states/s", "worst", "jitter ms", "gap ms", "mispred", "error", "busy");
+
+	int64 clock_ticks_per_second = clock_frequency();
+	int64 start_time = clock_now();
+	int64 join_resend_interval = (int64)(c_join_resend_s * clock_ticks_per_second);
+	int64 report_interval = (int64)(config.report_interval_s * clock_ticks_per_second);
+	int64 end_time = start_time + (int64)(config.duration_s * clock_ticks_per_second);
+	int64 next_report_time = start_time + report_interval;
+	int64 wait_time_total = 0; // for how busy the bots are
+	int64 interval_wait_time = 0;
+	uint32 num_started = 0;
+	uint32 num_reports = 0;
+	uint32 first_behind_bots = 0;
+	int64 now = start_time;
+	while (g_should_run.load(std::memory_order_relaxed) && now < end_time)
+	{
+		// ramp up, a step at the start of each report interval
+		uint32 num_to_start = config.ramp_step ? config.ramp_step * (num_reports + 1) : config.num_bots;
+		if (num_to_start > config.num_bots)
+		{
+			num_to_start = config.num_bots;
+		}
+		for (; num_started < num_to_start; ++num_started)
+		{
+			bot_join_send(&bots[num_started], buffer, &config.server_endpoint, now);
+		}
+
+		// wait for packets, or a millisecond, as inputs are due at the tick rate
+		int64 wait_start = clock_now();
+#ifdef __linux__
+		int num_events = epoll_wait(epoll_fd, events, c_max_events, 1);
+		int64 wait_end = clock_now();
+		for (int i = 0; i < num_events; ++i)
+		{
+			bot_receive(&bots[events[i].data.u32], packet_views, c_max_packet_views, &config, &allocator);
+		}
+#else
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		int64 wait_end = clock_now();
+		for (uint32 i = 0; i < num_started; ++i)
+		{
+			bot_receive(&bots[i], packet_views, c_max_packet_views, &config, &allocator);
+		}
+#endif // #ifdef __linux__
+		interval_wait_time += wait_end - wait_start;
+
+		now = clock_now();
+		for (uint32 i = 0; i < num_started; ++i)
+		{
+			Bot* bot = &bots[i];
+			if (bot->status == Bot_Status::Joined)
+			{
+				bot_inputs_send(bot, config.script, buffer, &config.server_endpoint, now);
+			}
+			else if (bot->status == Bot_Status::Joining && now - bot->last_join_time >= join_resend_interval)
+			{
+				bot_join_send(bot, buffer, &config.server_endpoint, now);
+			}
+		}
+
+		if (now >= next_report_time)
+		{
+			float32 interval_s = (float32)(now - (next_report_time - report_interval)) / clock_ticks_per_second;
+			float32 busy_fraction = 1.0f - ((float32)interval_wait_time / (now - (next_report_time - report_interval)));
+			bool32 kept_up = report_line_print(bots, num_started, (float32)(now - start_time) / clock_ticks_per_second, interval_s, busy_fraction);
+			// only the first interval a step is fully running for counts, the one it joins in is partial
+			if (!kept_up && !first_behind_bots && num_reports)
+			{
+				first_behind_bots = num_started;
+			}
+			wait_time_total += interval_wait_time;
+			interval_wait_time = 0;
+			next_report_time = now + report_interval;
+			++num_reports;
+		}
+	}
+
+	// anything since the last report line still counts towards the summary
+	for (uint32 i = 0; i < num_started; ++i)
+	{
+		bot_stats_add(&bots[i].total_stats, &bots[i].interval_stats);
+	}
+	wait_time_total += interval_wait_time;
+	float32 elapsed_s = (float32)(now - start_time) / clock_ticks_per_second;
+	float32 busy_fraction = 1.0f - ((float32)wait_time_total / (now - start_time));
+	summary_print(bots, num_started, elapsed_s, now, first_behind_bots, busy_fraction);
+	if (config.per_bot_report)
+	{
+		per_bot_report_print(bots, num_started, now);
+	}
+
+	for (uint32 i = 0; i < num_started; ++i)
+	{
+		if (bots[i].status == Bot_Status::Joined)
+		{
+			uint32 leave_msg_size = Net::client_msg_leave_write(buffer);
+			Net::socket_send(&bots[i].sock, buffer, leave_msg_size, &config.server_endpoint);
+		}
+		Net::socket_close(&bots[i].sock);
+	}
+#ifdef __linux__
+	close(epoll_fd);
+#endif // #ifdef __linux__
+
+	return 0;
+}
@@ -0,0 +1,50 @@
+#include "cli_args.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+
+
+bool32 cli_args_parse_uint(int argc, char** argv, int* arg_index, uint32 min, uint32 max, uint32* out_value)
+{
+	if (*arg_index + 1 >= argc)
+	{
+		fprintf(stderr, "%s needs a value\n", argv[*arg_index]);
+		return false;
+	}
+
+	++(*arg_index);
+	const char* str = argv[*arg_index];
+	char* end;
+	unsigned long value = strtoul(str, &end, 10);
+	if (end == str || *end || value < min || value > max)
+	{
+		fprintf(stderr, "%s must be a number from %u to %u, got %s\n", argv[*arg_index - 1], min, max, str);
+		return false;
+	}
+
+	*out_value = (uint32)value;
+	return true;
+}
+
+bool32 cli_args_parse_float(int argc, char** argv, int* arg_index, float32 min, float32* out_value)
+{
+	if (*arg_index + 1 >= argc)
+	{
+		fprintf(stderr, "%s needs a value\n", argv[*arg_index]);
+		return false;
+	}
+
+	++(*arg_index);
+	const char* str = argv[*arg_index];
+	char* end;
+	float32 value = strtof(str, &end);
+	if (end == str || *end || !(value >= min))
+	{
+		fprintf(stderr, "%s must be a number from %.1f up, got %s\n", argv[*arg_index - 1], min, str);
+		return false;
+	}
+
+	*out_value = value;
+	return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "core.h"
+
+
+
+// option values for the command line tools (odin_server, odin_bots, odin_bench, odin_net_bench), each reads the
+// value after the option at argv[*arg_index], moving arg_index on to it. Problems are reported on stderr
+
+// returns false if the value is missing or not a number in [min, max]
+bool32 cli_args_parse_uint(int argc, char** argv, int* arg_index, uint32 min, uint32 max, uint32* out_value);
+// returns false if the value is missing, not a number, or below min
+bool32 cli_args_parse_float(int argc, char** argv, int* arg_index, float32 min, float32* out_value);
@@ -10,6 +10,7 @@
 #include "net.h"
 #include "net_msgs.h"
 #include "player.h"
+#include "profile.h"
 #include "server.h"
 
 
@@ -21,6 +22,8 @@ struct Client_Input
 	bool32 keys[256];
 };
 
+constexpr uint32 c_profile_frames = 120; // how many frames F9 captures
+
 struct Client_Globals
 {
 	Client_Input input;
@@ -43,6 +46,10 @@ LRESULT CALLBACK window_callback(HWND window_handle, UINT message, WPARAM w_para
 			break;
 
 		case WM_KEYDOWN:
+			if (w_param == VK_F9)
+			{
+				profile_capture_request(c_profile_frames);
+			}
 			if (globals->input.has_focus)
 			{
 				assert(w_param < 256);
@@ -162,7 +169,20 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE /*prev_instance*/, LPSTR /*cm
 	}
 
 	std::atomic_bool server_should_run = true;
-	std::thread server_thread(&server_main, &server_should_run);
+	// listen server, the server runs on a thread in this process so talk to it through in process sockets
+	Server_Config server_config = {};
+	server_config.port = c_port;
+	server_config.tick_rate = c_default_server_tick_rate;
+	server_config.max_clients = c_default_max_clients;
+	server_config.num_rooms = 1;
+	server_config.num_room_workers = 0;
+	server_config.socket_type = Net::Socket_Type::In_Process;
+	server_config.num_receive_shards = 0;
+	server_config.wait_for_events = false;
+	server_config.num_state_encode_workers = 1;
+	server_config.stats_interval_s = 0.0f;
+	server_config.ticks_profiler = false; // captures are counted in frames, below
+	std::thread server_thread(&server_main, &server_should_run, &server_config);
 
 	Linear_Allocator allocator;
 	linear_allocator_create(&allocator, megabytes(16));
@@ -182,14 +202,21 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE /*prev_instance*/, LPSTR /*cm
 					&allocator, &temp_allocator);
 
 	Net::Socket sock;
-	if (!Net::socket(&sock))
+	if (!Net::socket(&sock, Net::Socket_Type::In_Process, &allocator))
 	{
 		return 0;
 	}
-	Net::socket_set_fake_lag_s(&sock, 0.2f, &allocator); // 200ms of fake lag
+#ifdef _DEBUG
+	// 200ms round trip in debug builds, to keep prediction/interpolation honest
+	Net::Link_Profile link_profile = {};
+	link_profile.latency_s = 0.1f;
+	Net::socket_set_link_profile(&sock, &link_profile, &link_profile, /*seed*/ 1, &allocator);
+#endif
 
 	constexpr uint32 c_socket_buffer_size = c_packet_budget_per_tick;
 	uint8* socket_buffer = linear_allocator_alloc(&allocator, c_socket_buffer_size);
+	constexpr uint32 c_max_packet_views = 16;
+	Net::Packet_View* packet_views = (Net::Packet_View*)linear_allocator_alloc(&allocator, sizeof(Net::Packet_View) * c_max_packet_views);
 	Net::IP_Endpoint server_endpoint = Net::ip_endpoint(127, 0, 0, 1, c_port);
 
 	uint32 join_msg_size = Net::client_msg_join_write(socket_buffer);
@@ -200,6 +227,11 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE /*prev_instance*/, LPSTR /*cm
 
 	Player_Snapshot_State* player_snapshot_states	= (Player_Snapshot_State*)	linear_allocator_alloc(&allocator, sizeof(Player_Snapshot_State) * c_max_clients);
 	bool32* players_present							= (bool32*)					linear_allocator_alloc(&allocator, sizeof(bool32) * c_max_clients);
+
+	// state messages are deltas against snapshots we've acked, so keep recent ones around to decode against
+	Net::Snapshot_History snapshot_history;
+	Net::snapshot_history_create(&snapshot_history, c_max_clients, &allocator);
+	uint32 latest_sequence = 0;
 	Matrix_4x4* mvp_matrices						= (Matrix_4x4*)				linear_allocator_alloc(&allocator, sizeof(Matrix_4x4) * (c_max_clients + 1)); // todo(jbr) all these arrays should be named singular not plural
 
 	Player_Snapshot_State*	local_player_snapshot_state			= (Player_Snapshot_State*)	linear_allocator_alloc(&allocator, sizeof(Player_Snapshot_State));
@@ -233,14 +265,21 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE /*prev_instance*/, LPSTR /*cm
 	constexpr float32 c_seconds_per_tick = 1.0f / c_tick_rate;
 
 	uint32 local_player_slot = (uint32)-1;
-	uint32 prediction_id = 0; // todo(jbr) rolling sequence number, could maybe get away with 8 bits, certainly 9 or 10
+	uint32 room_max_players = 0; // state messages are sized for the room, which comes with the join result
+	float32 server_seconds_per_tick = 0.0f; // inputs are made at the server's tick rate, which comes with the join result
+	float32 input_time_s = 0.0f; // time since the last input was made
+	uint32 prediction_id = 0; // only the low bits are sent, see Net::sequence_expand
 
 	Timer tick_timer = timer();
+	profile_thread_name("client");
 	
 	// main loop
 	int exit_code = 0;
 	while (true)
 	{
+		profile_tick();
+		PROFILE_SCOPE("frame");
+
 		// Windows messages
 		bool32 got_quit_message = 0;
 		MSG message;
@@ -264,120 +303,184 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE /*prev_instance*/, LPSTR /*cm
 			break;
 		}
 
-		// consume mouse deltas from input so it resets every tick
-		int32 mouse_delta_x = client_globals->input.mouse_delta_x;
-		int32 mouse_delta_y = client_globals->input.mouse_delta_y;
-		client_globals->input.mouse_delta_x = 0; 
-		client_globals->input.mouse_delta_y = 0;
-
-		// Process Packets
-		uint32 bytes_received;
-		Net::IP_Endpoint from;
-		while (Net::socket_receive(&sock, socket_buffer, c_socket_buffer_size, &bytes_received, &from))
+		// Process Packets, reading them in place from the socket's receive ring
+		uint32 num_received;
+		while ((num_received = Net::socket_receive_views(&sock, packet_views, c_max_packet_views)) > 0)
 		{
-			switch ((Net::Server_Message)socket_buffer[0])
+			for (uint32 packet_index = 0; packet_index < num_received; ++packet_index)
 			{
-				case Net::Server_Message::Join_Result:
+				uint8* packet = packet_views[packet_index].data;
+				uint32 packet_size = packet_views[packet_index].size;
+
+				Net::Server_Message message_type;
+				if (!Net::server_msg_type_read(packet, packet_size, &message_type))
 				{
-					bool32 success;
-					Net::server_msg_join_result_read(socket_buffer, &success, &local_player_slot);
-					if (!success)
-					{
-						log("[client] server didn't let us in\n");
-					}
+					continue; // too short, or not a message at all
 				}
-				break;
 
-				case Net::Server_Message::State:
+				switch (message_type)
 				{
-					uint32 received_prediction_id;
-					Player_Extra_State received_local_player_extra_state;
-					Net::server_msg_state_read(
-						socket_buffer, 
-						&received_prediction_id, 
-						&received_local_player_extra_state, 
-						player_snapshot_states, 
-						players_present,
-						c_max_clients);
-
-					int32 ticks_ahead = prediction_id - received_prediction_id;
-					assert(ticks_ahead > -1);
-					assert(ticks_ahead <= c_prediction_buffer_capacity); // todo(jbr) cope better with this case
-					
-					Player_Snapshot_State* received_local_player_snapshot_state = &player_snapshot_states[local_player_slot];
-
-					uint32 index = received_prediction_id & c_prediction_buffer_mask;
-					Vec_3f delta_pos = vec_3f_sub(received_local_player_snapshot_state->position, predicted_move_result[index].snapshot_state.position);
-					constexpr float32 c_max_error = 0.001f; // 0.1cm
-					constexpr float32 c_max_error_sq = c_max_error * c_max_error;
-					if (vec_3f_length_sq(delta_pos) > c_max_error_sq)
+					case Net::Server_Message::Join_Result:
 					{
-						log("[client]error of (%f, %f, %f) detected at prediction id %d, rewinding and replaying\n", delta_pos.x, delta_pos.y, delta_pos.z, received_prediction_id);
-						
-						*local_player_snapshot_state = *received_local_player_snapshot_state;
-						*local_player_extra_state = received_local_player_extra_state;
+						bool32 success;
+						int32 server_tick_rate;
+						if (!Net::server_msg_join_result_read(packet, packet_size, &success, &local_player_slot, &room_max_players, &server_tick_rate))
+						{
+							break;
+						}
+						if (success)
+						{
+							server_seconds_per_tick = 1.0f / server_tick_rate;
+						}
+						else
+						{
+							log("[client] server didn't let us in\n");
+						}
+					}
+					break;
+
+					case Net::Server_Message::State:
+					{
+						if (!room_max_players)
+						{
+							break; // the join result hasn't arrived yet
+						}
+
+						uint32 received_sequence;
+						uint32 received_prediction_id;
+						Player_Extra_State received_local_player_extra_state;
+						bool32 is_complete;
+						if (!Net::server_msg_state_read(
+							packet, 
+							packet_size,
+							&snapshot_history,
+							&received_sequence,
+							prediction_id,
+							&received_prediction_id, 
+							&received_local_player_extra_state, 
+							room_max_players,
+							&is_complete))
+						{
+							break; // stale, a duplicate, cut short, or its baseline has already dropped out of history
+						}
+
+						if (!is_complete)
+						{
+							break; // more fragments of this snapshot still to come
+						}
 
-						for (uint32 replaying_prediction_id = received_prediction_id + 1; 
-							replaying_prediction_id < prediction_id; 
-							++replaying_prediction_id)
+						if (received_sequence <= latest_sequence)
 						{
-							uint32					replaying_index			= replaying_prediction_id & c_prediction_buffer_mask;
+							break; // arrived out of order, it's in history to be used as a baseline but is older than what we have
+						}
+						latest_sequence = received_sequence;
 
-							Predicted_Move*			replaying_move			= &predicted_move[replaying_index];
-							Predicted_Move_Result*	replaying_move_result	= &predicted_move_result[replaying_index];
+						Net::Snapshot* snapshot = Net::snapshot_history_get(&snapshot_history, received_sequence);
+						for (uint32 i = 0; i < room_max_players; ++i)
+						{
+							player_snapshot_states[i] = snapshot->player_snapshot_states[i];
+							players_present[i] = snapshot->players_present[i];
+						}
 
-							tick_player(local_player_snapshot_state, 
-										local_player_extra_state, 
-										replaying_move->dt, 
-										&replaying_move->input);
+						int32 ticks_ahead = prediction_id - received_prediction_id;
+						assert(ticks_ahead > -1);
+						assert(ticks_ahead <= c_prediction_buffer_capacity); // todo(jbr) cope better with this case
+						
+						Player_Snapshot_State* received_local_player_snapshot_state = &player_snapshot_states[local_player_slot];
 
-							replaying_move_result->snapshot_state = *local_player_snapshot_state;
-							replaying_move_result->extra_state = *local_player_extra_state;
+						uint32 index = received_prediction_id & c_prediction_buffer_mask;
+						Vec_3f delta_pos = vec_3f_sub(received_local_player_snapshot_state->position, predicted_move_result[index].snapshot_state.position);
+						constexpr float32 c_max_error = 0.001f; // 0.1cm
+						constexpr float32 c_max_error_sq = c_max_error * c_max_error;
+						if (vec_3f_length_sq(delta_pos) > c_max_error_sq)
+						{
+							log("[client]error of (%f, %f, %f) detected at prediction id %d, rewinding and replaying\n", delta_pos.x, delta_pos.y, delta_pos.z, received_prediction_id);
+							
+							*local_player_snapshot_state = *received_local_player_snapshot_state;
+							*local_player_extra_state = received_local_player_extra_state;
+
+							for (uint32 replaying_prediction_id = received_prediction_id + 1; 
+								replaying_prediction_id < prediction_id; 
+								++replaying_prediction_id)
+							{
+								uint32					replaying_index			= replaying_prediction_id & c_prediction_buffer_mask;
+
+								Predicted_Move*			replaying_move			= &predicted_move[replaying_index];
+								Predicted_Move_Result*	replaying_move_result	= &predicted_move_result[replaying_index];
+
+								tick_player(local_player_snapshot_state, 
+											local_player_extra_state, 
+											replaying_move->dt, 
+											&replaying_move->input);
+
+								replaying_move_result->snapshot_state = *local_player_snapshot_state;
+								replaying_move_result->extra_state = *local_player_extra_state;
+							}
 						}
 					}
+					break;
 				}
-				break;
 			}
+
+			Net::socket_release_views(&sock, num_received);
 		}
 
 		
-		// tick player if we have one
+		// tick player if we have one, once per server tick so the server can simulate exactly one input per tick
 		if (local_player_slot != (uint32)-1)
 		{
-			constexpr float32 c_mouse_sensitivity = 0.003f;
-
-			Player_Input player_input = {};
-			player_input.left = client_globals->input.keys['A'];
-			player_input.right = client_globals->input.keys['D'];
-			player_input.up = client_globals->input.keys['W'];
-			player_input.down = client_globals->input.keys['S'];
-			player_input.jump = client_globals->input.keys[VK_SPACE];
-			player_input.pitch = f32_clamp(local_player_snapshot_state->pitch - (mouse_delta_y * c_mouse_sensitivity), -85.0f * c_deg_to_rad, 85.0f * c_deg_to_rad);
-			player_input.yaw = local_player_snapshot_state->yaw + (mouse_delta_x * c_mouse_sensitivity);
-
-			float32 dt = c_seconds_per_tick;
-			
-			uint32 input_msg_size = Net::client_msg_input_write(socket_buffer, local_player_slot, dt, &player_input, prediction_id);
-			Net::socket_send(&sock, socket_buffer, input_msg_size, &server_endpoint);
-
-			tick_player(local_player_snapshot_state, 
-						local_player_extra_state, 
-						dt, 
-						&player_input);
-
-			uint32					index	= prediction_id & c_prediction_buffer_mask;
-
-			Predicted_Move*			move	= &predicted_move[index];
-			Predicted_Move_Result*	result	= &predicted_move_result[index];
-
-			move->dt						= dt;
-			move->input						= player_input;
-			result->snapshot_state			= *local_player_snapshot_state;
-			result->extra_state				= *local_player_extra_state;
-			
-			player_snapshot_states[local_player_slot] = *local_player_snapshot_state;
-
-			++prediction_id;
+			input_time_s += c_seconds_per_tick;
+			while (input_time_s >= server_seconds_per_tick)
+			{
+				input_time_s -= server_seconds_per_tick;
+
+				// consume mouse deltas from input so they reset every input
+				int32 mouse_delta_x = client_globals->input.mouse_delta_x;
+				int32 mouse_delta_y = client_globals->input.mouse_delta_y;
+				client_globals->input.mouse_delta_x = 0; 
+				client_globals->input.mouse_delta_y = 0;
+
+				constexpr float32 c_mouse_sensitivity = 0.003f;
+
+				Player_Input player_input = {};
+				player_input.left = client_globals->input.keys['A'];
+				player_input.right = client_globals->input.keys['D'];
+				player_input.up = client_globals->input.keys['W'];
+				player_input.down = client_globals->input.keys['S'];
+				player_input.jump = client_globals->input.keys[VK_SPACE];
+				player_input.pitch = f32_clamp(local_player_snapshot_state->pitch - (mouse_delta_y * c_mouse_sensitivity), -85.0f * c_deg_to_rad, 85.0f * c_deg_to_rad);
+				player_input.yaw = local_player_snapshot_state->yaw + (mouse_delta_x * c_mouse_sensitivity);
+				Net::player_input_quantise(&player_input);
+
+				float32 dt = server_seconds_per_tick;
+				
+				uint32 input_msg_size = Net::client_msg_input_write(socket_buffer, &player_input, prediction_id, latest_sequence);
+				Net::socket_send(&sock, socket_buffer, input_msg_size, &server_endpoint);
+
+				tick_player(local_player_snapshot_state, 
+							local_player_extra_state, 
+							dt, 
+							&player_input);
+
+				uint32					index	= prediction_id & c_prediction_buffer_mask;
+
+				Predicted_Move*			move	= &predicted_move[index];
+				Predicted_Move_Result*	result	= &predicted_move_result[index];
+
+				move->dt						= dt;
+				move->input						= player_input;
+				result->snapshot_state			= *local_player_snapshot_state;
+				result->extra_state				= *local_player_extra_state;
+				
+				player_snapshot_states[local_player_slot] = *local_player_snapshot_state;
+
+				++prediction_id;
+			}
+		}
+		else
+		{
+			client_globals->input.mouse_delta_x = 0; 
+			client_globals->input.mouse_delta_y = 0;
 		}
 
 		// Create view-projection matrix
@@ -405,7 +508,7 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE /*prev_instance*/, LPSTR /*cm
 		Matrix_4x4 temp_translation_matrix;
 		Matrix_4x4 temp_rotation_matrix;
 		
-		bool32* players_present_end = &players_present[c_max_clients];
+		bool32* players_present_end = &players_present[room_max_players];
 		Player_Snapshot_State* player_snapshot_state = &player_snapshot_states[0];
 		Matrix_4x4* player_mvp_matrix = &mvp_matrices[1];
 		Matrix_4x4 temp_model_matrix;
@@ -426,16 +529,20 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE /*prev_instance*/, LPSTR /*cm
 		uint32 num_matrices = (uint32)(player_mvp_matrix - &mvp_matrices[1]);
 		Graphics::update_and_draw(graphics_state, mvp_matrices, num_matrices);
 
-		timer_wait_until(&tick_timer, c_seconds_per_tick, sleep_granularity_was_set);
+		{
+			PROFILE_SCOPE("wait");
+			timer_wait_until(&tick_timer, c_seconds_per_tick, sleep_granularity_was_set);
+		}
 		timer_shift_start(&tick_timer, c_seconds_per_tick);
 	}
 
-	uint32 leave_msg_size = Net::client_msg_leave_write(socket_buffer, local_player_slot);
+	uint32 leave_msg_size = Net::client_msg_leave_write(socket_buffer);
 	Net::socket_send(&sock, socket_buffer, leave_msg_size, &server_endpoint);
 	Net::socket_close(&sock);
 
 	server_should_run = false;
 	server_thread.join();
+	profile_shutdown();
 
 	return exit_code;
 }
\ No newline at end of file
@@ -1,24 +1,69 @@
 #include "core.h"
 
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
+#include <mutex>
+#include <new>
+#include <thread>
+#ifdef __linux__
+#include <time.h>
+#include <unistd.h>
+#else
+#include <share.h>
+#endif // #ifdef __linux__
 
 
 
+int64 clock_now()
+{
+#ifdef __linux__
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((int64)now.tv_sec * 1000000000) + now.tv_nsec;
+#else
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+#endif // #ifdef __linux__
+}
+
+int64 clock_frequency()
+{
+#ifdef __linux__
+	return 1000000000;
+#else
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+#endif // #ifdef __linux__
+}
+
+uint64 clock_ticks_to_ns(int64 clock_ticks)
+{
+	if (clock_ticks <= 0)
+	{
+		return 0;
+	}
+#ifdef __linux__
+	return (uint64)clock_ticks;
+#else
+	return (uint64)(clock_ticks * (1000000000.0 / clock_frequency()));
+#endif // #ifdef __linux__
+}
+
 Timer timer()
 {
 	Timer timer = {};
-	QueryPerformanceFrequency(&timer.frequency);
-	QueryPerformanceCounter(&timer.start);
+	timer.frequency = clock_frequency();
+	timer.start = clock_now();
 	return timer;
 }
 
 float32 timer_get_s(Timer* timer)
 {
-	LARGE_INTEGER now;
-	QueryPerformanceCounter(&now);
-
-	return (float32)(now.QuadPart - timer->start.QuadPart) / (float32)timer->frequency.QuadPart;
+	return (float32)(clock_now() - timer->start) / (float32)timer->frequency;
 }
 
 void timer_wait_until(Timer* timer, float32 wait_time_s, bool sleep_granularity_is_set)
@@ -29,10 +74,14 @@ void timer_wait_until(Timer* timer, float32 wait_time_s, bool sleep_granularity_
 	{
 		if (sleep_granularity_is_set)
 		{
-			DWORD time_to_wait_ms = (DWORD)((wait_time_s - time_taken_s) * 1000);
+			uint32 time_to_wait_ms = (uint32)((wait_time_s - time_taken_s) * 1000);
 			if (time_to_wait_ms > 1) // Sleep frequently oversleeps by 1ms, so spin for everything smaller than 2
 			{
+#ifdef __linux__
+				usleep(time_to_wait_ms * 1000);
+#else
 				Sleep(time_to_wait_ms);
+#endif // #ifdef __linux__
 			}
 		}
 
@@ -42,7 +91,7 @@ void timer_wait_until(Timer* timer, float32 wait_time_s, bool sleep_granularity_
 
 void timer_shift_start(Timer* timer, float32 accumulate_s)
 {
-	timer->start.QuadPart += (LONGLONG)(timer->frequency.QuadPart * accumulate_s);
+	timer->start += (int64)(timer->frequency * accumulate_s);
 }
 
 
@@ -69,15 +118,643 @@ uint8* linear_allocator_alloc(Linear_Allocator* allocator, uint64 size)
 	return mem;
 }
 
+void linear_allocator_destroy(Linear_Allocator* allocator)
+{
+	delete[] allocator->memory;
+	allocator->memory = 0;
+	allocator->next = 0;
+	allocator->bytes_remaining = 0;
+}
+
+
+FILE* file_open(const char* path, const char* mode)
+{
+#ifdef __linux__
+	return fopen(path, mode);
+#else
+	return _fsopen(path, mode, _SH_DENYWR);
+#endif // #ifdef __linux__
+}
+
+
+constexpr uint32	c_log_ring_mask					= c_log_ring_size - 1;
+constexpr uint32	c_log_max_string				= 255; // longer string arguments are cut short
+constexpr uint32	c_log_max_message				= 512;
+constexpr uint32	c_log_rate_limit_slots			= 64; // per thread, open addressed by format
+constexpr uint32	c_log_rate_limit_probes			= 8; // past this the least recently reset call site is evicted
+constexpr float32	c_log_drain_interval_s			= 0.002f;
+
+// what's in the ring for each log() call, followed by its args then copies of its strings,
+// string args' s are offsets from the start of the record
+struct Log_Record
+{
+	const char* format; // 0 for padding to the end of the ring
+	int64 time; // clock_now()
+	uint32 size; // in bytes, including args and strings, a multiple of sizeof(Log_Record) so padding always has room for one
+	uint32 num_args;
+	uint32 num_suppressed; // by the rate limit since the last message from this call site
+	uint32 pad;
+};
+static_assert((sizeof(Log_Record) & (sizeof(Log_Record) - 1)) == 0 && (c_log_ring_size % sizeof(Log_Record)) == 0, "records must tile the ring");
+
+struct Log_Rate_Limit
+{
+	const char* format;
+	int64 window_start;
+	uint32 count;
+	uint32 num_suppressed;
+};
+
+// single producer (the thread it's given to), single consumer (the log thread), positions only ever increase
+struct Log_Ring
+{
+	alignas(64) std::atomic<uint64> write_position;
+	alignas(64) std::atomic<uint64> read_position;
+	alignas(64) uint64 cached_read_position; // the producer's last look at read_position
+	std::atomic<uint32> num_dropped; // since the log thread last reported them
+	std::atomic_bool is_in_use;
+	std::atomic_bool is_orphaned; // its thread has exited, so once drained it can be given to another
+	Log_Rate_Limit rate_limits[c_log_rate_limit_slots];
+	uint8* buffer;
+};
+
+struct Logger
+{
+	std::atomic_bool is_running;
+	std::atomic_bool should_stop;
+	std::atomic<uint32> num_dropped; // messages from threads which couldn't get a ring
+	std::mutex rings_mutex; // for handing out rings
+	Log_Ring* rings;
+	std::thread thread;
+	Linear_Allocator allocator;
+	bool32 has_allocator;
+	// only touched by the log thread
+	FILE* file;
+	Log_Config config;
+	char file_path[256];
+	uint64 file_size;
+	int64 start_time;
+};
+
+static Logger s_logger;
+
+// hands the thread's ring back once the thread exits
+struct Log_Thread
+{
+	Log_Ring* ring;
+
+	~Log_Thread()
+	{
+		if (ring)
+		{
+			ring->is_orphaned.store(true, std::memory_order_release);
+		}
+	}
+};
+
+static thread_local Log_Thread t_log_thread;
+
+
+// formats with the arg types captured by log(), so only flags, width and precision are taken from the format,
+// length modifiers are ignored and a mismatched arg is printed as best it can be rather than crashing
+static uint32 log_format(char* buffer, uint32 buffer_size, const char* format, Log_Arg* args, uint32 num_args)
+{
+	uint32 length = 0;
+	uint32 arg_index = 0;
+	const char* c = format;
+	while (*c && length < buffer_size - 1)
+	{
+		if (*c != '%')
+		{
+			buffer[length++] = *c++;
+			continue;
+		}
+		if (c[1] == '%')
+		{
+			buffer[length++] = '%';
+			c += 2;
+			continue;
+		}
+
+		char spec[32];
+		uint32 spec_length = 0;
+		spec[spec_length++] = *c++;
+		while (*c && strchr("-+ #0123456789.", *c) && spec_length < sizeof(spec) - 4)
+		{
+			spec[spec_length++] = *c++;
+		}
+		while (*c && strchr("hljztL", *c))
+		{
+			++c;
+		}
+		char conversion = *c;
+		if (!conversion)
+		{
+			break;
+		}
+		++c;
+
+		int written = 0;
+		uint32 remaining = buffer_size - length;
+		if (arg_index == num_args)
+		{
+			written = snprintf(&buffer[length], remaining, "(missing)");
+			length += (uint32)written < remaining ? (uint32)written : remaining - 1;
+			continue;
+		}
+		Log_Arg* arg = &args[arg_index++];
+		switch (conversion)
+		{
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o':
+				spec[spec_length++] = 'l';
+				spec[spec_length++] = 'l';
+				spec[spec_length++] = conversion;
+				spec[spec_length] = 0;
+				written = snprintf(&buffer[length], remaining, spec, arg->type == Log_Arg_Type::Float ? (long long)arg->f : (long long)arg->i);
+			break;
+
+			case 'c':
+				spec[spec_length++] = conversion;
+				spec[spec_length] = 0;
+				written = snprintf(&buffer[length], remaining, spec, (int)arg->i);
+			break;
+
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+			{
+				float64 value = arg->f;
+				if (arg->type == Log_Arg_Type::Int)
+				{
+					value = (float64)arg->i;
+				}
+				else if (arg->type != Log_Arg_Type::Float)
+				{
+					value = (float64)arg->u;
+				}
+				spec[spec_length++] = conversion;
+				spec[spec_length] = 0;
+				written = snprintf(&buffer[length], remaining, spec, value);
+			}
+			break;
+
+			case 's':
+				spec[spec_length++] = conversion;
+				spec[spec_length] = 0;
+				written = snprintf(&buffer[length], remaining, spec, arg->type == Log_Arg_Type::String ? arg->s : "(not a string)");
+			break;
+
+			case 'p':
+				spec[spec_length++] = conversion;
+				spec[spec_length] = 0;
+				written = snprintf(&buffer[length], remaining, spec, arg->p);
+			break;
+		}
+
+		if (written > 0)
+		{
+			length += (uint32)written < remaining ? (uint32)written : remaining - 1;
+		}
+	}
+
+	buffer[length] = 0;
+	return length;
+}
+
+static void log_output_debug(const char* message)
+{
+#ifdef __linux__
+	// no debugger output on a headless server
+	fputs(message, stderr);
+#else
+	OutputDebugStringA(message);
+#endif // #ifdef __linux__
+}
+
+static void log_file_rotate()
+{
+	fclose(s_logger.file);
+
+	// file_path.n-2 -> file_path.n-1 ... file_path -> file_path.1
+	char from[300];
+	char to[300];
+	for (uint32 i = s_logger.config.max_files - 1; i > 0; --i)
+	{
+		if (i == 1)
+		{
+			snprintf(from, sizeof(from), "%s", s_logger.file_path);
+		}
+		else
+		{
+			snprintf(from, sizeof(from), "%s.%u", s_logger.file_path, i - 1);
+		}
+		snprintf(to, sizeof(to), "%s.%u", s_logger.file_path, i);
+		remove(to);
+		rename(from, to);
+	}
+
+	s_logger.file = file_open(s_logger.file_path, "wb");
+	s_logger.file_size = 0;
+}
+
+// log thread only
+static void log_output(const char* message, uint32 length, int64 time)
+{
+	if (!s_logger.file)
+	{
+		log_output_debug(message);
+		return;
+	}
+
+	char prefix[32];
+	uint32 prefix_length = (uint32)snprintf(prefix, sizeof(prefix), "[%.6f] ", (float64)(time - s_logger.start_time) / (float64)clock_frequency());
+	if (s_logger.file_size && s_logger.file_size + prefix_length + length > s_logger.config.max_file_size)
+	{
+		log_file_rotate();
+		if (!s_logger.file)
+		{
+			log_output_debug("[log] failed to reopen log file, writing to stderr\n");
+			log_output_debug(message);
+			return;
+		}
+	}
+	fwrite(prefix, 1, prefix_length, s_logger.file);
+	fwrite(message, 1, length, s_logger.file);
+	s_logger.file_size += prefix_length + length;
+}
+
+// the record at the front of the ring, skipping padding, 0 if it's empty
+static Log_Record* log_ring_peek(Log_Ring* ring)
+{
+	uint64 read_position = ring->read_position.load(std::memory_order_relaxed);
+	while (read_position != ring->write_position.load(std::memory_order_acquire))
+	{
+		Log_Record* record = (Log_Record*)&ring->buffer[read_position & c_log_ring_mask];
+		if (record->format)
+		{
+			return record;
+		}
+		read_position += record->size;
+		ring->read_position.store(read_position, std::memory_order_release);
+	}
+	return 0;
+}
+
+// writes out everything in the rings, oldest first across threads, returns how many messages there were
+static uint32 log_drain()
+{
+	char message[c_log_max_message];
+	uint32 num_messages = 0;
+	while (true)
+	{
+		Log_Ring* oldest_ring = 0;
+		Log_Record* oldest_record = 0;
+		for (uint32 i = 0; i < c_log_max_threads; ++i)
+		{
+			Log_Ring* ring = &s_logger.rings[i];
+			if (!ring->is_in_use.load(std::memory_order_acquire))
+			{
+				continue;
+			}
+			Log_Record* record = log_ring_peek(ring);
+			if (record && (!oldest_record || record->time < oldest_record->time))
+			{
+				oldest_ring = ring;
+				oldest_record = record;
+			}
+		}
+		if (!oldest_record)
+		{
+			return num_messages;
+		}
+
+		if (oldest_record->num_suppressed)
+		{
+			uint32 length = (uint32)snprintf(message, sizeof(message), "[log] %u more like the next were rate limited\n", oldest_record->num_suppressed);
+			log_output(message, length, oldest_record->time);
+		}
+
+		Log_Arg args[c_log_max_args];
+		memcpy(args, &oldest_record[1], sizeof(Log_Arg) * oldest_record->num_args);
+		for (uint32 i = 0; i < oldest_record->num_args; ++i)
+		{
+			if (args[i].type == Log_Arg_Type::String)
+			{
+				args[i].s = (const char*)oldest_record + args[i].u;
+			}
+		}
+		uint32 length = log_format(message, sizeof(message), oldest_record->format, args, oldest_record->num_args);
+		log_output(message, length, oldest_record->time);
+		++num_messages;
+
+		oldest_ring->read_position.store(oldest_ring->read_position.load(std::memory_order_relaxed) + oldest_record->size, std::memory_order_release);
+	}
+}
+
+static void log_thread_main()
+{
+	while (true)
+	{
+		bool32 should_stop = s_logger.should_stop.load(std::memory_order_acquire);
+
+		uint32 num_messages = log_drain();
+
+		char message[c_log_max_message];
+		int64 now = clock_now();
+		uint32 num_dropped = s_logger.num_dropped.exchange(0, std::memory_order_relaxed);
+		if (num_dropped)
+		{
+			uint32 length = (uint32)snprintf(message, sizeof(message), "[log] %u messages dropped, more than %u threads logging\n", num_dropped, c_log_max_threads);
+			log_output(message, length, now);
+		}
+		for (uint32 i = 0; i < c_log_max_threads; ++i)
+		{
+			Log_Ring* ring = &s_logger.rings[i];
+			if (!ring->is_in_use.load(std::memory_order_acquire))
+			{
+				continue;
+			}
+
+			num_dropped = ring->num_dropped.exchange(0, std::memory_order_relaxed);
+			if (num_dropped)
+			{
+				uint32 length = (uint32)snprintf(message, sizeof(message), "[log] %u messages dropped, a thread's log ring was full\n", num_dropped);
+				log_output(message, length, now);
+			}
+
+			// orphaned is checked first, so anything its thread logged is already visible
+			if (ring->is_orphaned.load(std::memory_order_acquire) && !log_ring_peek(ring))
+			{
+				std::lock_guard<std::mutex> lock(s_logger.rings_mutex);
+				ring->is_in_use.store(false, std::memory_order_relaxed);
+			}
+		}
+
+		if (num_messages && s_logger.file)
+		{
+			fflush(s_logger.file);
+		}
+
+		if (should_stop)
+		{
+			return;
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds((int64)(c_log_drain_interval_s * 1000000)));
+	}
+}
+
+// 0 if there are none free
+static Log_Ring* log_thread_ring()
+{
+	if (t_log_thread.ring)
+	{
+		return t_log_thread.ring;
+	}
+
+	std::lock_guard<std::mutex> lock(s_logger.rings_mutex);
+	for (uint32 i = 0; i < c_log_max_threads; ++i)
+	{
+		Log_Ring* ring = &s_logger.rings[i];
+		if (!ring->is_in_use.load(std::memory_order_relaxed))
+		{
+			uint64 position = ring->read_position.load(std::memory_order_relaxed);
+			ring->write_position.store(position, std::memory_order_relaxed);
+			ring->cached_read_position = position;
+			ring->num_dropped.store(0, std::memory_order_relaxed);
+			ring->is_orphaned.store(false, std::memory_order_relaxed);
+			memset(ring->rate_limits, 0, sizeof(ring->rate_limits));
+			ring->is_in_use.store(true, std::memory_order_release);
+			t_log_thread.ring = ring;
+			return ring;
+		}
+	}
+	return 0;
+}
+
+bool32 log_init(Log_Config* config)
+{
+	if (!s_logger.has_allocator)
+	{
+		linear_allocator_create(&s_logger.allocator, (sizeof(Log_Ring) + 63 + c_log_ring_size) * c_log_max_threads);
+		s_logger.rings = (Log_Ring*)(((uintptr_t)linear_allocator_alloc(&s_logger.allocator, (sizeof(Log_Ring) * c_log_max_threads) + 63) + 63) & ~(uintptr_t)63);
+		for (uint32 i = 0; i < c_log_max_threads; ++i)
+		{
+			Log_Ring* ring = new (&s_logger.rings[i]) Log_Ring();
+			ring->write_position.store(0, std::memory_order_relaxed);
+			ring->read_position.store(0, std::memory_order_relaxed);
+			ring->is_in_use.store(false, std::memory_order_relaxed);
+			ring->buffer = linear_allocator_alloc(&s_logger.allocator, c_log_ring_size);
+		}
+		s_logger.has_allocator = true;
+	}
+
+	s_logger.config = *config;
+	s_logger.file = 0;
+	if (config->file_path)
+	{
+		snprintf(s_logger.file_path, sizeof(s_logger.file_path), "%s", config->file_path);
+		if (s_logger.config.max_files < 1)
+		{
+			s_logger.config.max_files = 1;
+		}
+		s_logger.file = file_open(s_logger.file_path, "wb");
+		if (!s_logger.file)
+		{
+			log("[log] failed to open %s\n", config->file_path);
+			return false;
+		}
+	}
+	s_logger.file_size = 0;
+	s_logger.start_time = clock_now();
+	s_logger.num_dropped.store(0, std::memory_order_relaxed);
+	s_logger.should_stop.store(false, std::memory_order_relaxed);
+	s_logger.thread = std::thread(log_thread_main);
+	s_logger.is_running.store(true, std::memory_order_release);
+	return true;
+}
 
-void log(const char* format, ...)
+void log_shutdown()
 {
-	char buffer[512];
+	if (!s_logger.is_running.load(std::memory_order_relaxed))
+	{
+		return;
+	}
 
-	va_list args;
-	va_start(args, format);
-	vsnprintf(buffer, sizeof(buffer), format, args);
-	va_end(args);
+	// anything logged from here on is written synchronously
+	s_logger.is_running.store(false, std::memory_order_release);
+	s_logger.should_stop.store(true, std::memory_order_release);
+	s_logger.thread.join();
 
-	OutputDebugStringA(buffer);
-}
\ No newline at end of file
+	if (s_logger.file)
+	{
+		fclose(s_logger.file);
+		s_logger.file = 0;
+	}
+}
+
+// returns false if the ring is full
+static bool32 log_ring_push(Log_Ring* ring, const char* format, Log_Arg* args, uint32 num_args, int64 now, uint32 num_suppressed)
+{
+	uint32 string_lengths[c_log_max_args];
+	uint32 size = sizeof(Log_Record) + (sizeof(Log_Arg) * num_args);
+	for (uint32 i = 0; i < num_args; ++i)
+	{
+		if (args[i].type == Log_Arg_Type::String)
+		{
+			uint32 length = 0;
+			while (length < c_log_max_string && args[i].s[length])
+			{
+				++length;
+			}
+			string_lengths[i] = length;
+			size += length + 1;
+		}
+	}
+	size = (size + sizeof(Log_Record) - 1) & ~(uint32)(sizeof(Log_Record) - 1);
+
+	// records don't wrap, so if there isn't room before the end, pad to it
+	uint64 write_position = ring->write_position.load(std::memory_order_relaxed);
+	uint32 space_to_end = c_log_ring_size - (uint32)(write_position & c_log_ring_mask);
+	uint32 padding = space_to_end < size ? space_to_end : 0;
+	if (write_position + padding + size - ring->cached_read_position > c_log_ring_size)
+	{
+		ring->cached_read_position = ring->read_position.load(std::memory_order_acquire);
+		if (write_position + padding + size - ring->cached_read_position > c_log_ring_size)
+		{
+			return false;
+		}
+	}
+	if (padding)
+	{
+		Log_Record* pad_record = (Log_Record*)&ring->buffer[write_position & c_log_ring_mask];
+		pad_record->format = 0;
+		pad_record->size = padding;
+		write_position += padding;
+	}
+
+	uint8* record_start = &ring->buffer[write_position & c_log_ring_mask];
+	Log_Record* record = (Log_Record*)record_start;
+	record->format = format;
+	record->time = now;
+	record->size = size;
+	record->num_args = num_args;
+	record->num_suppressed = num_suppressed;
+	Log_Arg* record_args = (Log_Arg*)&record[1];
+	uint32 string_offset = sizeof(Log_Record) + (sizeof(Log_Arg) * num_args);
+	for (uint32 i = 0; i < num_args; ++i)
+	{
+		record_args[i] = args[i];
+		if (args[i].type == Log_Arg_Type::String)
+		{
+			memcpy(&record_start[string_offset], args[i].s, string_lengths[i]);
+			record_start[string_offset + string_lengths[i]] = 0;
+			record_args[i].u = string_offset;
+			string_offset += string_lengths[i] + 1;
+		}
+	}
+
+	ring->write_position.store(write_position + size, std::memory_order_release);
+	return true;
+}
+
+// the call site's slot, if the probes are all taken by other call sites the one whose window started longest ago
+// is evicted and whatever it had suppressed is logged, so colliding call sites never reset each other's limits
+static Log_Rate_Limit* log_rate_limit_find(Log_Ring* ring, const char* format, int64 now)
+{
+	uint32 home = (uint32)((uintptr_t)format >> 3);
+	Log_Rate_Limit* oldest = 0;
+	for (uint32 i = 0; i < c_log_rate_limit_probes; ++i)
+	{
+		Log_Rate_Limit* rate_limit = &ring->rate_limits[(home + i) & (c_log_rate_limit_slots - 1)];
+		if (rate_limit->format == format)
+		{
+			return rate_limit;
+		}
+		if (!rate_limit->format)
+		{
+			oldest = rate_limit;
+			break;
+		}
+		if (!oldest || rate_limit->window_start < oldest->window_start)
+		{
+			oldest = rate_limit;
+		}
+	}
+
+	if (oldest->num_suppressed)
+	{
+		// the format without its newline, e.g. "[server] room %u inbox full"
+		char evicted_format[c_log_max_string + 1];
+		uint32 length = 0;
+		while (length < c_log_max_string && oldest->format[length] && oldest->format[length] != '\n')
+		{
+			evicted_format[length] = oldest->format[length];
+			++length;
+		}
+		evicted_format[length] = 0;
+
+		Log_Arg evicted_args[] = { log_arg(oldest->num_suppressed), log_arg(evicted_format) };
+		if (!log_ring_push(ring, "[log] %u more like \"%s\" were rate limited\n", evicted_args, 2, now, 0))
+		{
+			ring->num_dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	oldest->format = format;
+	oldest->window_start = now;
+	oldest->count = 0;
+	oldest->num_suppressed = 0;
+	return oldest;
+}
+
+void log_write(const char* format, Log_Arg* args, uint32 num_args)
+{
+	if (!s_logger.is_running.load(std::memory_order_acquire))
+	{
+		char buffer[c_log_max_message];
+		log_format(buffer, sizeof(buffer), format, args, num_args);
+		log_output_debug(buffer);
+		return;
+	}
+
+	Log_Ring* ring = log_thread_ring();
+	if (!ring)
+	{
+		s_logger.num_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	// past the burst, call sites are only counted until the next window
+	int64 now = clock_now();
+	Log_Rate_Limit* rate_limit = log_rate_limit_find(ring, format, now);
+	uint32 num_suppressed = 0;
+	if (now - rate_limit->window_start >= clock_frequency())
+	{
+		num_suppressed = rate_limit->num_suppressed;
+		rate_limit->window_start = now;
+		rate_limit->count = 0;
+		rate_limit->num_suppressed = 0;
+	}
+	if (rate_limit->count == c_log_rate_limit_burst)
+	{
+		++rate_limit->num_suppressed;
+		return;
+	}
+	++rate_limit->count;
+
+	if (!log_ring_push(ring, format, args, num_args, now, num_suppressed))
+	{
+		rate_limit->num_suppressed += num_suppressed;
+		ring->num_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
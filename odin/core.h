@@ -1,7 +1,15 @@
 #pragma once
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <type_traits>
+#ifdef __linux__
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#else
 #include <windows.h>
+#endif // #ifdef __linux__
 
 
 
@@ -20,7 +28,8 @@ typedef double float64;
 
 constexpr uint16 	c_port = 9999;
 constexpr uint32 	c_packet_budget_per_tick = 1024;
-constexpr uint32	c_max_clients = 32;
+constexpr uint32	c_max_clients = 1024; // per room, what the protocol has room for, each server picks its room size up to this
+constexpr uint32	c_default_max_clients = 32;
 constexpr int32		c_max_client_tick_rate = 120;
 constexpr int32		c_max_server_tick_rate = 60;
 
@@ -48,8 +57,8 @@ constexpr uint64 gigabytes(uint32 gb)
 
 struct Timer
 {
-	LARGE_INTEGER start;
-	LARGE_INTEGER frequency;
+	int64 start;
+	int64 frequency;
 };
 
 struct Linear_Allocator
@@ -60,6 +69,11 @@ struct Linear_Allocator
 };
 
 
+// high resolution clock, in ticks of clock_frequency() per second
+int64	clock_now();
+int64	clock_frequency();
+uint64	clock_ticks_to_ns(int64 clock_ticks); // for durations, negative ones come out as 0
+
 Timer	timer();
 float32 timer_get_s(Timer* timer);
 void	timer_wait_until(Timer* timer, float32 wait_time_s, bool sleep_granularity_is_set);
@@ -68,5 +82,101 @@ void	timer_shift_start(Timer* timer, float32 accumulate_s);
 void linear_allocator_create(Linear_Allocator* allocator, uint64 size);
 void linear_allocator_create_sub_allocator(Linear_Allocator* allocator, Linear_Allocator* sub_allocator, uint64 size);
 uint8* linear_allocator_alloc(Linear_Allocator* allocator, uint64 size);
+void linear_allocator_destroy(Linear_Allocator* allocator); // not for sub allocators, their memory belongs to their parent
+
+// fopen, on windows without msvc's deprecation warning and still letting other programs read the file, 0 on failure
+FILE*	file_open(const char* path, const char* mode);
+
+
+// log() only copies the format pointer and its arguments into the calling thread's ring, a background thread
+// formats and writes them (see log_init), before log_init or after log_shutdown it writes synchronously.
+// String arguments are copied so they can be on the stack, but the format must outlive the log thread, e.g. a
+// literal. Each call site gets c_log_rate_limit_burst messages per thread per second, the rest are counted
+constexpr uint32	c_log_max_args			= 8;
+constexpr uint32	c_log_max_threads		= 128;
+constexpr uint32	c_log_ring_size			= 32 * 1024; // per thread, in bytes
+constexpr uint32	c_log_rate_limit_burst	= 20;
+
+enum class Log_Arg_Type : uint8
+{
+	Int,
+	Uint,
+	Float,
+	String,
+	Pointer
+};
+
+struct Log_Arg
+{
+	union
+	{
+		int64 i;
+		uint64 u;
+		float64 f;
+		const char* s;
+		const void* p;
+	};
+	Log_Arg_Type type;
+};
+
+struct Log_Config
+{
+	const char* file_path; // 0 to write to stderr (debugger output on windows)
+	uint64 max_file_size; // the file is rotated once it would grow past this
+	uint32 max_files; // including the one being written, older ones are file_path.1, file_path.2, ...
+};
+
+bool32	log_init(Log_Config* config);
+void	log_shutdown(); // waits for everything logged so far to be written
+void	log_write(const char* format, Log_Arg* args, uint32 num_args);
+
+inline void log_arg_set(Log_Arg* arg, float64 value, std::true_type /*is_floating_point*/)
+{
+	arg->f = value;
+	arg->type = Log_Arg_Type::Float;
+}
+template <typename T>
+inline void log_arg_set(Log_Arg* arg, T value, std::false_type /*is_floating_point*/)
+{
+	arg->i = (int64)value;
+	arg->type = std::is_signed<T>::value ? Log_Arg_Type::Int : Log_Arg_Type::Uint;
+}
+
+template <typename T>
+inline Log_Arg log_arg(T value)
+{
+	Log_Arg arg;
+	log_arg_set(&arg, value, std::is_floating_point<T>());
+	return arg;
+}
+inline Log_Arg log_arg(const char* value)
+{
+	Log_Arg arg;
+	arg.s = value;
+	arg.type = Log_Arg_Type::String;
+	return arg;
+}
+inline Log_Arg log_arg(char* value)
+{
+	return log_arg((const char*)value);
+}
+template <typename T>
+inline Log_Arg log_arg(T* value)
+{
+	Log_Arg arg;
+	arg.p = value;
+	arg.type = Log_Arg_Type::Pointer;
+	return arg;
+}
 
-void log(const char* format, ...);
\ No newline at end of file
+inline void log(const char* format)
+{
+	log_write(format, 0, 0);
+}
+template <typename... Args>
+inline void log(const char* format, Args... args)
+{
+	static_assert(sizeof...(Args) <= c_log_max_args, "too many log arguments");
+	Log_Arg log_args[] = { log_arg(args)... };
+	log_write(format, log_args, sizeof...(Args));
+}
\ No newline at end of file
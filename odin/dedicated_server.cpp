@@ -0,0 +1,244 @@
+#include "cli_args.h"
+#include "core.h"
+#include "metrics.h"
+#include "net.h"
+#include "profile.h"
+#include "server.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+
+// headless server, runs server_main on the main thread until SIGINT/SIGTERM, SIGUSR1 captures a profile
+
+
+constexpr uint32 c_default_log_file_mb = 64;
+constexpr uint32 c_default_log_files = 4;
+constexpr uint32 c_default_profile_ticks = 90;
+
+static std::atomic_bool g_should_run;
+static uint32 g_profile_ticks = c_default_profile_ticks;
+
+static void on_stop_signal(int /*signal*/)
+{
+	g_should_run.store(false, std::memory_order_relaxed);
+}
+
+#ifdef __linux__
+static void on_profile_signal(int /*signal*/)
+{
+	profile_capture_request(g_profile_ticks);
+}
+#endif // #ifdef __linux__
+
+static void print_usage(const char* program_name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --port <port>            udp port to listen on (default %hu)\n"
+		"  --tick-rate <hz>         server ticks per second, up to %d (default %d)\n"
+		"  --max-clients <n>        per room, up to %u (default %u)\n"
+		"  --rooms <n>              independent games hosted, up to %u (default 1)\n"
+		"  --room-workers <n>       threads ticking rooms, up to %u, 0 ticks them on the main thread (default 0)\n"
+		"  --socket <udp|io_uring>  socket backend (default udp)\n"
+		"  --receive-shards <n>     threads receiving packets, up to %u, 0 receives on the tick thread (default 1)\n"
+		"  --encode-workers <n>     threads encoding state packets, up to %u, including the main thread, without room workers (default 1)\n"
+		"  --wait                   sleep between ticks rather than spinning\n"
+		"  --stats <seconds>        log room tick time and receive latency this often (default never)\n"
+		"  --log-file <path>        log to this file rather than stderr\n"
+		"  --log-file-mb <n>        rotate the log file once it reaches this size (default %u)\n"
+		"  --log-files <n>          rotated log files kept, including the current one (default %u)\n"
+		"  --profile <ticks>        capture a trace of this many ticks at startup, and on each SIGUSR1 (default %u on SIGUSR1 only)\n",
+		program_name, c_port, c_max_server_tick_rate, c_default_server_tick_rate, c_max_clients, c_default_max_clients, c_max_rooms, c_max_room_workers, c_max_receive_shards, c_max_state_encode_workers,
+		c_default_log_file_mb, c_default_log_files, c_default_profile_ticks);
+}
+
+int main(int argc, char** argv)
+{
+	Server_Config config = {};
+	config.port = c_port;
+	config.tick_rate = c_default_server_tick_rate;
+	config.max_clients = c_default_max_clients;
+	config.num_rooms = 1;
+	config.num_room_workers = 0;
+	config.socket_type = Net::Socket_Type::Udp;
+	config.num_receive_shards = 1;
+	config.wait_for_events = false;
+	config.num_state_encode_workers = 1;
+	config.stats_interval_s = 0.0f;
+	config.ticks_profiler = true;
+	bool32 profile_at_startup = false;
+
+	Log_Config log_config = {};
+	log_config.file_path = 0;
+	log_config.max_file_size = megabytes(c_default_log_file_mb);
+	log_config.max_files = c_default_log_files;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		uint32 value;
+		if (!strcmp(arg, "--port"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 65535, &value))
+			{
+				return 1;
+			}
+			config.port = (uint16)value;
+		}
+		else if (!strcmp(arg, "--tick-rate"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_max_server_tick_rate, &value))
+			{
+				return 1;
+			}
+			config.tick_rate = (int32)value;
+		}
+		else if (!strcmp(arg, "--max-clients"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_max_clients, &value))
+			{
+				return 1;
+			}
+			config.max_clients = value;
+		}
+		else if (!strcmp(arg, "--rooms"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_max_rooms, &value))
+			{
+				return 1;
+			}
+			config.num_rooms = value;
+		}
+		else if (!strcmp(arg, "--room-workers"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 0, c_max_room_workers, &value))
+			{
+				return 1;
+			}
+			config.num_room_workers = value;
+		}
+		else if (!strcmp(arg, "--socket") && i + 1 < argc)
+		{
+			++i;
+			if (!strcmp(argv[i], "udp"))
+			{
+				config.socket_type = Net::Socket_Type::Udp;
+			}
+			else if (!strcmp(argv[i], "io_uring"))
+			{
+				config.socket_type = Net::Socket_Type::Io_Uring;
+			}
+			else
+			{
+				fprintf(stderr, "unknown socket type %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--receive-shards"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 0, c_max_receive_shards, &value))
+			{
+				return 1;
+			}
+			config.num_receive_shards = value;
+		}
+		else if (!strcmp(arg, "--encode-workers"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_max_state_encode_workers, &value))
+			{
+				return 1;
+			}
+			config.num_state_encode_workers = value;
+		}
+		else if (!strcmp(arg, "--wait"))
+		{
+			config.wait_for_events = true;
+		}
+		else if (!strcmp(arg, "--stats"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 3600, &value))
+			{
+				return 1;
+			}
+			config.stats_interval_s = (float32)value;
+		}
+		else if (!strcmp(arg, "--log-file") && i + 1 < argc)
+		{
+			++i;
+			log_config.file_path = argv[i];
+		}
+		else if (!strcmp(arg, "--log-file-mb"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 1024, &value))
+			{
+				return 1;
+			}
+			log_config.max_file_size = megabytes(value);
+		}
+		else if (!strcmp(arg, "--log-files"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 100, &value))
+			{
+				return 1;
+			}
+			log_config.max_files = value;
+		}
+		else if (!strcmp(arg, "--profile"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 1000000, &value))
+			{
+				return 1;
+			}
+			g_profile_ticks = value;
+			profile_at_startup = true;
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return !strcmp(arg, "--help") ? 0 : 1;
+		}
+	}
+
+	// from here on logging is asynchronous
+	if (!log_init(&log_config))
+	{
+		return 1;
+	}
+
+	if (!Net::init())
+	{
+		log_shutdown();
+		return 1;
+	}
+
+	// before any server threads start, as they update the metrics too
+	if (!metrics_publish(config.port))
+	{
+		log("[server] metrics aren't published, odin_metrics won't see this server\n");
+	}
+
+	g_should_run.store(true, std::memory_order_relaxed);
+	signal(SIGINT, &on_stop_signal);
+	signal(SIGTERM, &on_stop_signal);
+#ifdef __linux__
+	signal(SIGUSR1, &on_profile_signal);
+#endif // #ifdef __linux__
+	if (profile_at_startup)
+	{
+		profile_capture_request(g_profile_ticks);
+	}
+
+	log("[server] listening on port %hu, %d ticks per second, %u rooms of up to %u clients\n", config.port, config.tick_rate, config.num_rooms, config.max_clients);
+	server_main(&g_should_run, &config);
+	metrics_unpublish();
+	profile_shutdown();
+	log("[server] stopped\n");
+	log_shutdown();
+
+	return 0;
+}
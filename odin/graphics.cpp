@@ -1,5 +1,7 @@
 #include "graphics.h"
 
+#include "profile.h"
+
 
 namespace Graphics
 {
@@ -988,6 +990,8 @@ void init(	State* out_state,
 
 void update_and_draw(State* state, Matrix_4x4* matrices, uint32 num_players)
 {
+	PROFILE_SCOPE("Graphics::update_and_draw");
+
 	if (!num_players)
 	{
 		return;
@@ -0,0 +1,274 @@
+#include "metrics.h"
+
+#include <new>
+#include <stdio.h>
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // #ifdef __linux__
+
+
+
+static const char* c_counter_names[] =
+{
+	"net.packets_sent",
+	"net.bytes_sent",
+	"net.send_errors",
+	"net.send_syscalls",
+	"net.packets_received",
+	"net.bytes_received",
+	"net.receive_syscalls",
+	"net.uring_out_of_buffers",
+	"net.uring_truncated",
+	"client_msg.join_bytes",
+	"client_msg.leave_bytes",
+	"client_msg.input_bytes",
+	"client_msg.invalid",
+	"server_msg.join_result_bytes",
+	"server_msg.state_bytes",
+	"server.joins",
+	"server.joins_rejected",
+	"server.leaves",
+	"server.timeouts",
+	"server.msgs_not_connected",
+	"server.msgs_dropped_shard_queue",
+	"server.msgs_dropped_inbox",
+	"server.room_ticks",
+	"server.room_tick_overruns",
+	"server.dispatch_ns",
+	"server.room_inbox_ns",
+	"server.room_simulate_ns",
+	"server.room_encode_ns",
+	"server.room_send_ns"
+};
+static_assert(sizeof(c_counter_names) / sizeof(c_counter_names[0]) == (uint32)Metric_Counter::Count, "a name for every counter");
+
+static const char* c_gauge_names[] =
+{
+	"server.tick_rate",
+	"server.rooms",
+	"server.rooms_occupied",
+	"server.clients"
+};
+static_assert(sizeof(c_gauge_names) / sizeof(c_gauge_names[0]) == (uint32)Metric_Gauge::Count, "a name for every gauge");
+
+static const char* c_histogram_names[] =
+{
+	"server.room_tick_time_us",
+	"server.receive_latency_us"
+};
+static_assert(sizeof(c_histogram_names) / sizeof(c_histogram_names[0]) == (uint32)Metric_Histogram::Count, "a name for every histogram");
+
+static Metrics s_local_metrics;
+Metrics* g_metrics = &s_local_metrics;
+#ifdef __linux__
+static char s_shared_memory_name[64];
+#endif // #ifdef __linux__
+
+
+static void metrics_shared_memory_name(char* out_name, uint32 out_name_size, uint16 port)
+{
+	snprintf(out_name, out_name_size, "/odin_metrics_%hu", port);
+}
+
+bool32 metrics_publish(uint16 port)
+{
+#ifdef __linux__
+	metrics_shared_memory_name(s_shared_memory_name, sizeof(s_shared_memory_name), port);
+	int fd = shm_open(s_shared_memory_name, O_CREAT | O_RDWR, 0644);
+	if (fd == -1)
+	{
+		log("[metrics] shm_open(%s) failed: %d\n", s_shared_memory_name, errno);
+		return false;
+	}
+	if (ftruncate(fd, sizeof(Metrics)) == -1)
+	{
+		log("[metrics] ftruncate failed: %d\n", errno);
+		close(fd);
+		shm_unlink(s_shared_memory_name);
+		return false;
+	}
+	void* memory = mmap(0, sizeof(Metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED)
+	{
+		log("[metrics] mmap failed: %d\n", errno);
+		shm_unlink(s_shared_memory_name);
+		return false;
+	}
+
+	// the segment may be left over from a server which crashed, so start it afresh
+	memset(memory, 0, sizeof(Metrics));
+	Metrics* metrics = new (memory) Metrics;
+	metrics->magic.store(0, std::memory_order_relaxed);
+	metrics->version = c_metrics_version;
+	metrics->num_counters = (uint32)Metric_Counter::Count;
+	metrics->num_gauges = (uint32)Metric_Gauge::Count;
+	metrics->num_histograms = (uint32)Metric_Histogram::Count;
+	metrics->pid = (uint32)getpid();
+	for (uint32 i = 0; i < (uint32)Metric_Counter::Count; ++i)
+	{
+		snprintf(metrics->counter_names[i], c_metric_name_size, "%s", c_counter_names[i]);
+		metrics->counters[i].value.store(g_metrics->counters[i].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	for (uint32 i = 0; i < (uint32)Metric_Gauge::Count; ++i)
+	{
+		snprintf(metrics->gauge_names[i], c_metric_name_size, "%s", c_gauge_names[i]);
+		metrics->gauges[i].value.store(g_metrics->gauges[i].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	for (uint32 i = 0; i < (uint32)Metric_Histogram::Count; ++i)
+	{
+		snprintf(metrics->histogram_names[i], c_metric_name_size, "%s", c_histogram_names[i]);
+		Metrics_Histogram_Values* from = &g_metrics->histograms[i];
+		Metrics_Histogram_Values* to = &metrics->histograms[i];
+		for (uint32 bucket = 0; bucket < c_metrics_histogram_buckets; ++bucket)
+		{
+			to->counts[bucket].store(from->counts[bucket].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+		to->total.store(from->total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		to->sum.store(from->sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		to->max.store(from->max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	metrics->magic.store(c_metrics_magic, std::memory_order_release);
+
+	// anything updated by another thread between the copy and here is lost, so publish before starting them
+	g_metrics = metrics;
+	return true;
+#else
+	log("[metrics] publishing metrics is linux only\n");
+	return false;
+#endif // #ifdef __linux__
+}
+
+void metrics_unpublish()
+{
+#ifdef __linux__
+	if (g_metrics == &s_local_metrics)
+	{
+		return;
+	}
+
+	// readers holding it open keep their mapping, they'll see the pid has gone
+	Metrics* metrics = g_metrics;
+	g_metrics = &s_local_metrics;
+	munmap(metrics, sizeof(Metrics));
+	shm_unlink(s_shared_memory_name);
+#endif // #ifdef __linux__
+}
+
+Metrics* metrics_open(uint16 port)
+{
+#ifdef __linux__
+	char name[64];
+	metrics_shared_memory_name(name, sizeof(name), port);
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1)
+	{
+		return 0;
+	}
+	struct stat stats;
+	if (fstat(fd, &stats) == -1 || stats.st_size < (off_t)sizeof(Metrics))
+	{
+		close(fd);
+		return 0;
+	}
+	void* memory = mmap(0, sizeof(Metrics), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	Metrics* metrics = (Metrics*)memory;
+	if (metrics->magic.load(std::memory_order_acquire) != c_metrics_magic || metrics->version != c_metrics_version)
+	{
+		munmap(memory, sizeof(Metrics));
+		return 0;
+	}
+	return metrics;
+#else
+	return 0;
+#endif // #ifdef __linux__
+}
+
+void metrics_close(Metrics* metrics)
+{
+#ifdef __linux__
+	munmap(metrics, sizeof(Metrics));
+#endif // #ifdef __linux__
+}
+
+void metrics_histogram_add(Metric_Histogram histogram, uint64 value)
+{
+	Metrics_Histogram_Values* values = &g_metrics->histograms[(uint32)histogram];
+
+	uint32 bucket = 0;
+	while (bucket < c_metrics_histogram_buckets - 1 && value >= ((uint64)1 << bucket))
+	{
+		++bucket;
+	}
+	values->counts[bucket].fetch_add(1, std::memory_order_relaxed);
+	values->total.fetch_add(1, std::memory_order_relaxed);
+	values->sum.fetch_add(value, std::memory_order_relaxed);
+
+	uint64 max = values->max.load(std::memory_order_relaxed);
+	while (value > max && !values->max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+void metrics_histogram_read(Metrics* metrics, Metric_Histogram histogram, Metrics_Histogram_Snapshot* out_snapshot)
+{
+	// not an atomic snapshot, the total may be slightly out from the sum of the buckets
+	Metrics_Histogram_Values* values = &metrics->histograms[(uint32)histogram];
+	for (uint32 i = 0; i < c_metrics_histogram_buckets; ++i)
+	{
+		out_snapshot->counts[i] = values->counts[i].load(std::memory_order_relaxed);
+	}
+	out_snapshot->total = values->total.load(std::memory_order_relaxed);
+	out_snapshot->sum = values->sum.load(std::memory_order_relaxed);
+	out_snapshot->max = values->max.load(std::memory_order_relaxed);
+}
+
+void metrics_histogram_diff(Metrics_Histogram_Snapshot* after, Metrics_Histogram_Snapshot* before, Metrics_Histogram_Snapshot* out_diff)
+{
+	for (uint32 i = 0; i < c_metrics_histogram_buckets; ++i)
+	{
+		out_diff->counts[i] = after->counts[i] - before->counts[i];
+	}
+	out_diff->total = after->total - before->total;
+	out_diff->sum = after->sum - before->sum;
+	out_diff->max = after->max;
+}
+
+uint64 metrics_histogram_percentile(Metrics_Histogram_Snapshot* snapshot, float32 percentile)
+{
+	uint64 total = 0;
+	for (uint32 i = 0; i < c_metrics_histogram_buckets; ++i)
+	{
+		total += snapshot->counts[i];
+	}
+	if (!total)
+	{
+		return 0;
+	}
+
+	uint64 target = (uint64)(total * percentile);
+	if (target < 1)
+	{
+		target = 1;
+	}
+	uint64 count = 0;
+	for (uint32 i = 0; i < c_metrics_histogram_buckets - 1; ++i)
+	{
+		count += snapshot->counts[i];
+		if (count >= target)
+		{
+			return (uint64)1 << i;
+		}
+	}
+	return snapshot->max;
+}
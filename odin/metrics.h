@@ -0,0 +1,138 @@
+#pragma once
+
+#include "core.h"
+
+#include <atomic>
+
+
+
+// process wide counters, gauges and histograms, updated with relaxed atomics from any thread. The whole
+// registry is one flat block of memory, which metrics_publish moves into shared memory so that another
+// process (see metrics_cli.cpp) can read it live without the server doing anything extra
+constexpr uint32 c_metrics_magic			= 0x6d6e646f; // "odnm"
+constexpr uint32 c_metrics_version			= 5; // bump whenever the layout or the metrics below change
+constexpr uint32 c_metric_name_size			= 48;
+constexpr uint32 c_metrics_histogram_buckets	= 20; // up to about half a second in microseconds
+
+enum class Metric_Counter : uint32
+{
+	Net_Packets_Sent,
+	Net_Bytes_Sent,
+	Net_Send_Errors,
+	Net_Send_Syscalls, // sendto and sendmmsg calls, io_uring sockets' aren't counted
+	Net_Packets_Received,
+	Net_Bytes_Received,
+	Net_Receive_Syscalls, // recvfrom and recvmmsg calls, io_uring sockets' aren't counted
+	Net_Uring_Out_Of_Buffers, // io_uring had packets but no free provided buffer, so stopped receiving until rearmed
+	Net_Uring_Truncated, // io_uring received a packet bigger than its buffers, and cut it short
+	Client_Msg_Join_Bytes,
+	Client_Msg_Leave_Bytes,
+	Client_Msg_Input_Bytes,
+	Client_Msg_Invalid, // unknown message type, or too short for its type
+	Server_Msg_Join_Result_Bytes,
+	Server_Msg_State_Bytes,
+	Server_Joins,
+	Server_Joins_Rejected, // every room full
+	Server_Leaves,
+	Server_Timeouts,
+	Server_Msgs_Not_Connected, // leaves and inputs from endpoints which aren't connected
+	Server_Msgs_Dropped_Shard_Queue, // a receive shard's queue was full
+	Server_Msgs_Dropped_Inbox, // a room's inbox was full
+	Server_Room_Ticks,
+	Server_Room_Tick_Overruns,
+	// where the server's time goes, the rates are nanoseconds per second
+	Server_Dispatch_Ns, // handling received messages, including joins and leaves
+	Server_Room_Inbox_Ns,
+	Server_Room_Simulate_Ns,
+	Server_Room_Encode_Ns, // snapshots and state packets
+	Server_Room_Send_Ns,
+
+	Count
+};
+
+enum class Metric_Gauge : uint32
+{
+	Server_Tick_Rate,
+	Server_Rooms,
+	Server_Rooms_Occupied,
+	Server_Clients,
+
+	Count
+};
+
+enum class Metric_Histogram : uint32
+{
+	Server_Room_Tick_Time_Us,
+	Server_Receive_Latency_Us, // from a receive shard receiving a message to the dispatcher handling it
+
+	Count
+};
+
+// each on its own cache line, so threads updating different metrics don't contend
+struct alignas(64) Metrics_Value
+{
+	std::atomic<uint64> value;
+};
+
+// power of 2 buckets, bucket i counts [2^(i-1), 2^i), the last bucket everything above
+struct alignas(64) Metrics_Histogram_Values
+{
+	std::atomic<uint64> counts[c_metrics_histogram_buckets];
+	std::atomic<uint64> total;
+	std::atomic<uint64> sum;
+	std::atomic<uint64> max;
+};
+
+// shared between processes, so only fixed size, lock free members. magic is written last when publishing,
+// so a reader which sees it can trust the rest
+struct Metrics
+{
+	std::atomic<uint32> magic;
+	uint32 version;
+	uint32 num_counters;
+	uint32 num_gauges;
+	uint32 num_histograms;
+	uint32 pid;
+	char counter_names[(uint32)Metric_Counter::Count][c_metric_name_size];
+	char gauge_names[(uint32)Metric_Gauge::Count][c_metric_name_size];
+	char histogram_names[(uint32)Metric_Histogram::Count][c_metric_name_size];
+	Metrics_Value counters[(uint32)Metric_Counter::Count];
+	Metrics_Value gauges[(uint32)Metric_Gauge::Count]; // int64 values stored as uint64
+	Metrics_Histogram_Values histograms[(uint32)Metric_Histogram::Count];
+};
+static_assert(std::atomic<uint64>::is_always_lock_free && std::atomic<uint32>::is_always_lock_free, "metrics are shared between processes, so atomics can't use locks");
+
+// a plain copy of a histogram, for working out percentiles
+struct Metrics_Histogram_Snapshot
+{
+	uint64 counts[c_metrics_histogram_buckets];
+	uint64 total;
+	uint64 sum;
+	uint64 max;
+};
+
+extern Metrics* g_metrics; // process memory until published, so updates are always safe
+
+// moves the metrics into a shared memory segment named for the port, carrying over what's been counted so far
+bool32	metrics_publish(uint16 port);
+void	metrics_unpublish();
+// maps a running server's metrics read only, 0 if there aren't any
+Metrics* metrics_open(uint16 port);
+void	metrics_close(Metrics* metrics);
+
+inline void metrics_add(Metric_Counter counter, uint64 amount = 1)
+{
+	g_metrics->counters[(uint32)counter].value.fetch_add(amount, std::memory_order_relaxed);
+}
+
+inline void metrics_set(Metric_Gauge gauge, int64 value)
+{
+	g_metrics->gauges[(uint32)gauge].value.store((uint64)value, std::memory_order_relaxed);
+}
+
+void	metrics_histogram_add(Metric_Histogram histogram, uint64 value);
+void	metrics_histogram_read(Metrics* metrics, Metric_Histogram histogram, Metrics_Histogram_Snapshot* out_snapshot);
+// what was added between before and after, max is after's as it's never reset
+void	metrics_histogram_diff(Metrics_Histogram_Snapshot* after, Metrics_Histogram_Snapshot* before, Metrics_Histogram_Snapshot* out_diff);
+// upper bound of the bucket the percentile falls in, max for the last bucket
+uint64	metrics_histogram_percentile(Metrics_Histogram_Snapshot* snapshot, float32 percentile);
@@ -0,0 +1,146 @@
+#include "core.h"
+#include "metrics.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+
+
+// prints a running server's metrics, read straight out of its shared memory, so the server doesn't know
+// it's being watched. Counters are shown with their rate, histograms just what was added in the interval
+
+
+static void print_usage(const char* program_name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --port <port>            port of the server to watch (default %hu)\n"
+		"  --interval <seconds>     how often to print (default 1)\n"
+		"  --once                   print totals once and exit\n",
+		program_name, c_port);
+}
+
+static void metrics_print(Metrics* metrics, Metrics* previous, float32 interval_s, uint16 port)
+{
+	printf("odin server pid %u, port %hu\n", metrics->pid, port);
+
+	printf("  %-36s %16s %14s\n", "counter", "total", previous ? "per second" : "");
+	for (uint32 i = 0; i < metrics->num_counters; ++i)
+	{
+		uint64 value = metrics->counters[i].value.load(std::memory_order_relaxed);
+		if (previous)
+		{
+			uint64 previous_value = previous->counters[i].value.load(std::memory_order_relaxed);
+			printf("  %-36s %16llu %14.1f\n", metrics->counter_names[i], value, (value - previous_value) / interval_s);
+		}
+		else
+		{
+			printf("  %-36s %16llu\n", metrics->counter_names[i], value);
+		}
+	}
+
+	printf("  %-36s %16s\n", "gauge", "value");
+	for (uint32 i = 0; i < metrics->num_gauges; ++i)
+	{
+		printf("  %-36s %16lld\n", metrics->gauge_names[i], (int64)metrics->gauges[i].value.load(std::memory_order_relaxed));
+	}
+
+	printf("  %-36s %16s %10s %10s %10s %10s\n", "histogram", "samples", "p50 <", "p99 <", "mean", "max ever");
+	for (uint32 i = 0; i < metrics->num_histograms; ++i)
+	{
+		Metrics_Histogram_Snapshot snapshot;
+		metrics_histogram_read(metrics, (Metric_Histogram)i, &snapshot);
+		if (previous)
+		{
+			Metrics_Histogram_Snapshot previous_snapshot;
+			metrics_histogram_read(previous, (Metric_Histogram)i, &previous_snapshot);
+			Metrics_Histogram_Snapshot diff;
+			metrics_histogram_diff(&snapshot, &previous_snapshot, &diff);
+			snapshot = diff;
+		}
+		printf("  %-36s %16llu %10llu %10llu %10.1f %10llu\n",
+			metrics->histogram_names[i],
+			snapshot.total,
+			metrics_histogram_percentile(&snapshot, 0.5f),
+			metrics_histogram_percentile(&snapshot, 0.99f),
+			snapshot.total ? (float64)snapshot.sum / snapshot.total : 0.0,
+			snapshot.max);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	uint16 port = c_port;
+	float32 interval_s = 1.0f;
+	bool32 once = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		if (!strcmp(arg, "--port") && i + 1 < argc)
+		{
+			port = (uint16)atoi(argv[++i]);
+		}
+		else if (!strcmp(arg, "--interval") && i + 1 < argc)
+		{
+			interval_s = (float32)atof(argv[++i]);
+			if (interval_s <= 0.0f)
+			{
+				fprintf(stderr, "--interval must be more than 0\n");
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--once"))
+		{
+			once = true;
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return !strcmp(arg, "--help") ? 0 : 1;
+		}
+	}
+
+	Metrics* metrics = metrics_open(port);
+	if (!metrics)
+	{
+		fprintf(stderr, "no server metrics for port %hu, is a server running there?\n", port);
+		return 1;
+	}
+
+	if (once)
+	{
+		metrics_print(metrics, 0, 0.0f, port);
+		metrics_close(metrics);
+		return 0;
+	}
+
+	// a private copy of the last read to take rates from, the copy isn't atomic as a whole but each value is
+	Metrics* previous = new Metrics;
+	memcpy((void*)previous, (void*)metrics, sizeof(Metrics));
+	Timer interval_timer = timer();
+	while (true)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds((int64)(interval_s * 1000000)));
+		if (kill((pid_t)metrics->pid, 0) == -1 && errno == ESRCH)
+		{
+			fprintf(stderr, "server %u has stopped\n", metrics->pid);
+			break;
+		}
+
+		float32 elapsed_s = timer_get_s(&interval_timer);
+		interval_timer = timer();
+		metrics_print(metrics, previous, elapsed_s, port);
+		memcpy((void*)previous, (void*)metrics, sizeof(Metrics));
+	}
+
+	delete previous;
+	metrics_close(metrics);
+	return 0;
+}
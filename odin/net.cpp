@@ -1,8 +1,23 @@
 #include "net.h"
 
 #include "core.h"
+#include "metrics.h"
+#include "net_uring.h"
+#include "packet_ring.h"
 
+#include <atomic>
+#include <new>
 #include <stdio.h>
+#include <thread>
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 
 namespace Net
@@ -10,8 +25,28 @@ namespace Net
 
 
 
+#ifdef __linux__
+typedef socklen_t Socket_Address_Size;
+
+static int socket_last_error()
+{
+	return errno;
+}
+#else
+typedef int Socket_Address_Size;
+
+static int socket_last_error()
+{
+	return WSAGetLastError();
+}
+#endif // #ifdef __linux__
+
 bool32 init()
 {
+#ifdef __linux__
+	// nothing to start up
+	return true;
+#else
 	WORD winsock_version = 0x202;
 	WSADATA winsock_data;
 	if (WSAStartup(winsock_version, &winsock_data))
@@ -21,6 +56,7 @@ bool32 init()
 	}
 
 	return true;
+#endif // #ifdef __linux__
 }
 
 IP_Endpoint ip_endpoint(uint8 a, uint8 b, uint8 c, uint8 d, uint16 port)
@@ -55,17 +91,266 @@ void ip_endpoint_to_str(char* out_str, size_t out_str_size, IP_Endpoint* ip_endp
 			ip_endpoint->port);
 }
 
+static uint32 endpoint_hash(IP_Endpoint* endpoint)
+{
+	uint32 hash = (endpoint->address ^ ((uint32)endpoint->port << 16) ^ endpoint->port) * 0x9E3779B1; // fibonacci hashing
+	return hash ^ (hash >> 16);
+}
+
+void endpoint_map_create(Endpoint_Map* map, uint32 max_entries, Linear_Allocator* allocator)
+{
+	uint32 capacity = 1;
+	while (capacity < max_entries * 2)
+	{
+		capacity <<= 1;
+	}
+
+	map->keys = (IP_Endpoint*)linear_allocator_alloc(allocator, sizeof(IP_Endpoint) * capacity);
+	map->values = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * capacity);
+	map->mask = capacity - 1;
+	map->count = 0;
+	for (uint32 i = 0; i < capacity; ++i)
+	{
+		map->keys[i] = {};
+	}
+}
+
+uint32 endpoint_map_get(Endpoint_Map* map, IP_Endpoint* key)
+{
+	for (uint32 i = endpoint_hash(key) & map->mask; ; i = (i + 1) & map->mask)
+	{
+		if (ip_endpoint_equals(&map->keys[i], key))
+		{
+			return map->values[i];
+		}
+		if (!map->keys[i].address && !map->keys[i].port)
+		{
+			return c_endpoint_map_not_found;
+		}
+	}
+}
+
+void endpoint_map_set(Endpoint_Map* map, IP_Endpoint* key, uint32 value)
+{
+	assert(key->address || key->port);
+
+	uint32 i = endpoint_hash(key) & map->mask;
+	while ((map->keys[i].address || map->keys[i].port) && !ip_endpoint_equals(&map->keys[i], key))
+	{
+		i = (i + 1) & map->mask;
+	}
+
+	if (!map->keys[i].address && !map->keys[i].port)
+	{
+		assert(map->count < (map->mask + 1) / 2);
+		++map->count;
+	}
+	map->keys[i] = *key;
+	map->values[i] = value;
+}
+
+void endpoint_map_remove(Endpoint_Map* map, IP_Endpoint* key)
+{
+	uint32 i = endpoint_hash(key) & map->mask;
+	while (!ip_endpoint_equals(&map->keys[i], key))
+	{
+		if (!map->keys[i].address && !map->keys[i].port)
+		{
+			return;
+		}
+		i = (i + 1) & map->mask;
+	}
+
+	// shift back any later entries in the run which would no longer be found past the gap, so no tombstones are needed
+	uint32 gap = i;
+	for (uint32 j = (i + 1) & map->mask; map->keys[j].address || map->keys[j].port; j = (j + 1) & map->mask)
+	{
+		uint32 home = endpoint_hash(&map->keys[j]) & map->mask;
+		if (((j - home) & map->mask) >= ((j - gap) & map->mask))
+		{
+			map->keys[gap] = map->keys[j];
+			map->values[gap] = map->values[j];
+			gap = j;
+		}
+	}
+	map->keys[gap] = {};
+	--map->count;
+}
+
+
+// in process sockets, each socket has a bounded lock-free multi-producer single-consumer queue
+// which any other in process socket can push to by port, packets never touch the kernel
+constexpr uint32 c_in_process_queue_capacity = 256;
+constexpr uint32 c_in_process_queue_mask = c_in_process_queue_capacity - 1;
+constexpr uint16 c_in_process_first_ephemeral_port = 49152;
+
+struct In_Process_Packet
+{
+	std::atomic<uint32> sequence; // == position when free to write, == position + 1 when written
+	uint32 size;
+	IP_Endpoint from;
+	uint8 data[c_packet_budget_per_tick];
+};
+
+struct In_Process_Queue
+{
+	alignas(64) std::atomic<uint32> push_position;
+	alignas(64) uint32 pop_position;
+	In_Process_Packet packets[c_in_process_queue_capacity];
+};
+
+static std::atomic<In_Process_Queue*> in_process_ports[65536];
+// senders part way through pushing to each port's queue, a closing socket waits for its port's to 
+// drain so the queue's memory can go back to its owner without a sender still writing to it
+static std::atomic<uint32> in_process_port_senders[65536];
+
+static In_Process_Queue* in_process_queue_create(Linear_Allocator* allocator)
+{
+	uint8* memory = linear_allocator_alloc(allocator, sizeof(In_Process_Queue) + 63);
+	In_Process_Queue* queue = new ((void*)(((uintptr_t)memory + 63) & ~(uintptr_t)63)) In_Process_Queue;
+
+	queue->push_position.store(0, std::memory_order_relaxed);
+	queue->pop_position = 0;
+	for (uint32 i = 0; i < c_in_process_queue_capacity; ++i)
+	{
+		queue->packets[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	return queue;
+}
+
+static bool32 in_process_queue_push(In_Process_Queue* queue, uint8* packet, uint32 packet_size, IP_Endpoint* from)
+{
+	assert(packet_size <= c_packet_budget_per_tick);
 
-#ifdef FAKE_LAG
-// when using fake lag, put normal socket in this namespace so the socket with
-// fake lag can use them while implementing the same interface
-namespace Internal
+	uint32 position = queue->push_position.load(std::memory_order_relaxed);
+	In_Process_Packet* slot;
+	while (true)
+	{
+		slot = &queue->packets[position & c_in_process_queue_mask];
+		uint32 sequence = slot->sequence.load(std::memory_order_acquire);
+		int32 diff = (int32)(sequence - position);
+		if (diff == 0)
+		{
+			if (queue->push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			return false; // full, drop it like a real socket would
+		}
+		else
+		{
+			position = queue->push_position.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->size = packet_size;
+	slot->from = *from;
+	memcpy(slot->data, packet, packet_size);
+	slot->sequence.store(position + 1, std::memory_order_release);
+
+	return true;
+}
+
+static bool32 in_process_queue_pop(In_Process_Queue* queue, uint8* buffer, uint32 buffer_size, uint32* out_packet_size, IP_Endpoint* out_from)
 {
-#endif // #ifdef FAKE_LAG
+	uint32 position = queue->pop_position;
+	In_Process_Packet* slot = &queue->packets[position & c_in_process_queue_mask];
+	if (slot->sequence.load(std::memory_order_acquire) != position + 1)
+	{
+		return false;
+	}
+
+	// like recvfrom, anything which doesn't fit is truncated
+	uint32 packet_size = slot->size < buffer_size ? slot->size : buffer_size;
+	memcpy(buffer, slot->data, packet_size);
+	*out_packet_size = packet_size;
+	*out_from = slot->from;
+
+	slot->sequence.store(position + c_in_process_queue_capacity, std::memory_order_release);
+	queue->pop_position = position + 1;
+
+	return true;
+}
+
+static bool32 in_process_port_claim(uint16 port, In_Process_Queue* queue)
+{
+	In_Process_Queue* expected = 0;
+	return in_process_ports[port].compare_exchange_strong(expected, queue);
+}
+
+
+static bool32 in_process_socket_bind(Socket* sock, uint16 port)
+{
+	if (!in_process_port_claim(port, sock->in_process_queue))
+	{
+		log("[net] in process port %hu already in use\n", port);
+		return false;
+	}
+
+	sock->in_process_port = port;
+	return true;
+}
+
+// once this returns nothing can push to the socket's queue
+static void in_process_socket_unpublish(Socket* sock)
+{
+	if (!sock->in_process_port)
+	{
+		return; // never bound or sent, so nobody could find the queue
+	}
+
+	in_process_ports[sock->in_process_port].store(0, std::memory_order_seq_cst);
+	while (in_process_port_senders[sock->in_process_port].load(std::memory_order_acquire))
+	{
+		std::this_thread::yield();
+	}
+	sock->in_process_port = 0;
+}
+
+static bool32 in_process_socket_send(Socket* sock, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint)
+{
+	if (!sock->in_process_port)
+	{
+		// like an unbound udp socket, pick an ephemeral port so replies can find their way back
+		for (uint32 port = c_in_process_first_ephemeral_port; port < 65536; ++port)
+		{
+			if (in_process_port_claim((uint16)port, sock->in_process_queue))
+			{
+				sock->in_process_port = (uint16)port;
+				break;
+			}
+		}
+
+		if (!sock->in_process_port)
+		{
+			log("[net] no free in process ports\n");
+			return false;
+		}
+	}
+
+	// seq_cst against in_process_socket_unpublish, either it sees this sender and waits, or this sender 
+	// sees the port already cleared
+	in_process_port_senders[endpoint->port].fetch_add(1, std::memory_order_seq_cst);
+	In_Process_Queue* destination = in_process_ports[endpoint->port].load(std::memory_order_seq_cst);
+	if (destination)
+	{
+		IP_Endpoint from = ip_endpoint(127, 0, 0, 1, sock->in_process_port);
+		in_process_queue_push(destination, packet, packet_size, &from);
+	}
+	// else nobody listening, the packet is lost just as it would be over udp
+	in_process_port_senders[endpoint->port].fetch_sub(1, std::memory_order_release);
+
+	return true;
+}
+
 
 static bool32 set_sock_opt(SOCKET sock, int opt, int val)
 {
-	int len = sizeof(int);
+	Socket_Address_Size len = sizeof(int);
 	if (setsockopt(sock, SOL_SOCKET, opt, (char*)&val, len) == SOCKET_ERROR)
 	{
 		return false;
@@ -77,94 +362,475 @@ static bool32 set_sock_opt(SOCKET sock, int opt, int val)
 		return false;
 	}
 
+#ifdef __linux__
+	// linux reports double what was asked for (the rest is for its bookkeeping), or less if capped by net.core.*mem_max
+	return actual >= val;
+#else
 	return val == actual;
+#endif // #ifdef __linux__
 }
 
-bool32 socket(Socket* out_socket)
+constexpr uint32 c_receive_ring_mask = c_receive_ring_capacity - 1;
+constexpr uint32 c_no_uring_buffer = (uint32)-1;
+
+struct Receive_Ring
 {
-	int address_family = AF_INET;
-	int type = SOCK_DGRAM;
-	int protocol = IPPROTO_UDP;
-	SOCKET sock = ::socket(address_family, type, protocol);
+	uint8* buffers; // c_receive_ring_capacity buffers of c_packet_budget_per_tick bytes
+	uint32* sizes;
+	IP_Endpoint* froms;
+	uint8** link_buffers; // when a view points at a link emulator buffer instead, 0 otherwise
+	uint32* uring_buffer_ids; // when a view points at an io_uring provided buffer instead, c_no_uring_buffer otherwise
+	uint32 head; // next slot to receive into
+	uint32 tail; // oldest slot still held
+};
+
+static Receive_Ring* receive_ring_create(Linear_Allocator* allocator)
+{
+	Receive_Ring* ring = (Receive_Ring*)linear_allocator_alloc(allocator, sizeof(Receive_Ring));
+	ring->buffers = linear_allocator_alloc(allocator, c_receive_ring_capacity * c_packet_budget_per_tick);
+	ring->sizes = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * c_receive_ring_capacity);
+	ring->froms = (IP_Endpoint*)linear_allocator_alloc(allocator, sizeof(IP_Endpoint) * c_receive_ring_capacity);
+	ring->link_buffers = (uint8**)linear_allocator_alloc(allocator, sizeof(uint8*) * c_receive_ring_capacity);
+	ring->uring_buffer_ids = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * c_receive_ring_capacity);
+	ring->head = 0;
+	ring->tail = 0;
+	return ring;
+}
 
-	if (!set_sock_opt(sock, SO_RCVBUF, (int)megabytes(1)))
+static void raw_socket_close(Socket* sock)
+{
+	if (sock->is_send_only)
 	{
-		log("failed to set rcvbuf size");
+		return; // the handle belongs to the socket it was made from
 	}
-	if (!set_sock_opt(sock, SO_SNDBUF, (int)megabytes(1)))
+
+	if (sock->type == Socket_Type::In_Process)
+	{
+		// the queue's memory belongs to the allocator the socket was made with
+		in_process_socket_unpublish(sock);
+		return;
+	}
+
+#ifdef __linux__
+	if (sock->uring)
+	{
+		uring_destroy(sock->uring);
+	}
+#endif // #ifdef __linux__
+
+#ifdef __linux__
+	int result = close(sock->handle);
+#else
+	int result = closesocket(sock->handle);
+#endif // #ifdef __linux__
+	assert(result != SOCKET_ERROR);
+}
+
+bool32 socket(Socket* out_socket, Socket_Type type, Linear_Allocator* allocator)
+{
+	if (type == Socket_Type::In_Process)
 	{
-		log("failed to set sndbuf size");
+		*out_socket = {};
+		out_socket->type = type;
+		out_socket->handle = INVALID_SOCKET;
+		out_socket->in_process_queue = in_process_queue_create(allocator);
+		out_socket->receive_ring = receive_ring_create(allocator);
+		return true;
 	}
 
+	int address_family = AF_INET;
+	int socket_type = SOCK_DGRAM;
+	int protocol = IPPROTO_UDP;
+	SOCKET sock = ::socket(address_family, socket_type, protocol);
 	if (sock == INVALID_SOCKET)
 	{
-		log("[net] socket() failed: %d\n", WSAGetLastError());
+		log("[net] socket() failed: %d\n", socket_last_error());
 		return false;
 	}
 
-	// put socket in non-blocking mode
-	u_long enabled = 1;
-	int result = ioctlsocket(sock, FIONBIO, &enabled);
-	if (result == SOCKET_ERROR)
+	if (!set_sock_opt(sock, SO_RCVBUF, (int)megabytes(1)))
 	{
-		log("[net] ioctlsocket() failed: %d\n", WSAGetLastError());
-		return false;
+		log("[net] failed to set rcvbuf size\n");
+	}
+	if (!set_sock_opt(sock, SO_SNDBUF, (int)megabytes(1)))
+	{
+		log("[net] failed to set sndbuf size\n");
 	}
 
 	*out_socket = {};
 	out_socket->handle = sock;
+	out_socket->receive_ring = receive_ring_create(allocator);
+
+	if (type == Socket_Type::Io_Uring)
+	{
+#ifdef __linux__
+		if (!uring_create(&out_socket->uring, sock, allocator))
+		{
+			log("[net] io_uring not available, using plain udp socket\n");
+			type = Socket_Type::Udp;
+		}
+#else
+		type = Socket_Type::Udp;
+#endif // #ifdef __linux__
+	}
+	out_socket->type = type;
+
+	// put socket in non-blocking mode, io_uring does its own waiting so leaves it blocking
+	if (!out_socket->uring)
+	{
+#ifdef __linux__
+		int result = fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+#else
+		u_long enabled = 1;
+		int result = ioctlsocket(sock, FIONBIO, &enabled);
+#endif // #ifdef __linux__
+		if (result == SOCKET_ERROR)
+		{
+			log("[net] failed to make socket non-blocking: %d\n", socket_last_error());
+			raw_socket_close(out_socket);
+			return false;
+		}
+	}
+
+#ifdef __linux__
+	// UDP_SEGMENT is only known to kernels with UDP GSO (4.18+)
+	int segment_size;
+	socklen_t segment_size_len = sizeof(segment_size);
+	out_socket->supports_udp_segment = getsockopt(sock, IPPROTO_UDP, UDP_SEGMENT, &segment_size, &segment_size_len) == 0;
+#endif // #ifdef __linux__
 
 	return true;
 }
 
-void socket_close(Socket* sock)
+uint64 socket_memory_size(Socket_Type type)
 {
-	int result = closesocket(sock->handle);
-	assert(result != SOCKET_ERROR);
+	uint64 size =	sizeof(Receive_Ring) + 
+					(c_receive_ring_capacity * (c_packet_budget_per_tick + sizeof(uint32) + sizeof(IP_Endpoint) + sizeof(uint8*) + sizeof(uint32)));
+	if (type == Socket_Type::In_Process)
+	{
+		size += sizeof(In_Process_Queue) + 63;
+	}
+#ifdef __linux__
+	else if (type == Socket_Type::Io_Uring)
+	{
+		size += uring_memory_size();
+	}
+#endif // #ifdef __linux__
+	return size;
 }
 
 bool32 socket_bind(Socket* sock, IP_Endpoint* local_endpoint)
 {
+	if (sock->type == Socket_Type::In_Process)
+	{
+		sock->can_receive = 1;
+		return in_process_socket_bind(sock, local_endpoint->port);
+	}
+
 	SOCKADDR_IN local_address = ip_endpoint_to_sockaddr_in(local_endpoint);
 	if (bind(sock->handle, (SOCKADDR*)&local_address, sizeof(local_address)) == SOCKET_ERROR)
 	{
-		log("[net] bind() failed: %d\n", WSAGetLastError());
+		log("[net] bind() failed: %d\n", socket_last_error());
 		return false;
 	}
 
+	sock->can_receive = 1;
+
 	return true;
 }
 
-bool32 socket_send(Socket* sock, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint)
+bool32 socket_set_reuse_port(Socket* sock)
+{
+#ifdef __linux__
+	if (sock->type != Socket_Type::In_Process && set_sock_opt(sock->handle, SO_REUSEPORT, 1))
+	{
+		return true;
+	}
+#endif // #ifdef __linux__
+
+	log("[net] SO_REUSEPORT not supported\n");
+	return false;
+}
+
+bool32 socket_set_reuse_port_steering(Socket* sock, uint32 num_shards)
+{
+#ifdef __linux__
+	// the program runs with the packet data at the udp payload, so the addresses are read relative to 
+	// the ip header (assumed to have no options), source address ^ source port is mixed and reduced
+	// mod num_shards to pick the socket, so an endpoint always lands on the same shard
+	sock_filter code[] = 
+	{
+		{ BPF_LD | BPF_W | BPF_ABS,		0, 0, (uint32)(SKF_NET_OFF + 12) },	// a = source address
+		{ BPF_MISC | BPF_TAX,			0, 0, 0 },							// x = a
+		{ BPF_LD | BPF_H | BPF_ABS,		0, 0, (uint32)(SKF_NET_OFF + 20) },	// a = source port
+		{ BPF_ALU | BPF_XOR | BPF_X,	0, 0, 0 },							// a ^= x
+		{ BPF_ALU | BPF_MUL | BPF_K,	0, 0, 2654435761u },				// a *= knuth's multiplicative hash constant
+		{ BPF_ALU | BPF_RSH | BPF_K,	0, 0, 16 },							// a >>= 16
+		{ BPF_ALU | BPF_MOD | BPF_K,	0, 0, num_shards },					// a %= num_shards
+		{ BPF_RET | BPF_A,				0, 0, 0 },							// socket index in the group
+	};
+	sock_fprog program;
+	program.len = sizeof(code) / sizeof(code[0]);
+	program.filter = code;
+
+	if (sock->type != Socket_Type::In_Process && 
+		setsockopt(sock->handle, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0)
+	{
+		return true;
+	}
+
+	log("[net] SO_ATTACH_REUSEPORT_CBPF failed: %d\n", errno);
+#endif // #ifdef __linux__
+
+	return false;
+}
+
+// unbound sockets are given a port when they first send. Only that first send writes the flag, so once a 
+// socket is bound, or has sent on the thread that owns it, other threads can send while one receives
+static void socket_mark_can_receive(Socket* sock)
+{
+	if (!sock->can_receive)
+	{
+		sock->can_receive = 1;
+	}
+}
+
+static bool32 raw_socket_send(Socket* sock, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint)
 {
-	SOCKADDR_IN server_address;
-	server_address.sin_family = AF_INET;
-	server_address.sin_addr.S_un.S_addr = htonl(endpoint->address);
-	server_address.sin_port = htons(endpoint->port);
+	socket_mark_can_receive(sock);
+
+	if (sock->type == Socket_Type::In_Process)
+	{
+		return in_process_socket_send(sock, packet, packet_size, endpoint);
+	}
+
+#ifdef __linux__
+	if (sock->uring)
+	{
+		return uring_send(sock->uring, packet, packet_size, endpoint) && uring_submit(sock->uring);
+	}
+#endif // #ifdef __linux__
+
+	SOCKADDR_IN server_address = ip_endpoint_to_sockaddr_in(endpoint);
 	int server_address_size = sizeof(server_address);
 
-	if (sendto(sock->handle, (const char*)packet, packet_size, 0, (SOCKADDR*)&server_address, server_address_size) == SOCKET_ERROR)
+	int result = sendto(sock->handle, (const char*)packet, packet_size, 0, (SOCKADDR*)&server_address, server_address_size);
+	metrics_add(Metric_Counter::Net_Send_Syscalls);
+	if (result == SOCKET_ERROR)
 	{
-		log("[net] sendto() failed: %d\n", WSAGetLastError());
+		log("[net] sendto() failed: %d\n", socket_last_error());
 		return false;
 	}
 
 	return true;
 }
 
-bool32 socket_receive(Socket* sock, uint8* buffer, uint32 buffer_size, uint32* out_packet_size, IP_Endpoint* out_from)
+#ifdef __linux__
+// a send with UDP_SEGMENT failing with EIO means the device can't do segmentation offload, which any socket
+// sending through it would find too, so once one has none do. Sockets' supports_udp_segment is only ever 
+// written by socket(), as any number of threads may be sending on one
+static std::atomic<bool32> s_udp_segment_failed;
+#endif // #ifdef __linux__
+
+static bool32 raw_socket_send_batch(	Socket* sock, 
+									uint8* packets, uint32 packet_stride, uint32* packet_sizes, 
+									IP_Endpoint* endpoints, uint32 num_packets)
+{
+	socket_mark_can_receive(sock);
+
+#ifdef __linux__
+	if (sock->type == Socket_Type::In_Process)
+	{
+		bool32 success = true;
+		for (uint32 i = 0; i < num_packets; ++i)
+		{
+			if (!in_process_socket_send(sock, &packets[i * packet_stride], packet_sizes[i], &endpoints[i]))
+			{
+				success = false;
+			}
+		}
+
+		return success;
+	}
+
+	if (sock->uring)
+	{
+		// the whole batch goes to the kernel in one submit
+		bool32 success = true;
+		for (uint32 i = 0; i < num_packets; ++i)
+		{
+			if (!uring_send(sock->uring, &packets[i * packet_stride], packet_sizes[i], &endpoints[i]))
+			{
+				success = false;
+			}
+		}
+
+		return uring_submit(sock->uring) && success;
+	}
+
+	// sendmmsg sends a whole batch of datagrams in one syscall, and where the kernel supports it
+	// runs of same sized packets to the same endpoint are handed over as one UDP GSO message
+	bool32 use_udp_segment = sock->supports_udp_segment && !s_udp_segment_failed.load(std::memory_order_relaxed);
+	constexpr uint32 c_max_batch_size = 64;
+	constexpr uint32 c_max_segments = 64; // UDP_MAX_SEGMENTS
+	constexpr uint32 c_max_segmented_size = 65507; // max udp payload
+	mmsghdr		messages[c_max_batch_size];
+	iovec		iovecs[c_max_batch_size];
+	sockaddr_in	destinations[c_max_batch_size];
+	uint8		controls[c_max_batch_size][CMSG_SPACE(sizeof(uint16))];
+
+	bool32 success = true;
+	uint32 packet_index = 0;
+	while (packet_index < num_packets)
+	{
+		uint32 num_messages = 0;
+		uint32 num_iovecs = 0;
+		uint32 message_first_packets[c_max_batch_size];
+		while (packet_index < num_packets && 
+				num_messages < c_max_batch_size && 
+				num_iovecs < c_max_batch_size)
+		{
+			uint32 segment_size = packet_sizes[packet_index];
+			uint32 num_segments = 1;
+			uint32 total_size = segment_size;
+			if (use_udp_segment)
+			{
+				// a segmented message can end in one smaller packet, but all others must be the same size
+				while (packet_index + num_segments < num_packets &&
+						num_segments < c_max_segments &&
+						num_iovecs + num_segments < c_max_batch_size &&
+						ip_endpoint_equals(&endpoints[packet_index], &endpoints[packet_index + num_segments]) &&
+						packet_sizes[packet_index + num_segments - 1] == segment_size &&
+						packet_sizes[packet_index + num_segments] <= segment_size &&
+						total_size + packet_sizes[packet_index + num_segments] <= c_max_segmented_size)
+				{
+					total_size += packet_sizes[packet_index + num_segments];
+					++num_segments;
+				}
+			}
+
+			mmsghdr* message = &messages[num_messages];
+			*message = {};
+			destinations[num_messages] = ip_endpoint_to_sockaddr_in(&endpoints[packet_index]);
+			message->msg_hdr.msg_name = &destinations[num_messages];
+			message->msg_hdr.msg_namelen = sizeof(destinations[num_messages]);
+			message->msg_hdr.msg_iov = &iovecs[num_iovecs];
+			message->msg_hdr.msg_iovlen = num_segments;
+
+			for (uint32 i = 0; i < num_segments; ++i)
+			{
+				iovecs[num_iovecs].iov_base = &packets[(packet_index + i) * packet_stride];
+				iovecs[num_iovecs].iov_len = packet_sizes[packet_index + i];
+				++num_iovecs;
+			}
+
+			if (num_segments > 1)
+			{
+				message->msg_hdr.msg_control = controls[num_messages];
+				message->msg_hdr.msg_controllen = sizeof(controls[num_messages]);
+
+				cmsghdr* control = CMSG_FIRSTHDR(&message->msg_hdr);
+				control->cmsg_level = IPPROTO_UDP;
+				control->cmsg_type = UDP_SEGMENT;
+				control->cmsg_len = CMSG_LEN(sizeof(uint16));
+				uint16 gso_size = (uint16)segment_size;
+				memcpy(CMSG_DATA(control), &gso_size, sizeof(gso_size));
+			}
+
+			message_first_packets[num_messages] = packet_index;
+			packet_index += num_segments;
+			++num_messages;
+		}
+
+		uint32 num_sent = 0;
+		while (num_sent < num_messages)
+		{
+			int result = sendmmsg(sock->handle, &messages[num_sent], num_messages - num_sent, 0);
+			metrics_add(Metric_Counter::Net_Send_Syscalls);
+			if (result < 0)
+			{
+				int error = errno;
+				if (error == EIO && use_udp_segment)
+				{
+					// the device can't do segmentation offload, resend this lot without it
+					if (!s_udp_segment_failed.exchange(true, std::memory_order_relaxed))
+					{
+						log("[net] sendmmsg() with UDP_SEGMENT failed, disabling UDP GSO\n");
+					}
+					use_udp_segment = false;
+					packet_index = message_first_packets[num_sent];
+				}
+				else
+				{
+					log("[net] sendmmsg() failed: %d\n", error);
+					success = false;
+				}
+				break;
+			}
+
+			num_sent += result;
+		}
+	}
+
+	return success;
+#else
+	bool32 success = true;
+	for (uint32 i = 0; i < num_packets; ++i)
+	{
+		if (!raw_socket_send(sock, &packets[i * packet_stride], packet_sizes[i], &endpoints[i]))
+		{
+			success = false;
+		}
+	}
+
+	return success;
+#endif // #ifdef __linux__
+}
+
+static bool32 raw_socket_receive(Socket* sock, uint8* buffer, uint32 buffer_size, uint32* out_packet_size, IP_Endpoint* out_from)
 {
+	if (sock->type == Socket_Type::In_Process)
+	{
+		return in_process_queue_pop(sock->in_process_queue, buffer, buffer_size, out_packet_size, out_from);
+	}
+
+#ifdef __linux__
+	if (sock->uring)
+	{
+		uint8* packet;
+		uint32 packet_size;
+		uint32 buffer_id;
+		if (!uring_receive(sock->uring, &packet, &packet_size, out_from, &buffer_id))
+		{
+			return false;
+		}
+
+		*out_packet_size = packet_size < buffer_size ? packet_size : buffer_size;
+		memcpy(buffer, packet, *out_packet_size);
+		uring_release_buffer(sock->uring, buffer_id);
+
+		return true;
+	}
+#endif // #ifdef __linux__
+
 	int flags = 0;
 	SOCKADDR_IN from;
-	int from_size = sizeof(from);
+	Socket_Address_Size from_size = sizeof(from);
 	int bytes_received = recvfrom(sock->handle, (char*)buffer, buffer_size, flags, (SOCKADDR*)&from, &from_size);
+	metrics_add(Metric_Counter::Net_Receive_Syscalls);
 
 	if (bytes_received == SOCKET_ERROR)
 	{
-		int error = WSAGetLastError();
-		if (error != WSAEWOULDBLOCK && error != WSAECONNRESET)
+		int error = socket_last_error();
+#ifdef __linux__
+		// an icmp port unreachable from an earlier send shows up as ECONNREFUSED
+		bool32 is_error = error != EAGAIN && error != EWOULDBLOCK && error != ECONNREFUSED;
+#else
+		bool32 is_error = error != WSAEWOULDBLOCK && error != WSAECONNRESET;
+#endif // #ifdef __linux__
+		if (is_error)
 		{
-			log("[net] recvfrom() returned SOCKET_ERROR, WSAGetLastError() %d\n", error);
+			log("[net] recvfrom() returned SOCKET_ERROR, error %d\n", error);
 		}
 		
 		return false;
@@ -173,171 +839,459 @@ bool32 socket_receive(Socket* sock, uint8* buffer, uint32 buffer_size, uint32* o
 	*out_packet_size = bytes_received;
 
 	*out_from = {};
-	out_from->address = ntohl(from.sin_addr.S_un.S_addr);
+	out_from->address = ntohl(from.sin_addr.s_addr);
 	out_from->port = ntohs(from.sin_port);
 
 	return true;
 }
 
-void socket_set_fake_lag_s(	Socket* /*sock*/, 
-							float32 /*fake_lag_s*/, 
-							Linear_Allocator* /*allocator*/)
+static uint32 raw_socket_receive_batch(	Socket* sock, 
+										uint8* buffers, uint32 buffer_size, uint32 max_packets, 
+										uint32* out_packet_sizes, IP_Endpoint* out_froms)
 {
-}
+#ifdef __linux__
+	if (sock->type == Socket_Type::In_Process)
+	{
+		uint32 num_received = 0;
+		while (num_received < max_packets &&
+				in_process_queue_pop(sock->in_process_queue, &buffers[num_received * buffer_size], buffer_size, &out_packet_sizes[num_received], &out_froms[num_received]))
+		{
+			++num_received;
+		}
 
-#ifdef FAKE_LAG
-} // namespace Internal
+		return num_received;
+	}
 
+	if (sock->uring)
+	{
+		uint32 num_received = 0;
+		while (num_received < max_packets &&
+				raw_socket_receive(sock, &buffers[num_received * buffer_size], buffer_size, &out_packet_sizes[num_received], &out_froms[num_received]))
+		{
+			++num_received;
+		}
 
-constexpr uint32 c_packet_buffer_capacity = 512;
-constexpr uint32 c_packet_buffer_mask = c_packet_buffer_capacity - 1;
+		return num_received;
+	}
 
-static LARGE_INTEGER clock_frequency;
+	// recvmmsg pulls up to a whole batch of datagrams out of the kernel in one syscall
+	constexpr uint32 c_max_batch_size = 64;
+	mmsghdr		messages[c_max_batch_size];
+	iovec		iovecs[c_max_batch_size];
+	sockaddr_in	froms[c_max_batch_size];
 
-static Packet_Buffer packet_buffer(Linear_Allocator* allocator)
-{
-	QueryPerformanceFrequency(&clock_frequency);
+	uint32 batch_size = max_packets < c_max_batch_size ? max_packets : c_max_batch_size;
+	for (uint32 i = 0; i < batch_size; ++i)
+	{
+		iovecs[i].iov_base = &buffers[i * buffer_size];
+		iovecs[i].iov_len = buffer_size;
+
+		messages[i] = {};
+		messages[i].msg_hdr.msg_name = &froms[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(froms[i]);
+		messages[i].msg_hdr.msg_iov = &iovecs[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int num_received = recvmmsg(sock->handle, messages, batch_size, MSG_DONTWAIT, 0);
+	metrics_add(Metric_Counter::Net_Receive_Syscalls);
+	if (num_received < 0)
+	{
+		int error = errno;
+		if (error != EWOULDBLOCK && error != EAGAIN && error != ECONNREFUSED)
+		{
+			log("[net] recvmmsg() failed: %d\n", error);
+		}
+
+		return 0;
+	}
 
-	Packet_Buffer packet_buffer = {};
-	packet_buffer.index = 0;
-	packet_buffer.size = 0;
-	packet_buffer.packets =							linear_allocator_alloc(allocator, c_packet_buffer_capacity * c_packet_budget_per_tick);
-	packet_buffer.packet_sizes =	(uint32*)		linear_allocator_alloc(allocator, sizeof(uint32) * c_packet_buffer_capacity);
-	packet_buffer.endpoints =		(IP_Endpoint*)	linear_allocator_alloc(allocator, sizeof(IP_Endpoint) * c_packet_buffer_capacity);
-	packet_buffer.times =			(LARGE_INTEGER*)linear_allocator_alloc(allocator, sizeof(LARGE_INTEGER) * c_packet_buffer_capacity);
-	return packet_buffer;
+	for (int i = 0; i < num_received; ++i)
+	{
+		out_packet_sizes[i] = messages[i].msg_len;
+
+		out_froms[i] = {};
+		out_froms[i].address = ntohl(froms[i].sin_addr.s_addr);
+		out_froms[i].port = ntohs(froms[i].sin_port);
+	}
+
+	return (uint32)num_received;
+#else
+	uint32 num_received = 0;
+	while (num_received < max_packets &&
+			raw_socket_receive(sock, &buffers[num_received * buffer_size], buffer_size, &out_packet_sizes[num_received], &out_froms[num_received]))
+	{
+		++num_received;
+	}
+
+	return num_received;
+#endif // #ifdef __linux__
 }
 
-static bool32 packet_buffer_is_full(Packet_Buffer* packet_buffer)
+// link emulation, packets are held in a time ordered queue for each direction and only sent/received once due
+constexpr uint32 c_link_queue_capacity = 512;
+// bytes, packets are packed so an input takes 24, but the receive direction queues states of a few hundred bytes
+// each, and up to c_link_max_queue_delay_s of them when bandwidth is limited
+constexpr uint32 c_link_ring_capacity = kilobytes(64);
+constexpr float32 c_link_max_queue_delay_s = 1.0f; // over this long waiting for bandwidth and a router would drop the packet
+
+struct Link_Packet
+{
+	int64 time; // when the packet is due
+	uint64 order; // tie break so packets due at the same time keep the order they were queued in
+	uint32 size;
+	IP_Endpoint endpoint;
+	uint8* data;
+};
+
+struct Link_Queue
 {
-	return packet_buffer->size == c_packet_buffer_capacity;
+	Link_Profile profile;
+	Link_Packet* heap; // min heap on time
+	uint32 size;
+	Packet_Ring ring; // the packets' bytes
+	int64 busy_until; // when the link will have finished transmitting everything queued so far
+};
+
+struct Link_Emulator
+{
+	bool32 is_enabled;
+	Link_Queue send_queue;
+	Link_Queue recv_queue;
+	uint64 random_state;
+	uint64 next_order;
+	int64 clock_frequency;
+};
+
+// xorshift64*, so a given seed always gives the same sequence of drops/delays
+static float32 link_random_f32(Link_Emulator* link)
+{
+	uint64 x = link->random_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	link->random_state = x;
+	return (float32)((x * 0x2545F4914F6CDD1Dull) >> 40) / (float32)(1 << 24);
 }
 
-static void packet_buffer_push(Packet_Buffer* packet_buffer, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint, float32 fake_lag_s)
+static void link_queue_create(Link_Queue* queue, Linear_Allocator* allocator)
 {
-	assert(!packet_buffer_is_full(packet_buffer));
+	*queue = {};
+	queue->heap = (Link_Packet*)linear_allocator_alloc(allocator, sizeof(Link_Packet) * c_link_queue_capacity);
+	packet_ring_create(&queue->ring, c_link_ring_capacity, allocator);
+}
 
-	LARGE_INTEGER now;
-	QueryPerformanceCounter(&now);
+static bool32 link_packet_is_before(Link_Packet* a, Link_Packet* b)
+{
+	return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
 
-	LARGE_INTEGER then;
-	then.QuadPart = now.QuadPart + (LONGLONG)(clock_frequency.QuadPart * fake_lag_s);
+static void link_queue_heap_push(Link_Queue* queue, Link_Packet* packet)
+{
+	assert(queue->size < c_link_queue_capacity);
 
-	uint32 index = packet_buffer->index;
-	packet_buffer->times[index] = then;
-	packet_buffer->packet_sizes[index] = packet_size;
-	packet_buffer->endpoints[index] = *endpoint;
+	uint32 index = queue->size;
+	++queue->size;
+	while (index)
+	{
+		uint32 parent = (index - 1) / 2;
+		if (!link_packet_is_before(packet, &queue->heap[parent]))
+		{
+			break;
+		}
+		queue->heap[index] = queue->heap[parent];
+		index = parent;
+	}
+	queue->heap[index] = *packet;
+}
 
-	uint8* dst_packet = &packet_buffer->packets[index * c_packet_budget_per_tick];
-	memcpy(dst_packet, packet, packet_size);
+// returns 0 if either the ring or the heap is full
+static uint8* link_queue_alloc(Link_Queue* queue, uint32 size)
+{
+	if (queue->size == c_link_queue_capacity)
+	{
+		return 0;
+	}
 
-	++packet_buffer->size;
-	packet_buffer->index = (packet_buffer->index + 1) & c_packet_buffer_mask;
+	return packet_ring_alloc(&queue->ring, size);
 }
 
-static void packet_buffer_force_pop(Packet_Buffer* packet_buffer, uint8** out_packet, uint32* out_packet_size, IP_Endpoint* out_endpoint)
+// pops the earliest packet if it's due, the caller gives its buffer back with link_queue_free_buffer
+static bool32 link_queue_pop(Link_Queue* queue, int64 now, Link_Packet* out_packet)
 {
-	assert(packet_buffer->size);
+	if (!queue->size || queue->heap[0].time > now)
+	{
+		return false;
+	}
 
-	uint32 index = (packet_buffer->index - packet_buffer->size) & c_packet_buffer_mask;
-	*out_packet = &packet_buffer->packets[index * c_packet_budget_per_tick]; 
-	*out_packet_size = packet_buffer->packet_sizes[index];
-	*out_endpoint = packet_buffer->endpoints[index];
+	*out_packet = queue->heap[0];
 
-	--packet_buffer->size;
+	--queue->size;
+	Link_Packet* last = &queue->heap[queue->size];
+	uint32 index = 0;
+	while (true)
+	{
+		uint32 child = (index * 2) + 1;
+		if (child >= queue->size)
+		{
+			break;
+		}
+		if (child + 1 < queue->size && link_packet_is_before(&queue->heap[child + 1], &queue->heap[child]))
+		{
+			++child;
+		}
+		if (!link_packet_is_before(&queue->heap[child], last))
+		{
+			break;
+		}
+		queue->heap[index] = queue->heap[child];
+		index = child;
+	}
+	queue->heap[index] = *last;
+
+	return true;
 }
 
-static bool32 packet_buffer_pop(Packet_Buffer* packet_buffer, uint8** out_packet, uint32* out_packet_size, IP_Endpoint* out_endpoint)
+static void link_queue_free_buffer(Link_Queue* queue, uint8* buffer)
 {
-	assert(packet_buffer->size);
+	packet_ring_free(&queue->ring, buffer);
+}
 
-	LARGE_INTEGER now;
-	QueryPerformanceCounter(&now);
+// the packet must be in a buffer from link_queue_alloc
+static void link_queue_push(Link_Emulator* link, Link_Queue* queue, uint8* buffer, uint32 packet_size, IP_Endpoint* endpoint, int64 now)
+{
+	Link_Profile* profile = &queue->profile;
 
-	uint32 index = (packet_buffer->index - packet_buffer->size) & c_packet_buffer_mask;
-	if (packet_buffer->times[index].QuadPart <= now.QuadPart)
+	if (link_random_f32(link) < profile->loss)
 	{
-		*out_packet = &packet_buffer->packets[index * c_packet_budget_per_tick]; 
-		*out_packet_size = packet_buffer->packet_sizes[index];
-		*out_endpoint = packet_buffer->endpoints[index];
+		link_queue_free_buffer(queue, buffer);
+		return;
+	}
 
-		--packet_buffer->size;
+	// packets leave one after another at the link's bandwidth
+	int64 transmitted = now;
+	if (profile->bandwidth_bytes_per_s)
+	{
+		int64 departure = queue->busy_until > now ? queue->busy_until : now;
+		if (departure - now > (int64)(c_link_max_queue_delay_s * link->clock_frequency))
+		{
+			link_queue_free_buffer(queue, buffer);
+			return;
+		}
+		transmitted = departure + ((int64)packet_size * link->clock_frequency / profile->bandwidth_bytes_per_s);
+		queue->busy_until = transmitted;
+	}
 
-		return true;
+	uint32 num_copies = link_random_f32(link) < profile->duplicate ? 2 : 1;
+	for (uint32 i = 0; i < num_copies; ++i)
+	{
+		uint8* data = buffer;
+		if (i)
+		{
+			data = link_queue_alloc(queue, packet_size);
+			if (!data)
+			{
+				break;
+			}
+			memcpy(data, buffer, packet_size);
+		}
+
+		float32 delay_s = profile->latency_s + (link_random_f32(link) * profile->jitter_s);
+		if (link_random_f32(link) < profile->reorder)
+		{
+			delay_s += profile->reorder_delay_s;
+		}
+
+		Link_Packet packet;
+		packet.time = transmitted + (int64)(delay_s * link->clock_frequency);
+		packet.order = link->next_order;
+		packet.size = packet_size;
+		packet.endpoint = *endpoint;
+		packet.data = data;
+		++link->next_order;
+
+		link_queue_heap_push(queue, &packet);
 	}
+}
 
-	return false;
+static void link_queue_send(Link_Emulator* link, Link_Queue* queue, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint, int64 now)
+{
+	uint8* buffer = link_queue_alloc(queue, packet_size);
+	if (!buffer)
+	{
+		log("[net] link emulator queue is full\n");
+		return;
+	}
+
+	memcpy(buffer, packet, packet_size);
+	link_queue_push(link, queue, buffer, packet_size, endpoint, now);
 }
 
-bool32 socket(Socket* sock)
+// send anything that's due, and move anything the kernel has for us into the receive queue
+static void link_update(Socket* sock)
 {
-	*sock = {};
+	Link_Emulator* link = sock->link;
+	int64 now = clock_now();
 
-	if (!Internal::socket(&sock->sock))
+	Link_Packet packet;
+	while (link_queue_pop(&link->send_queue, now, &packet))
 	{
-		return false;
+		raw_socket_send(sock, packet.data, packet.size, &packet.endpoint);
+		link_queue_free_buffer(&link->send_queue, packet.data);
 	}
 
-	sock->send_buffer = {};
-	sock->recv_buffer = {};
+	if (!link->is_enabled || !sock->can_receive)
+	{
+		return;
+	}
 
-	return true;
+	Link_Queue* recv_queue = &link->recv_queue;
+	while (true)
+	{
+		// receive into a full size entry, then give back what the packet didn't use
+		uint8* buffer = link_queue_alloc(recv_queue, c_packet_budget_per_tick);
+		if (!buffer)
+		{
+			break;
+		}
+
+		uint32 packet_size;
+		IP_Endpoint from;
+		if (!raw_socket_receive(sock, buffer, c_packet_budget_per_tick, &packet_size, &from))
+		{
+			link_queue_free_buffer(recv_queue, buffer);
+			break;
+		}
+
+		packet_ring_trim(&recv_queue->ring, buffer, packet_size);
+		link_queue_push(link, recv_queue, buffer, packet_size, &from, now);
+	}
+}
+
+
+void socket_send_only(Socket* out_socket, Socket* sock)
+{
+	assert(sock->type != Socket_Type::In_Process);
+
+	*out_socket = {};
+	out_socket->type = Socket_Type::Udp;
+	out_socket->handle = sock->handle;
+	out_socket->supports_udp_segment = sock->supports_udp_segment;
+	out_socket->is_send_only = true;
 }
 
 void socket_close(Socket* sock)
 {
-	while (sock->send_buffer.size)
+	// anything still waiting on the link goes out now
+	if (sock->link)
 	{
-		uint8* packet;
-		uint32 packet_size;
-		IP_Endpoint destination;
-		packet_buffer_force_pop(&sock->send_buffer, &packet, &packet_size, &destination);
-		Internal::socket_send(&sock->sock, packet, packet_size, &destination);
+		Link_Packet packet;
+		while (link_queue_pop(&sock->link->send_queue, INT64_MAX, &packet))
+		{
+			raw_socket_send(sock, packet.data, packet.size, &packet.endpoint);
+			link_queue_free_buffer(&sock->link->send_queue, packet.data);
+		}
 	}
 
-	Internal::socket_close(&sock->sock);
+	raw_socket_close(sock);
 }
 
-bool32 socket_bind(Socket* sock, IP_Endpoint* local_endpoint)
+// what the caller hands over and gets back, so packets the link emulator goes on to drop are still counted
+static void socket_count_sent(bool32 success, uint32 num_packets, uint64 num_bytes)
 {
-	if (Internal::socket_bind(&sock->sock, local_endpoint))
+	if (success)
 	{
-		sock->can_receive = 1;
-		return true;
+		metrics_add(Metric_Counter::Net_Packets_Sent, num_packets);
+		metrics_add(Metric_Counter::Net_Bytes_Sent, num_bytes);
 	}
+	else
+	{
+		metrics_add(Metric_Counter::Net_Send_Errors);
+	}
+}
 
-	return false;
+static void socket_count_received(Packet_View* views, uint32 num_views)
+{
+	if (num_views)
+	{
+		uint64 num_bytes = 0;
+		for (uint32 i = 0; i < num_views; ++i)
+		{
+			num_bytes += views[i].size;
+		}
+		metrics_add(Metric_Counter::Net_Packets_Received, num_views);
+		metrics_add(Metric_Counter::Net_Bytes_Received, num_bytes);
+	}
 }
 
 bool32 socket_send(Socket* sock, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint)
 {
-	if (packet_buffer_is_full(&sock->send_buffer))
+	if (sock->link && sock->link->is_enabled)
 	{
-		log("packet send buffer is full");
-		uint8* pending_packet;
-		uint32 pending_packet_size;
-		IP_Endpoint pending_packet_destination;
-		packet_buffer_force_pop(&sock->send_buffer, &pending_packet, &pending_packet_size, &pending_packet_destination);
-		Internal::socket_send(&sock->sock, pending_packet, pending_packet_size, &pending_packet_destination);
+		link_queue_send(sock->link, &sock->link->send_queue, packet, packet_size, endpoint, clock_now());
+		socket_count_sent(true, 1, packet_size);
+		return true;
 	}
-	packet_buffer_push(&sock->send_buffer, packet, packet_size, endpoint, sock->fake_lag_s);
 
-	return true;
+	bool32 success = raw_socket_send(sock, packet, packet_size, endpoint);
+	socket_count_sent(success, 1, packet_size);
+	return success;
+}
+
+bool32 socket_send_batch(	Socket* sock, 
+							uint8* packets, uint32 packet_stride, uint32* packet_sizes, 
+							IP_Endpoint* endpoints, uint32 num_packets)
+{
+	if (sock->link && sock->link->is_enabled)
+	{
+		// each packet gets its own delay, so they're queued individually
+		int64 now = clock_now();
+		uint64 num_bytes = 0;
+		for (uint32 i = 0; i < num_packets; ++i)
+		{
+			link_queue_send(sock->link, &sock->link->send_queue, &packets[i * packet_stride], packet_sizes[i], &endpoints[i], now);
+			num_bytes += packet_sizes[i];
+		}
+		socket_count_sent(true, num_packets, num_bytes);
+		return true;
+	}
+
+	bool32 success = raw_socket_send_batch(sock, packets, packet_stride, packet_sizes, endpoints, num_packets);
+	uint64 num_bytes = 0;
+	for (uint32 i = 0; i < num_packets; ++i)
+	{
+		num_bytes += packet_sizes[i];
+	}
+	socket_count_sent(success, num_packets, num_bytes);
+	return success;
 }
 
 bool32 socket_receive(Socket* sock, uint8* buffer, uint32 buffer_size, uint32* out_packet_size, IP_Endpoint* out_from)
 {
-	// when the calling code is checking for received packets each tick, 
-	// use this to do a quick update of any packets that need sending
-	uint32 packet_size;
-	IP_Endpoint endpoint;
-	uint8* packet;
-	while (sock->send_buffer.size &&
-			packet_buffer_pop(&sock->send_buffer, &packet, &packet_size, &endpoint))
+	if (sock->link)
 	{
-		bool32 success = Internal::socket_send(&sock->sock, packet, packet_size, &endpoint);
-		assert(success);
-		sock->can_receive = 1;
+		// when the calling code is checking for received packets each tick, 
+		// use this to do a quick update of any packets that need sending
+		link_update(sock);
+
+		// packets already queued are still delivered after emulation is turned off
+		Link_Packet packet;
+		if (link_queue_pop(&sock->link->recv_queue, clock_now(), &packet))
+		{
+			uint32 packet_size = packet.size < buffer_size ? packet.size : buffer_size;
+			memcpy(buffer, packet.data, packet_size);
+			*out_packet_size = packet_size;
+			*out_from = packet.endpoint;
+			link_queue_free_buffer(&sock->link->recv_queue, packet.data);
+			metrics_add(Metric_Counter::Net_Packets_Received);
+			metrics_add(Metric_Counter::Net_Bytes_Received, packet_size);
+			return true;
+		}
+
+		if (sock->link->is_enabled)
+		{
+			return false;
+		}
 	}
 
 	if (!sock->can_receive)
@@ -345,36 +1299,203 @@ bool32 socket_receive(Socket* sock, uint8* buffer, uint32 buffer_size, uint32* o
 		return false;
 	}
 
-	if (packet_buffer_is_full(&sock->recv_buffer))
+	if (!raw_socket_receive(sock, buffer, buffer_size, out_packet_size, out_from))
 	{
-		log("packet recv buffer is full");
+		return false;
 	}
+	metrics_add(Metric_Counter::Net_Packets_Received);
+	metrics_add(Metric_Counter::Net_Bytes_Received, *out_packet_size);
+	return true;
+}
 
-	while (!packet_buffer_is_full(&sock->recv_buffer) &&
-			Internal::socket_receive(&sock->sock, buffer, buffer_size, &packet_size, &endpoint))
+uint32 socket_receive_views(Socket* sock, Packet_View* out_views, uint32 max_views)
+{
+	Receive_Ring* ring = sock->receive_ring;
+	uint32 num_free = c_receive_ring_capacity - (ring->head - ring->tail);
+	if (max_views > num_free)
 	{
-		packet_buffer_push(&sock->recv_buffer, buffer, packet_size, &endpoint, sock->fake_lag_s);
+		max_views = num_free;
 	}
 
-	if (sock->recv_buffer.size &&
-		packet_buffer_pop(&sock->recv_buffer, &packet, out_packet_size, out_from))
+	uint32 num_received = 0;
+
+	if (sock->link)
 	{
-		memcpy(buffer, packet, *out_packet_size);
-		return true;
+		link_update(sock);
+
+		// hand out the link emulator's own buffers, they go back to it on release
+		int64 now = clock_now();
+		Link_Packet packet;
+		while (num_received < max_views && link_queue_pop(&sock->link->recv_queue, now, &packet))
+		{
+			ring->link_buffers[ring->head & c_receive_ring_mask] = packet.data;
+			ring->uring_buffer_ids[ring->head & c_receive_ring_mask] = c_no_uring_buffer;
+			++ring->head;
+
+			Packet_View* view = &out_views[num_received];
+			view->data = packet.data;
+			view->size = packet.size;
+			view->from = packet.endpoint;
+			++num_received;
+		}
+
+		if (sock->link->is_enabled)
+		{
+			socket_count_received(out_views, num_received);
+			return num_received;
+		}
 	}
-	return false;
+
+	if (!sock->can_receive)
+	{
+		socket_count_received(out_views, num_received);
+		return num_received;
+	}
+
+#ifdef __linux__
+	if (sock->uring)
+	{
+		// views point straight at the kernel's provided buffers, which go back to it on release
+		Packet_View* view = &out_views[num_received];
+		uint32 buffer_id;
+		while (num_received < max_views && uring_receive(sock->uring, &view->data, &view->size, &view->from, &buffer_id))
+		{
+			ring->link_buffers[ring->head & c_receive_ring_mask] = 0;
+			ring->uring_buffer_ids[ring->head & c_receive_ring_mask] = buffer_id;
+			++ring->head;
+			++num_received;
+			view = &out_views[num_received];
+		}
+
+		socket_count_received(out_views, num_received);
+		return num_received;
+	}
+#endif // #ifdef __linux__
+
+	// receive straight into the free slots, which is two runs when they wrap around the end of the ring
+	while (num_received < max_views)
+	{
+		uint32 index = ring->head & c_receive_ring_mask;
+		uint32 num_contiguous = c_receive_ring_capacity - index;
+		uint32 num_wanted = max_views - num_received;
+		if (num_wanted > num_contiguous)
+		{
+			num_wanted = num_contiguous;
+		}
+
+		uint32 num_batch_received = raw_socket_receive_batch(	sock, 
+																&ring->buffers[index * c_packet_budget_per_tick], c_packet_budget_per_tick, num_wanted, 
+																&ring->sizes[index], &ring->froms[index]);
+		for (uint32 i = 0; i < num_batch_received; ++i)
+		{
+			ring->link_buffers[index + i] = 0;
+			ring->uring_buffer_ids[index + i] = c_no_uring_buffer;
+
+			Packet_View* view = &out_views[num_received + i];
+			view->data = &ring->buffers[(index + i) * c_packet_budget_per_tick];
+			view->size = ring->sizes[index + i];
+			view->from = ring->froms[index + i];
+		}
+		ring->head += num_batch_received;
+		num_received += num_batch_received;
+
+		if (num_batch_received < num_wanted)
+		{
+			break;
+		}
+	}
+
+	socket_count_received(out_views, num_received);
+	return num_received;
+}
+
+void socket_release_views(Socket* sock, uint32 num_views)
+{
+	Receive_Ring* ring = sock->receive_ring;
+	assert(num_views <= ring->head - ring->tail);
+
+	for (uint32 i = 0; i < num_views; ++i)
+	{
+		uint32 index = ring->tail & c_receive_ring_mask;
+		if (ring->link_buffers[index])
+		{
+			link_queue_free_buffer(&sock->link->recv_queue, ring->link_buffers[index]);
+		}
+#ifdef __linux__
+		else if (ring->uring_buffer_ids[index] != c_no_uring_buffer)
+		{
+			uring_release_buffer(sock->uring, ring->uring_buffer_ids[index]);
+		}
+#endif // #ifdef __linux__
+		++ring->tail;
+	}
+}
+
+SOCKET socket_wait_handle(Socket* sock)
+{
+	// queued in process/emulated packets don't wake anything up
+	if (sock->type == Socket_Type::In_Process || sock->link)
+	{
+		return INVALID_SOCKET;
+	}
+
+#ifdef __linux__
+	if (sock->uring)
+	{
+		return uring_wait_handle(sock->uring);
+	}
+#endif // #ifdef __linux__
+
+	return sock->handle;
 }
 
-void socket_set_fake_lag_s(	Socket* sock, 
-							float32 fake_lag_s, 
-							Linear_Allocator* allocator)
+bool32 socket_wait(Socket* sock, uint32 timeout_ms)
 {
-	sock->fake_lag_s = fake_lag_s;
-	sock->send_buffer = packet_buffer(allocator);
-	sock->recv_buffer = packet_buffer(allocator);
+	SOCKET handle = socket_wait_handle(sock);
+	if (handle == INVALID_SOCKET)
+	{
+		return true;
+	}
+
+#ifdef __linux__
+	pollfd poll_fd = {};
+	poll_fd.fd = handle;
+	poll_fd.events = POLLIN;
+	return poll(&poll_fd, 1, (int)timeout_ms) > 0;
+#else
+	WSAPOLLFD poll_fd = {};
+	poll_fd.fd = handle;
+	poll_fd.events = POLLRDNORM;
+	return WSAPoll(&poll_fd, 1, (INT)timeout_ms) > 0;
+#endif // #ifdef __linux__
 }
 
-#endif // #ifdef FAKE_LAG
+void socket_set_link_profile(	Socket* sock, 
+								Link_Profile* send_profile, 
+								Link_Profile* recv_profile, 
+								uint64 seed,
+								Linear_Allocator* allocator)
+{
+	if (!sock->link)
+	{
+		if (!send_profile && !recv_profile)
+		{
+			return;
+		}
+
+		sock->link = (Link_Emulator*)linear_allocator_alloc(allocator, sizeof(Link_Emulator));
+		*sock->link = {};
+		sock->link->clock_frequency = ::clock_frequency();
+		link_queue_create(&sock->link->send_queue, allocator);
+		link_queue_create(&sock->link->recv_queue, allocator);
+	}
+
+	Link_Emulator* link = sock->link;
+	link->is_enabled = send_profile || recv_profile;
+	link->send_queue.profile = send_profile ? *send_profile : Link_Profile{};
+	link->recv_queue.profile = recv_profile ? *recv_profile : Link_Profile{};
+	link->random_state = seed ? seed : 1; // xorshift gets stuck on 0
+}
 
 
 } // namespace Net
\ No newline at end of file
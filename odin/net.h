@@ -2,6 +2,19 @@
 
 #include "core.h"
 
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// the winsock names, so the rest of Net reads the same on both
+typedef int SOCKET;
+typedef sockaddr SOCKADDR;
+typedef sockaddr_in SOCKADDR_IN;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+#endif // #ifdef __linux__
+
 
 namespace Net
 {
@@ -20,56 +33,113 @@ bool32		ip_endpoint_equals(IP_Endpoint* a, IP_Endpoint* b);
 SOCKADDR_IN ip_endpoint_to_sockaddr_in(IP_Endpoint* ip_endpoint);
 void		ip_endpoint_to_str(char* out_str, size_t out_str_size, IP_Endpoint* ip_endpoint);
 
+// open addressed (linear probing) hash map from endpoint to a value, e.g. a client slot,
+// 0.0.0.0:0 can't be used as a key because it marks an empty entry
+constexpr uint32 c_endpoint_map_not_found = (uint32)-1;
 
-#ifdef FAKE_LAG
-// when using fake lag, put normal socket in this namespace so the socket with
-// fake lag can use them while implementing the same interface
-namespace Internal
+struct Endpoint_Map
 {
-#endif // #ifdef FAKE_LAG
+	IP_Endpoint* keys;
+	uint32* values;
+	uint32 mask; // capacity - 1, capacity is a power of 2 at least twice max_entries
+	uint32 count;
+};
+void	endpoint_map_create(Endpoint_Map* map, uint32 max_entries, Linear_Allocator* allocator);
+uint32	endpoint_map_get(Endpoint_Map* map, IP_Endpoint* key); // c_endpoint_map_not_found if not there
+void	endpoint_map_set(Endpoint_Map* map, IP_Endpoint* key, uint32 value);
+void	endpoint_map_remove(Endpoint_Map* map, IP_Endpoint* key);
 
-	struct Socket
-	{
-		SOCKET handle;
-	};
 
-#ifdef FAKE_LAG
-} // namespace Internal
+enum class Socket_Type : uint8
+{
+	Udp,		// a real socket
+	Io_Uring,	// a real socket driven through io_uring, where the kernel supports it (linux 6.0+), otherwise Udp
+	In_Process	// lock-free in memory queues between sockets in this process, for listen servers and tests
+};
+
+struct In_Process_Queue;
 
 
-struct Packet_Buffer
+// one direction of an emulated network link
+struct Link_Profile
 {
-	uint32 index;
-	uint32 size;
-	uint8* packets;
-	uint32* packet_sizes;
-	IP_Endpoint* endpoints;
-	LARGE_INTEGER* times;
+	float32 latency_s;				// fixed delay added to every packet
+	float32 jitter_s;				// plus a random delay in [0, jitter_s], which can reorder packets
+	float32 loss;					// chance in [0, 1] a packet is dropped
+	float32 duplicate;				// chance in [0, 1] a packet is delivered twice
+	float32 reorder;				// chance in [0, 1] a packet is held back an extra reorder_delay_s
+	float32 reorder_delay_s;
+	uint32 bandwidth_bytes_per_s;	// 0 for unlimited
 };
 
-// todo(jbr) jitter simulation
-// packet loss simulation
-// out of order delivery simulation
-// duplication simulation
+constexpr uint32 c_receive_ring_capacity = 64;
+
+struct Link_Emulator;
+struct Receive_Ring;
+struct Uring;
+
 struct Socket
 {
-	Internal::Socket sock;
-	float32 fake_lag_s;
-	Packet_Buffer send_buffer;
-	Packet_Buffer recv_buffer;
-	bool32 can_receive;
+	Socket_Type type;
+	SOCKET handle;
+	bool32 supports_udp_segment; // kernel can split one large send into equal sized datagrams (UDP GSO), set once by socket()
+	bool32 can_receive; // bound, or has sent and so been given a port, only written when it first becomes true
+	bool32 is_send_only; // made by socket_send_only, sharing another socket's handle
+	In_Process_Queue* in_process_queue; // packets sent to this socket's port
+	uint16 in_process_port; // 0 until bound, or given an ephemeral port on first send
+	Link_Emulator* link; // 0 unless link emulation has been turned on
+	Receive_Ring* receive_ring; // where packets handed out as views live until released
+	Uring* uring; // 0 unless type is Io_Uring
 };
 
-#endif // #ifdef FAKE_LAG
+// a received packet still in the socket's receive ring, read only
+struct Packet_View
+{
+	uint8* data;
+	uint32 size;
+	IP_Endpoint from;
+};
 
-bool32 socket(Socket* out_socket);
+// the socket's buffers and queues come from allocator, and stay there after it's closed
+bool32 socket(Socket* out_socket, Socket_Type type, Linear_Allocator* allocator);
+// the most socket() will take from its allocator
+uint64 socket_memory_size(Socket_Type type);
 void socket_close(Socket* sock);
+// a socket which sends from sock's port with plain sendto/sendmmsg, so from any thread even when sock is
+// driven by io_uring, without joining sock's reuseport group. It can't receive, and must be closed before 
+// sock, which closing it leaves open
+void socket_send_only(Socket* out_socket, Socket* sock);
 bool32 socket_bind(Socket* sock, IP_Endpoint* local_endpoint);
+// before binding, lets several sockets bind the same port and share its packets (linux only)
+bool32 socket_set_reuse_port(Socket* sock);
+// after binding, pins each remote endpoint to one of the first num_shards sockets bound to the 
+// port (in bind order), call on any socket in the group, sockets bound after never receive
+bool32 socket_set_reuse_port_steering(Socket* sock, uint32 num_shards);
 bool32 socket_send(Socket* sock, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint);
+// packets is num_packets contiguous buffers of packet_stride bytes each, returns false if any failed to send
+bool32 socket_send_batch(	Socket* sock, 
+							uint8* packets, uint32 packet_stride, uint32* packet_sizes, 
+							IP_Endpoint* endpoints, uint32 num_packets);
 bool32 socket_receive(Socket* sock, uint8* buffer, uint32 buffer_size, uint32* out_packet_size, IP_Endpoint* out_from);
-void socket_set_fake_lag_s(	Socket* sock, 
-							float32 fake_lag_s, 
-							Linear_Allocator* allocator);
+// receives up to max_views packets without copying them, returns the number received, the views 
+// stay valid until released, and the ring only has room for c_receive_ring_capacity at once
+uint32 socket_receive_views(Socket* sock, Packet_View* out_views, uint32 max_views);
+// releases the oldest num_views views still held
+void socket_release_views(Socket* sock, uint32 num_views);
+// something to poll/epoll on which becomes readable when packets arrive, or INVALID_SOCKET if 
+// there isn't one (in process sockets, link emulation)
+SOCKET socket_wait_handle(Socket* sock);
+// waits up to timeout_ms for a packet to arrive, returns true if there might be one, 
+// returns straight away if there's no wait handle
+bool32 socket_wait(Socket* sock, uint32 timeout_ms);
+// turns on link emulation for each direction (0 for no emulation in that direction, 0 for both 
+// turns it off), the seed makes the emulated losses/delays reproducible, allocator is only used 
+// the first time emulation is turned on for this socket
+void socket_set_link_profile(	Socket* sock, 
+								Link_Profile* send_profile, 
+								Link_Profile* recv_profile, 
+								uint64 seed,
+								Linear_Allocator* allocator);
 
 
 } // namespace Net
\ No newline at end of file
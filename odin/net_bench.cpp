@@ -0,0 +1,672 @@
+#include "cli_args.h"
+#include "core.h"
+#include "metrics.h"
+#include "net.h"
+#include "packet_ring.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+
+
+// micro benchmarks of the net layer's hot paths, each run on its own so they can be compared
+// against each other and across changes. Timings are wall clock over loopback or in memory, so
+// run them on a quiet machine and compare runs from the same one
+
+
+constexpr uint16 c_net_bench_port				= 19999;
+constexpr uint32 c_net_bench_max_batch			= 64;
+constexpr uint32 c_net_bench_max_clients		= 1024;
+
+struct Net_Bench_Config
+{
+	uint32 num_rounds;
+	uint32 packet_size;
+	uint32 num_clients;
+};
+
+static void print_usage(const char* program_name)
+{
+	fprintf(stderr,
+		"usage: %s <benchmark> [options]\n"
+		"  receive                  packets/s received over loopback, one recvfrom each vs recvmmsg batches\n"
+		"  send                     a tick's state broadcast over loopback, one sendto each vs sendmmsg batches\n"
+		"  ring                     queueing packets in the link emulator, full size slots vs a packed byte ring\n"
+		"  endpoints                finding a sender's slot and a free slot for a join, linear scans vs Endpoint_Map and\n"
+		"                           a free slot stack, at 32, 1024 and 10240 connections\n"
+		"options\n"
+		"  --rounds <n>             how many times (or ticks) each case runs (default 2000)\n"
+		"  --size <bytes>           packet size, up to %u (default 16 for receive, about an input, 128 for send,\n"
+		"                           13 and 376 for ring, an input and a full 32 player state)\n"
+		"  --clients <n>            clients the broadcast goes to, up to %u (default 32)\n",
+		program_name, c_packet_budget_per_tick, c_net_bench_max_clients);
+}
+
+static float64 clock_ticks_to_s(int64 clock_ticks)
+{
+	return (float64)clock_ticks / clock_frequency();
+}
+
+// cpu time, which for loopback includes delivering the packet to the receiving socket
+static int64 thread_cpu_time_ns()
+{
+	timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return ((int64)now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+static uint64 metrics_counter_read(Metric_Counter counter)
+{
+	return g_metrics->counters[(uint32)counter].value.load(std::memory_order_relaxed);
+}
+
+// xorshift64, so every run picks the same sequence
+static uint32 bench_random(uint64* random_state)
+{
+	uint64 x = *random_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*random_state = x;
+	return (uint32)((x * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+
+// each round a sender fills the receiver's kernel buffer with c_receive_bench_burst packets, then only
+// the time taken to drain it is counted, so the sender doesn't compete for the cpu while it's measured
+constexpr uint32 c_receive_bench_burst = 256;
+
+enum class Receive_Bench_Path : uint8
+{
+	Single,	// socket_receive, one recvfrom per packet (and one more to find there are no more)
+	Batch	// socket_receive_views, recvmmsg batches, or with io_uring reading completions the kernel
+			// has already copied into provided buffers as the packets arrived, so that copy isn't timed,
+			// and then one io_uring_enter to find there are no more
+};
+
+static bool32 receive_bench_case(Net_Bench_Config* config, Net::Socket_Type socket_type, Receive_Bench_Path path, const char* name, Linear_Allocator* allocator)
+{
+	Net::Socket receiver;
+	Net::Socket sender;
+	if (!Net::socket(&receiver, socket_type, allocator) || !Net::socket(&sender, Net::Socket_Type::Udp, allocator))
+	{
+		return false;
+	}
+	Net::IP_Endpoint receiver_endpoint = Net::ip_endpoint(127, 0, 0, 1, c_net_bench_port);
+	if (!Net::socket_bind(&receiver, &receiver_endpoint))
+	{
+		return false;
+	}
+
+	uint8* packets = linear_allocator_alloc(allocator, c_receive_bench_burst * config->packet_size);
+	uint32* packet_sizes = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * c_receive_bench_burst);
+	Net::IP_Endpoint* endpoints = (Net::IP_Endpoint*)linear_allocator_alloc(allocator, sizeof(Net::IP_Endpoint) * c_receive_bench_burst);
+	memset(packets, 0x5a, c_receive_bench_burst * config->packet_size);
+	for (uint32 i = 0; i < c_receive_bench_burst; ++i)
+	{
+		packet_sizes[i] = config->packet_size;
+		endpoints[i] = receiver_endpoint;
+	}
+
+	uint8 buffer[c_packet_budget_per_tick];
+	Net::Packet_View views[c_net_bench_max_batch];
+	uint64 num_received = 0;
+	uint64 num_sent = 0;
+	int64 receive_time = 0;
+	uint64 num_syscalls = 0;
+	for (uint32 round = 0; round < config->num_rounds; ++round)
+	{
+		Net::socket_send_batch(&sender, packets, config->packet_size, packet_sizes, endpoints, c_receive_bench_burst);
+		num_sent += c_receive_bench_burst;
+
+		uint64 syscalls_start = metrics_counter_read(Metric_Counter::Net_Receive_Syscalls);
+		int64 start = clock_now();
+		if (path == Receive_Bench_Path::Single)
+		{
+			uint32 packet_size;
+			Net::IP_Endpoint from;
+			while (Net::socket_receive(&receiver, buffer, sizeof(buffer), &packet_size, &from))
+			{
+				++num_received;
+			}
+		}
+		else
+		{
+			uint32 num_views;
+			while ((num_views = Net::socket_receive_views(&receiver, views, c_net_bench_max_batch)) > 0)
+			{
+				Net::socket_release_views(&receiver, num_views);
+				num_received += num_views;
+			}
+		}
+		receive_time += clock_now() - start;
+		num_syscalls += metrics_counter_read(Metric_Counter::Net_Receive_Syscalls) - syscalls_start;
+	}
+
+	float64 receive_s = clock_ticks_to_s(receive_time);
+	char syscalls_per_packet[32] = "-"; // not counted for io_uring
+	if (socket_type != Net::Socket_Type::Io_Uring)
+	{
+		snprintf(syscalls_per_packet, sizeof(syscalls_per_packet), "%.3f", (float64)num_syscalls / num_received);
+	}
+	printf("  %-32s %12.0f %12.1f %16s %11.1f%%\n",
+		name,
+		num_received / receive_s,
+		receive_s * 1000000000.0 / num_received,
+		syscalls_per_packet,
+		num_sent > num_received ? 100.0 * (num_sent - num_received) / num_sent : 0.0);
+
+	Net::socket_close(&sender);
+	Net::socket_close(&receiver);
+	return true;
+}
+
+static bool32 receive_bench(Net_Bench_Config* config)
+{
+	Linear_Allocator allocator;
+	linear_allocator_create(&allocator, megabytes(8));
+
+	printf("receiving %u x %u byte packets over loopback, in bursts of %u\n\n", config->num_rounds * c_receive_bench_burst, config->packet_size, c_receive_bench_burst);
+	printf("  %-32s %12s %12s %16s %12s\n", "", "packets/s", "ns/packet", "syscalls/packet", "dropped");
+	return	receive_bench_case(config, Net::Socket_Type::Udp, Receive_Bench_Path::Single, "udp, socket_receive", &allocator) &&
+			receive_bench_case(config, Net::Socket_Type::Udp, Receive_Bench_Path::Batch, "udp, socket_receive_views", &allocator) &&
+			receive_bench_case(config, Net::Socket_Type::Io_Uring, Receive_Bench_Path::Batch, "io_uring, socket_receive_views", &allocator);
+}
+
+
+// each tick the server sends every client packets_per_client packets, as server_main's broadcast does,
+// the clients drain their sockets between ticks, untimed
+enum class Send_Bench_Path : uint8
+{
+	Single,	// socket_send per packet, one sendto each
+	Batch	// socket_send_batch, sendmmsg batches with runs to the same client as one UDP GSO message, or one io_uring submit
+};
+
+static bool32 send_bench_case(	Net_Bench_Config* config, 
+								Net::Socket_Type socket_type, Send_Bench_Path path, uint32 packets_per_client, 
+								const char* name, Linear_Allocator* allocator)
+{
+	Net::Socket server;
+	if (!Net::socket(&server, socket_type, allocator))
+	{
+		return false;
+	}
+	Net::IP_Endpoint server_endpoint = Net::ip_endpoint(127, 0, 0, 1, c_net_bench_port);
+	if (!Net::socket_bind(&server, &server_endpoint))
+	{
+		return false;
+	}
+
+	Net::Socket* clients = (Net::Socket*)linear_allocator_alloc(allocator, sizeof(Net::Socket) * config->num_clients);
+	for (uint32 i = 0; i < config->num_clients; ++i)
+	{
+		Net::IP_Endpoint client_endpoint = Net::ip_endpoint(127, 0, 0, 1, (uint16)(c_net_bench_port + 1 + i));
+		if (!Net::socket(&clients[i], Net::Socket_Type::Udp, allocator) || !Net::socket_bind(&clients[i], &client_endpoint))
+		{
+			return false;
+		}
+	}
+
+	uint32 num_packets = config->num_clients * packets_per_client;
+	uint8* packets = linear_allocator_alloc(allocator, num_packets * config->packet_size);
+	uint32* packet_sizes = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * num_packets);
+	Net::IP_Endpoint* endpoints = (Net::IP_Endpoint*)linear_allocator_alloc(allocator, sizeof(Net::IP_Endpoint) * num_packets);
+	memset(packets, 0x5a, num_packets * config->packet_size);
+	for (uint32 i = 0; i < num_packets; ++i)
+	{
+		packet_sizes[i] = config->packet_size;
+		endpoints[i] = Net::ip_endpoint(127, 0, 0, 1, (uint16)(c_net_bench_port + 1 + (i / packets_per_client)));
+	}
+
+	Net::Packet_View views[c_net_bench_max_batch];
+	uint64 num_received = 0;
+	int64 send_time = 0;
+	int64 send_cpu_ns = 0;
+	uint64 num_syscalls = 0;
+	for (uint32 tick = 0; tick < config->num_rounds; ++tick)
+	{
+		uint64 syscalls_start = metrics_counter_read(Metric_Counter::Net_Send_Syscalls);
+		int64 cpu_start = thread_cpu_time_ns();
+		int64 start = clock_now();
+		if (path == Send_Bench_Path::Single)
+		{
+			for (uint32 i = 0; i < num_packets; ++i)
+			{
+				Net::socket_send(&server, &packets[i * config->packet_size], packet_sizes[i], &endpoints[i]);
+			}
+		}
+		else
+		{
+			Net::socket_send_batch(&server, packets, config->packet_size, packet_sizes, endpoints, num_packets);
+		}
+		send_time += clock_now() - start;
+		send_cpu_ns += thread_cpu_time_ns() - cpu_start;
+		num_syscalls += metrics_counter_read(Metric_Counter::Net_Send_Syscalls) - syscalls_start;
+
+		for (uint32 i = 0; i < config->num_clients; ++i)
+		{
+			uint32 num_views;
+			while ((num_views = Net::socket_receive_views(&clients[i], views, c_net_bench_max_batch)) > 0)
+			{
+				Net::socket_release_views(&clients[i], num_views);
+				num_received += num_views;
+			}
+		}
+	}
+
+	char syscalls_per_tick[32] = "-"; // not counted for io_uring
+	if (socket_type != Net::Socket_Type::Io_Uring)
+	{
+		snprintf(syscalls_per_tick, sizeof(syscalls_per_tick), "%.1f", (float64)num_syscalls / config->num_rounds);
+	}
+	uint64 num_sent = (uint64)num_packets * config->num_rounds;
+	printf("  %-44s %14s %12.1f %12.1f %11.1f%%\n",
+		name,
+		syscalls_per_tick,
+		clock_ticks_to_s(send_time) * 1000000.0 / config->num_rounds,
+		send_cpu_ns / 1000.0 / config->num_rounds,
+		num_sent > num_received ? 100.0 * (num_sent - num_received) / num_sent : 0.0);
+
+	for (uint32 i = 0; i < config->num_clients; ++i)
+	{
+		Net::socket_close(&clients[i]);
+	}
+	Net::socket_close(&server);
+	return true;
+}
+
+static bool32 send_bench(Net_Bench_Config* config)
+{
+	// nothing is freed between cases, so there's room for all of them
+	constexpr uint32 c_send_bench_cases = 5;
+	constexpr uint32 c_send_bench_max_packets_per_client = 2;
+	uint64 packets_size = (uint64)config->num_clients * c_send_bench_max_packets_per_client * (config->packet_size + sizeof(uint32) + sizeof(Net::IP_Endpoint));
+	uint64 case_size =	Net::socket_memory_size(Net::Socket_Type::Io_Uring) + 
+						(config->num_clients * (sizeof(Net::Socket) + Net::socket_memory_size(Net::Socket_Type::Udp))) + 
+						packets_size;
+	Linear_Allocator allocator;
+	linear_allocator_create(&allocator, case_size * c_send_bench_cases);
+
+	printf("broadcasting %u byte packets to %u clients over loopback, %u ticks\n\n", config->packet_size, config->num_clients, config->num_rounds);
+	printf("  %-44s %14s %12s %12s %12s\n", "", "syscalls/tick", "us/tick", "cpu us/tick", "dropped");
+	return	send_bench_case(config, Net::Socket_Type::Udp, Send_Bench_Path::Single, 1, "udp, socket_send", &allocator) &&
+			send_bench_case(config, Net::Socket_Type::Udp, Send_Bench_Path::Batch, 1, "udp, socket_send_batch", &allocator) &&
+			send_bench_case(config, Net::Socket_Type::Udp, Send_Bench_Path::Single, 2, "udp, socket_send, 2 per client", &allocator) &&
+			send_bench_case(config, Net::Socket_Type::Udp, Send_Bench_Path::Batch, 2, "udp, socket_send_batch, 2 per client (gso)", &allocator) &&
+			send_bench_case(config, Net::Socket_Type::Io_Uring, Send_Bench_Path::Batch, 1, "io_uring, socket_send_batch", &allocator);
+}
+
+// the link emulator's two ways of holding queued packets, the old one, a free list of full size
+// slots, and a Packet_Ring. c_ring_bench_in_flight packets are kept queued, and each one queued 
+// pushes out one of the oldest few, as jitter would, each packet is written in and read back out
+constexpr uint32 c_ring_bench_slots				= 512; // as the link emulator had
+constexpr uint32 c_ring_bench_ring_capacity		= kilobytes(64); // as the link emulator has
+constexpr uint32 c_ring_bench_in_flight			= 128;
+constexpr uint32 c_ring_bench_reorder_window	= 8;
+
+enum class Ring_Bench_Layout : uint8
+{
+	Slots,
+	Ring
+};
+
+struct Slot_Pool
+{
+	uint8** free_slots;
+	uint32 num_free;
+};
+
+static volatile uint32 s_ring_bench_sink; // so reading packets back out isn't optimised away
+
+static bool32 ring_bench_case(Net_Bench_Config* config, Ring_Bench_Layout layout, uint32 packet_size, const char* name, Linear_Allocator* allocator)
+{
+	Slot_Pool pool = {};
+	Packet_Ring ring = {};
+	uint64 reserved_size;
+	if (layout == Ring_Bench_Layout::Slots)
+	{
+		pool.free_slots = (uint8**)linear_allocator_alloc(allocator, sizeof(uint8*) * c_ring_bench_slots);
+		uint8* slots = linear_allocator_alloc(allocator, c_ring_bench_slots * c_packet_budget_per_tick);
+		for (uint32 i = 0; i < c_ring_bench_slots; ++i)
+		{
+			pool.free_slots[i] = &slots[i * c_packet_budget_per_tick];
+		}
+		pool.num_free = c_ring_bench_slots;
+		reserved_size = c_ring_bench_slots * c_packet_budget_per_tick;
+	}
+	else
+	{
+		packet_ring_create(&ring, c_ring_bench_ring_capacity, allocator);
+		reserved_size = c_ring_bench_ring_capacity;
+	}
+
+	uint8 packet[c_packet_budget_per_tick];
+	uint8 buffer[c_packet_budget_per_tick];
+	memset(packet, 0x5a, packet_size);
+	uint8* in_flight[c_ring_bench_in_flight];
+	uint32 in_flight_head = 0;
+	uint32 num_in_flight = 0;
+	uint64 random_state = 0x9e3779b97f4a7c15ull;
+	uint64 num_packets = (uint64)config->num_rounds * c_ring_bench_in_flight;
+	uint32 num_to_leave_in_order = 0;
+	bool32 was_full = false;
+	uint64 num_full = 0;
+	uint64 peak_in_use = 0;
+	uint32 sink = 0;
+
+	int64 start = clock_now();
+	for (uint64 i = 0; i < num_packets; ++i)
+	{
+		if (num_in_flight == c_ring_bench_in_flight || was_full)
+		{
+			// the next few to leave go in a random order, so none leave more than c_ring_bench_reorder_window late
+			if (!num_to_leave_in_order)
+			{
+				uint32 num_reordered = num_in_flight < c_ring_bench_reorder_window ? num_in_flight : c_ring_bench_reorder_window;
+				for (uint32 j = num_reordered - 1; j > 0; --j)
+				{
+					uint32 a = (in_flight_head + j) % c_ring_bench_in_flight;
+					uint32 b = (in_flight_head + (bench_random(&random_state) % (j + 1))) % c_ring_bench_in_flight;
+					uint8* temp = in_flight[a];
+					in_flight[a] = in_flight[b];
+					in_flight[b] = temp;
+				}
+				num_to_leave_in_order = num_reordered;
+			}
+
+			uint8* data = in_flight[in_flight_head];
+			in_flight_head = (in_flight_head + 1) % c_ring_bench_in_flight;
+			--num_in_flight;
+			--num_to_leave_in_order;
+
+			memcpy(buffer, data, packet_size);
+			sink += buffer[packet_size - 1];
+			if (layout == Ring_Bench_Layout::Slots)
+			{
+				pool.free_slots[pool.num_free] = data;
+				++pool.num_free;
+			}
+			else
+			{
+				packet_ring_free(&ring, data);
+			}
+		}
+
+		uint8* data = 0;
+		if (layout == Ring_Bench_Layout::Slots)
+		{
+			if (pool.num_free)
+			{
+				--pool.num_free;
+				data = pool.free_slots[pool.num_free];
+			}
+		}
+		else
+		{
+			data = packet_ring_alloc(&ring, packet_size);
+		}
+		was_full = !data;
+		if (!data)
+		{
+			++num_full;
+			continue;
+		}
+
+		memcpy(data, packet, packet_size);
+		in_flight[(in_flight_head + num_in_flight) % c_ring_bench_in_flight] = data;
+		++num_in_flight;
+
+		uint64 in_use = layout == Ring_Bench_Layout::Slots ? (uint64)(c_ring_bench_slots - pool.num_free) * c_packet_budget_per_tick : ring.used;
+		peak_in_use = in_use > peak_in_use ? in_use : peak_in_use;
+	}
+	float64 time_s = clock_ticks_to_s(clock_now() - start);
+	s_ring_bench_sink = sink;
+
+	printf("  %-32s %12.1f %12llu %12llu %11.1f%%\n",
+		name,
+		time_s * 1000000000.0 / num_packets,
+		(unsigned long long)reserved_size,
+		(unsigned long long)peak_in_use,
+		100.0 * num_full / num_packets);
+	return true;
+}
+
+static bool32 ring_bench(Net_Bench_Config* config)
+{
+	Linear_Allocator allocator;
+	linear_allocator_create(&allocator, megabytes(8));
+
+	uint32 default_packet_sizes[] = {13, 376};
+	uint32* packet_sizes = default_packet_sizes;
+	uint32 num_packet_sizes = 2;
+	if (config->packet_size)
+	{
+		packet_sizes = &config->packet_size;
+		num_packet_sizes = 1;
+	}
+
+	printf("queueing packets with %u in flight, leaving up to %u out of order, %u rounds\n", c_ring_bench_in_flight, c_ring_bench_reorder_window, config->num_rounds);
+	for (uint32 i = 0; i < num_packet_sizes; ++i)
+	{
+		printf("\n  %-32s %12s %12s %12s %12s\n", "", "ns/packet", "reserved", "peak in use", "full");
+		char slots_name[64];
+		char ring_name[64];
+		snprintf(slots_name, sizeof(slots_name), "%u byte packets, slots", packet_sizes[i]);
+		snprintf(ring_name, sizeof(ring_name), "%u byte packets, packet ring", packet_sizes[i]);
+		if (!ring_bench_case(config, Ring_Bench_Layout::Slots, packet_sizes[i], slots_name, &allocator) ||
+			!ring_bench_case(config, Ring_Bench_Layout::Ring, packet_sizes[i], ring_name, &allocator))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// how the server finds a client's slot from the endpoint a packet came from, and a free slot for a join,
+// the old linear scans of every slot's endpoint against an Endpoint_Map and a stack of free slots. Joins 
+// are measured along with a leave to make room, the way clients come and go once the server is full
+constexpr uint32 c_endpoints_bench_ops_per_round = 64;
+
+enum class Endpoints_Bench_Path : uint8
+{
+	Scan,
+	Map
+};
+
+static Net::IP_Endpoint endpoints_bench_endpoint(uint8 a, uint32 i)
+{
+	return Net::ip_endpoint(a, (uint8)(i >> 16), (uint8)(i >> 8), (uint8)i, (uint16)(40000 + (i % 20000)));
+}
+
+static bool32 endpoints_bench_case(Net_Bench_Config* config, uint32 num_connections, Endpoints_Bench_Path path, Linear_Allocator* allocator)
+{
+	Linear_Allocator case_allocator;
+	linear_allocator_create_sub_allocator(allocator, &case_allocator, (uint64)num_connections * 64);
+
+	Net::IP_Endpoint* slot_endpoints = (Net::IP_Endpoint*)linear_allocator_alloc(&case_allocator, sizeof(Net::IP_Endpoint) * num_connections);
+	uint32* free_slots = (uint32*)linear_allocator_alloc(&case_allocator, sizeof(uint32) * num_connections);
+	uint32 num_free_slots = 0;
+	Net::Endpoint_Map map;
+	Net::endpoint_map_create(&map, num_connections, &case_allocator);
+	for (uint32 i = 0; i < num_connections; ++i)
+	{
+		slot_endpoints[i] = endpoints_bench_endpoint(10, i);
+		Net::endpoint_map_set(&map, &slot_endpoints[i], i);
+	}
+
+	uint64 num_ops = (uint64)config->num_rounds * c_endpoints_bench_ops_per_round;
+	uint64 random_state = 0x9e3779b97f4a7c15ull;
+	uint32 num_found = 0;
+
+	int64 start = clock_now();
+	for (uint64 i = 0; i < num_ops; ++i)
+	{
+		Net::IP_Endpoint from = slot_endpoints[bench_random(&random_state) % num_connections];
+		uint32 slot = Net::c_endpoint_map_not_found;
+		if (path == Endpoints_Bench_Path::Scan)
+		{
+			for (uint32 j = 0; j < num_connections; ++j)
+			{
+				if (Net::ip_endpoint_equals(&slot_endpoints[j], &from))
+				{
+					slot = j;
+					break;
+				}
+			}
+		}
+		else
+		{
+			slot = Net::endpoint_map_get(&map, &from);
+		}
+		num_found += slot != Net::c_endpoint_map_not_found;
+	}
+	float64 lookup_s = clock_ticks_to_s(clock_now() - start);
+
+	start = clock_now();
+	for (uint64 i = 0; i < num_ops; ++i)
+	{
+		// the slot is already known for a leave, it's the join which has to find one
+		uint32 leaving_slot = bench_random(&random_state) % num_connections;
+		Net::IP_Endpoint joining = endpoints_bench_endpoint(11, (uint32)i);
+		uint32 slot = Net::c_endpoint_map_not_found;
+		if (path == Endpoints_Bench_Path::Scan)
+		{
+			slot_endpoints[leaving_slot] = {};
+			for (uint32 j = 0; j < num_connections; ++j)
+			{
+				if (slot_endpoints[j].address == 0)
+				{
+					slot = j;
+					break;
+				}
+			}
+		}
+		else
+		{
+			Net::endpoint_map_remove(&map, &slot_endpoints[leaving_slot]);
+			slot_endpoints[leaving_slot] = {};
+			free_slots[num_free_slots] = leaving_slot;
+			++num_free_slots;
+
+			--num_free_slots;
+			slot = free_slots[num_free_slots];
+			Net::endpoint_map_set(&map, &joining, slot);
+		}
+		slot_endpoints[slot] = joining;
+	}
+	float64 join_s = clock_ticks_to_s(clock_now() - start);
+
+	if (num_found != num_ops)
+	{
+		fprintf(stderr, "only found %u of %llu senders\n", num_found, (unsigned long long)num_ops);
+		return false;
+	}
+
+	printf("  %-32s %12.1f %12.1f\n",
+		path == Endpoints_Bench_Path::Scan ? "linear scans" : "endpoint map, free slot stack",
+		lookup_s * 1000000000.0 / num_ops,
+		join_s * 1000000000.0 / num_ops);
+	return true;
+}
+
+static bool32 endpoints_bench(Net_Bench_Config* config)
+{
+	Linear_Allocator allocator;
+	linear_allocator_create(&allocator, megabytes(8));
+
+	uint32 connection_counts[] = {32, 1024, 10240};
+	printf("%u lookups and joins each\n", config->num_rounds * c_endpoints_bench_ops_per_round);
+	for (uint32 i = 0; i < sizeof(connection_counts) / sizeof(connection_counts[0]); ++i)
+	{
+		char connections_name[32];
+		snprintf(connections_name, sizeof(connections_name), "%u connections", connection_counts[i]);
+		printf("\n  %-32s %12s %12s\n", connections_name, "ns/lookup", "ns/join");
+		if (!endpoints_bench_case(config, connection_counts[i], Endpoints_Bench_Path::Scan, &allocator) ||
+			!endpoints_bench_case(config, connection_counts[i], Endpoints_Bench_Path::Map, &allocator))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+	const char* benchmark = argv[1];
+
+	Net_Bench_Config config = {};
+	config.num_rounds = 2000;
+	config.packet_size = 0;
+	config.num_clients = 32;
+	for (int i = 2; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		if (!strcmp(arg, "--rounds"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, 1000000, &config.num_rounds))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--size"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_packet_budget_per_tick, &config.packet_size))
+			{
+				return 1;
+			}
+		}
+		else if (!strcmp(arg, "--clients"))
+		{
+			if (!cli_args_parse_uint(argc, argv, &i, 1, c_net_bench_max_clients, &config.num_clients))
+			{
+				return 1;
+			}
+		}
+		else
+		{
+			print_usage(argv[0]);
+			return !strcmp(arg, "--help") ? 0 : 1;
+		}
+	}
+
+	if (!Net::init())
+	{
+		return 1;
+	}
+
+	bool32 success;
+	if (!strcmp(benchmark, "receive"))
+	{
+		config.packet_size = config.packet_size ? config.packet_size : 16;
+		success = receive_bench(&config);
+	}
+	else if (!strcmp(benchmark, "send"))
+	{
+		config.packet_size = config.packet_size ? config.packet_size : 128;
+		success = send_bench(&config);
+	}
+	else if (!strcmp(benchmark, "ring"))
+	{
+		success = ring_bench(&config);
+	}
+	else if (!strcmp(benchmark, "endpoints"))
+	{
+		success = endpoints_bench(&config);
+	}
+	else
+	{
+		print_usage(argv[0]);
+		return !strcmp(benchmark, "--help") ? 0 : 1;
+	}
+
+	return success ? 0 : 1;
+}
@@ -1,5 +1,7 @@
 #include "net_msgs.h"
 
+#include <math.h>
+
 #include "player.h"
 
 
@@ -9,97 +11,296 @@ namespace Net
 
 
 
-static void serialise_u8(uint8** buffer, uint8 u)
+constexpr uint32 bits_required(uint32 max_value)
+{
+	uint32 bits = 0;
+	while (max_value)
+	{
+		++bits;
+		max_value >>= 1;
+	}
+	return bits;
+}
+
+constexpr uint32 c_client_message_type_bits	= bits_required((uint32)Client_Message::Input);
+constexpr uint32 c_server_message_type_bits	= bits_required((uint32)Server_Message::State);
+constexpr uint32 c_slot_bits				= bits_required(c_max_clients - 1);
+constexpr uint32 c_tick_rate_bits			= bits_required(c_max_server_tick_rate);
+constexpr uint32 c_buttons_bits				= 5;
+
+// positions are sent as a whole number of c_position_precision steps, so 0 comes back as exactly 0 (grounded
+// players have z == 0). They're zigzag encoded and prefixed with a size class, absolute in full snapshots and
+// against the baseline in deltas, so small values and small moves take fewer bits
+constexpr int32 c_position_max_quantised	= (int32)((c_player_position_extent / c_position_precision) + 0.5f);
+constexpr uint32 c_position_class_bits		= 2;
+constexpr uint32 c_position_absolute_bits[]	= { 0, 12, 19, 24 };
+constexpr uint32 c_position_delta_bits[]	= { 6, 10, 14, 25 };
+static_assert(bits_required((uint32)c_position_max_quantised * 2) <= c_position_absolute_bits[3], "any position in the extent must fit");
+static_assert(bits_required((uint32)c_position_max_quantised * 4) <= c_position_delta_bits[3], "any move across the extent must fit");
+constexpr float32 c_velocity_min			= -c_velocity_extent;
+constexpr uint32 c_velocity_bits			= bits_required((uint32)((c_velocity_extent * 2.0f / c_velocity_precision) + 0.5f));
+constexpr uint32 c_angle_bits				= 16;
+constexpr float32 c_pitch_min				= -c_pi * 0.5f;
+constexpr float32 c_pitch_precision			= c_pi / ((1 << c_angle_bits) - 1);
+constexpr float32 c_yaw_min					= -c_pi;
+constexpr float32 c_yaw_precision			= (c_pi * 2.0f) / (1 << c_angle_bits);
+constexpr uint32 c_short_sequence_mask		= (1u << c_short_sequence_bits) - 1;
+constexpr uint32 c_baseline_offset_bits		= bits_required(c_snapshot_history_capacity - 1);
+constexpr uint32 c_fragment_bits			= bits_required(c_max_state_fragments - 1);
+static_assert(c_max_state_fragments <= 32, "fragment masks are uint32");
+
+
+struct Bit_Writer
+{
+	uint8* buffer_iter;
+	uint64 scratch;
+	uint32 scratch_bits;
+};
+
+// reads past the end return 0 and set is_overrun, so a message can be read in full and checked once at the end
+struct Bit_Reader
+{
+	uint8* buffer_iter;
+	uint8* buffer_end;
+	uint64 scratch;
+	uint32 scratch_bits;
+	bool32 is_overrun;
+};
+
+static Bit_Writer bit_writer(uint8* buffer)
+{
+	Bit_Writer writer = {};
+	writer.buffer_iter = buffer;
+	return writer;
+}
+
+static void bit_writer_write(Bit_Writer* writer, uint32 value, uint32 num_bits)
+{
+	assert(num_bits <= 32);
+	assert(num_bits == 32 || (value >> num_bits) == 0);
+
+	writer->scratch |= (uint64)value << writer->scratch_bits;
+	writer->scratch_bits += num_bits;
+
+	while (writer->scratch_bits >= 8)
+	{
+		*writer->buffer_iter = (uint8)writer->scratch;
+		++writer->buffer_iter;
+		writer->scratch >>= 8;
+		writer->scratch_bits -= 8;
+	}
+}
+
+// pads out to a byte boundary, returns the end of the written data
+static uint8* bit_writer_flush(Bit_Writer* writer)
+{
+	if (writer->scratch_bits)
+	{
+		bit_writer_write(writer, 0, 8 - writer->scratch_bits);
+	}
+
+	return writer->buffer_iter;
+}
+
+static Bit_Reader bit_reader(uint8* buffer, uint32 buffer_size)
+{
+	Bit_Reader reader = {};
+	reader.buffer_iter = buffer;
+	reader.buffer_end = buffer + buffer_size;
+	return reader;
+}
+
+static uint32 bit_reader_read(Bit_Reader* reader, uint32 num_bits)
+{
+	assert(num_bits <= 32);
+
+	while (reader->scratch_bits < num_bits)
+	{
+		if (reader->buffer_iter == reader->buffer_end)
+		{
+			reader->is_overrun = true;
+			reader->scratch = 0;
+			reader->scratch_bits = 0;
+			return 0;
+		}
+		reader->scratch |= (uint64)*reader->buffer_iter << reader->scratch_bits;
+		++reader->buffer_iter;
+		reader->scratch_bits += 8;
+	}
+
+	uint32 value = (uint32)(reader->scratch & ((1ull << num_bits) - 1));
+	reader->scratch >>= num_bits;
+	reader->scratch_bits -= num_bits;
+
+	return value;
+}
+
+// skips any padding up to the next byte boundary
+static void bit_reader_align(Bit_Reader* reader)
+{
+	reader->scratch = 0;
+	reader->scratch_bits = 0;
+}
+
+static uint32 bits_to_bytes(uint32 num_bits)
+{
+	return (num_bits + 7) / 8;
+}
+
+
+// clamped before converting to an int, so nan and huge values are still defined (nan goes to min)
+static uint32 f32_quantise(float32 f, float32 min, float32 precision, uint32 num_bits)
+{
+	float32 bias = roundf(-min / precision);
+	float32 max = (float32)((1ull << num_bits) - 1);
+	float32 q = roundf(f / precision) + bias;
+	return (uint32)(q > 0.0f ? (q < max ? q : max) : 0.0f);
+}
+
+static float32 f32_dequantise(uint32 q, float32 min, float32 precision)
+{
+	int32 bias = (int32)roundf(-min / precision);
+	return (float32)((int32)q - bias) * precision;
+}
+
+// done in float64 so every step in the extent survives float32 -> int -> float32 -> int unchanged,
+// which deltas rely on as the client quantises its decoded baseline to apply them
+static int32 position_quantise(float32 f)
+{
+	float64 q = round((float64)f / (float64)c_position_precision);
+	if (q != q)
+	{
+		return 0;
+	}
+	q = q < -c_position_max_quantised ? -c_position_max_quantised : (q > c_position_max_quantised ? c_position_max_quantised : q);
+	return (int32)q;
+}
+
+static float32 position_dequantise(int32 q)
+{
+	return (float32)((float64)q * (float64)c_position_precision);
+}
+
+static uint32 zigzag(int32 i)
+{
+	return ((uint32)i << 1) ^ (uint32)(i >> 31);
+}
+
+static int32 unzigzag(uint32 u)
+{
+	return (int32)(u >> 1) ^ -(int32)(u & 1);
+}
+
+static float32 yaw_wrap(float32 yaw)
+{
+	return yaw - ((c_pi * 2.0f) * floorf((yaw + c_pi) / (c_pi * 2.0f)));
+}
+
+
+static void serialise_bits(Bit_Writer* writer, uint32 u, uint32 num_bits)
+{
+	bit_writer_write(writer, u, num_bits);
+}
+
+static void serialise_u32(Bit_Writer* writer, uint32 u)
 {
-	**buffer = u;
-	++(*buffer);
+	bit_writer_write(writer, u, 32);
 }
 
-/*static void serialise_u16(uint8** buffer, uint16 u)
+// a size class and then the value in that class's bits, the last class must fit anything passed in
+static void serialise_size_classed(Bit_Writer* writer, uint32 u, const uint32* class_bits)
 {
-	memcpy(*buffer, &u, sizeof(u));
-	*buffer += sizeof(u);
-}*/
+	uint32 size_class = 0;
+	while (size_class < 3 && (u >> class_bits[size_class]))
+	{
+		++size_class;
+	}
+	bit_writer_write(writer, size_class, c_position_class_bits);
+	bit_writer_write(writer, u, class_bits[size_class]);
+}
 
-static void serialise_u32(uint8** buffer, uint32 u)
+static void serialise_f32_quantised(Bit_Writer* writer, float32 f, float32 min, float32 precision, uint32 num_bits)
 {
-	memcpy(*buffer, &u, sizeof(u));
-	*buffer += sizeof(u);
+	bit_writer_write(writer, f32_quantise(f, min, precision, num_bits), num_bits);
 }
 
-static void serialise_f32(uint8** buffer, float32 f)
+static void serialise_velocity(Bit_Writer* writer, Vec_3f velocity)
 {
-	memcpy(*buffer, &f, sizeof(f));
-	*buffer += sizeof(f);
+	serialise_f32_quantised(writer, velocity.x, c_velocity_min, c_velocity_precision, c_velocity_bits);
+	serialise_f32_quantised(writer, velocity.y, c_velocity_min, c_velocity_precision, c_velocity_bits);
+	serialise_f32_quantised(writer, velocity.z, c_velocity_min, c_velocity_precision, c_velocity_bits);
 }
 
-static void serialise_vec_3f(uint8** buffer, Vec_3f v)
+static void serialise_pitch(Bit_Writer* writer, float32 pitch)
 {
-	serialise_f32(buffer, v.x);
-	serialise_f32(buffer, v.y);
-	serialise_f32(buffer, v.z);
+	serialise_f32_quantised(writer, pitch, c_pitch_min, c_pitch_precision, c_angle_bits);
 }
 
-static void serialise_input(uint8** buffer, Player_Input* input)
+static void serialise_yaw(Bit_Writer* writer, float32 yaw)
+{
+	serialise_f32_quantised(writer, yaw_wrap(yaw), c_yaw_min, c_yaw_precision, c_angle_bits);
+}
+
+static void serialise_input(Bit_Writer* writer, Player_Input* input)
 {
 	// if buttons are non-zero they're not necessarily 1
-	uint8 packed_buttons = 
-		(uint8)(input->up	? 1 << 0 : 0) |
-		(uint8)(input->down ? 1 << 1 : 0) |
-		(uint8)(input->left ? 1 << 2 : 0) |
-		(uint8)(input->right? 1 << 3 : 0) |
-		(uint8)(input->jump ? 1 << 4 : 0);
+	uint32 packed_buttons =
+		(input->up		? 1 << 0 : 0) |
+		(input->down	? 1 << 1 : 0) |
+		(input->left	? 1 << 2 : 0) |
+		(input->right	? 1 << 3 : 0) |
+		(input->jump	? 1 << 4 : 0);
+
+	serialise_bits(writer, packed_buttons, c_buttons_bits);
+	serialise_pitch(writer, input->pitch);
+	serialise_yaw(writer, input->yaw);
+}
 
-	serialise_u8(buffer, packed_buttons);
-	serialise_f32(buffer, input->pitch);
-	serialise_f32(buffer, input->yaw);
+static void deserialise_bits(Bit_Reader* reader, uint32* u, uint32 num_bits)
+{
+	*u = bit_reader_read(reader, num_bits);
 }
 
-static void serialise_player_snapshot_state(uint8** buffer, Player_Snapshot_State* player_snapshot_state)
+static void deserialise_u32(Bit_Reader* reader, uint32* u)
 {
-	serialise_vec_3f(buffer, player_snapshot_state->position);
-	serialise_f32(buffer, player_snapshot_state->pitch);
-	serialise_f32(buffer, player_snapshot_state->yaw);
+	*u = bit_reader_read(reader, 32);
 }
 
-static void deserialise_u8(uint8** buffer, uint8* u)
+static uint32 deserialise_size_classed(Bit_Reader* reader, const uint32* class_bits)
 {
-	*u = **buffer;
-	++(*buffer);
+	uint32 size_class = bit_reader_read(reader, c_position_class_bits);
+	return bit_reader_read(reader, class_bits[size_class]);
 }
 
-/*static void deserialise_u16(uint8** buffer, uint16* u)
+static void deserialise_f32_quantised(Bit_Reader* reader, float32* f, float32 min, float32 precision, uint32 num_bits)
 {
-	memcpy(u, *buffer, sizeof(*u));
-	*buffer += sizeof(*u);
-}*/
+	*f = f32_dequantise(bit_reader_read(reader, num_bits), min, precision);
+}
 
-static void deserialise_u32(uint8** buffer, uint32* u)
+static void deserialise_velocity(Bit_Reader* reader, Vec_3f* velocity)
 {
-	memcpy(u, *buffer, sizeof(*u));
-	*buffer += sizeof(*u);
+	deserialise_f32_quantised(reader, &velocity->x, c_velocity_min, c_velocity_precision, c_velocity_bits);
+	deserialise_f32_quantised(reader, &velocity->y, c_velocity_min, c_velocity_precision, c_velocity_bits);
+	deserialise_f32_quantised(reader, &velocity->z, c_velocity_min, c_velocity_precision, c_velocity_bits);
 }
 
-static void deserialise_f32(uint8** buffer, float32* f)
+static void deserialise_pitch(Bit_Reader* reader, float32* pitch)
 {
-	memcpy(f, *buffer, sizeof(*f));
-	*buffer += sizeof(*f);
+	deserialise_f32_quantised(reader, pitch, c_pitch_min, c_pitch_precision, c_angle_bits);
 }
 
-static void deserialise_vec_3f(uint8** buffer, Vec_3f* v)
+static void deserialise_yaw(Bit_Reader* reader, float32* yaw)
 {
-	deserialise_f32(buffer, &v->x);
-	deserialise_f32(buffer, &v->y);
-	deserialise_f32(buffer, &v->z);
+	deserialise_f32_quantised(reader, yaw, c_yaw_min, c_yaw_precision, c_angle_bits);
 }
 
-static void deserialise_input(uint8** buffer, Player_Input* input)
+static void deserialise_input(Bit_Reader* reader, Player_Input* input)
 {
 	// if buttons are non-zero they're not necessarily 1
-	uint8 packed_buttons;
-	deserialise_u8(buffer, &packed_buttons);
-	deserialise_f32(buffer, &input->pitch);
-	deserialise_f32(buffer, &input->yaw);
+	uint32 packed_buttons;
+	deserialise_bits(reader, &packed_buttons, c_buttons_bits);
+	deserialise_pitch(reader, &input->pitch);
+	deserialise_yaw(reader, &input->yaw);
 
 	input->up		= packed_buttons & 1;
 	input->down		= packed_buttons & (1 << 1);
@@ -108,171 +309,634 @@ static void deserialise_input(uint8** buffer, Player_Input* input)
 	input->jump		= packed_buttons & (1 << 4);
 }
 
-static void deserialise_player_snapshot_state(uint8** buffer, Player_Snapshot_State* player_snapshot_state)
+
+
+// snapshot states are handled as quantised fields, so deltas compare exactly what the client would decode,
+// positions come first and are int32 steps, the angles after them are fixed point in c_angle_bits
+constexpr uint32 c_num_snapshot_fields = 5; // position x, y, z, pitch, yaw
+constexpr uint32 c_num_position_fields = 3;
+static const float32	c_angle_field_mins[c_num_snapshot_fields - c_num_position_fields]		= { c_pitch_min,		c_yaw_min };
+static const float32	c_angle_field_precisions[c_num_snapshot_fields - c_num_position_fields]	= { c_pitch_precision,	c_yaw_precision };
+
+// worst case for a fragment is every player changed and every field in its delta too, which has to fit after the header
+constexpr uint32 c_max_player_bits			= 2 + c_num_snapshot_fields + ((c_position_class_bits + c_position_delta_bits[3]) * c_num_position_fields) + (c_angle_bits * 2);
+constexpr uint32 c_max_state_header_bits	= c_server_message_type_bits + 32 + c_baseline_offset_bits + c_short_sequence_bits + (c_velocity_bits * 3) + c_max_state_fragments + c_fragment_bits;
+static_assert(((c_max_state_header_bits + 7) / 8) + (((c_max_player_bits * c_state_players_per_fragment) + 7) / 8) <= c_packet_budget_per_tick, 
+	"a full fragment must fit in a packet");
+
+// everything but state messages is a fixed size, or for join results one of two
+constexpr uint32 c_client_msg_join_bits				= c_client_message_type_bits;
+constexpr uint32 c_client_msg_leave_bits			= c_client_message_type_bits;
+constexpr uint32 c_client_msg_input_bits			= c_client_message_type_bits + c_buttons_bits + (c_angle_bits * 2) + c_short_sequence_bits + 1 + c_short_sequence_bits;
+constexpr uint32 c_server_msg_join_result_min_bits	= c_server_message_type_bits + 1; // rejected
+
+static void player_snapshot_state_quantise(Player_Snapshot_State* player_snapshot_state, uint32* out_fields)
 {
-	deserialise_vec_3f(buffer, &player_snapshot_state->position);
-	deserialise_f32(buffer, &player_snapshot_state->pitch);
-	deserialise_f32(buffer, &player_snapshot_state->yaw);
+	out_fields[0] = (uint32)position_quantise(player_snapshot_state->position.x);
+	out_fields[1] = (uint32)position_quantise(player_snapshot_state->position.y);
+	out_fields[2] = (uint32)position_quantise(player_snapshot_state->position.z);
+	out_fields[3] = f32_quantise(player_snapshot_state->pitch, c_pitch_min, c_pitch_precision, c_angle_bits);
+	out_fields[4] = f32_quantise(yaw_wrap(player_snapshot_state->yaw), c_yaw_min, c_yaw_precision, c_angle_bits);
 }
 
+static float32 snapshot_field_dequantise(uint32 field, uint32 q)
+{
+	if (field < c_num_position_fields)
+	{
+		return position_dequantise((int32)q);
+	}
+	uint32 angle = field - c_num_position_fields;
+	return f32_dequantise(q, c_angle_field_mins[angle], c_angle_field_precisions[angle]);
+}
 
-uint32 client_msg_join_write(uint8* buffer)
+static void player_snapshot_state_set_field(Player_Snapshot_State* player_snapshot_state, uint32 field, float32 value)
 {
-	uint8* buffer_iter = buffer;
-	
-	serialise_u8(&buffer_iter, (uint8)Client_Message::Join);
-	
-	return (uint32)(buffer_iter - buffer);
+	switch (field)
+	{
+		case 0: player_snapshot_state->position.x = value; break;
+		case 1: player_snapshot_state->position.y = value; break;
+		case 2: player_snapshot_state->position.z = value; break;
+		case 3: player_snapshot_state->pitch = value; break;
+		case 4: player_snapshot_state->yaw = value; break;
+	}
 }
 
-uint32 client_msg_leave_write(uint8* buffer, uint32 slot)
+// baseline_q is 0 to send the field as it is rather than against a baseline
+static void serialise_snapshot_field(Bit_Writer* writer, uint32 field, uint32 q, uint32* baseline_q)
 {
-	uint8* buffer_iter = buffer;
-	
-	serialise_u8(&buffer_iter, (uint8)Client_Message::Leave);
-	serialise_u32(&buffer_iter, slot);
+	if (field >= c_num_position_fields)
+	{
+		serialise_bits(writer, q, c_angle_bits);
+	}
+	else if (baseline_q)
+	{
+		serialise_size_classed(writer, zigzag((int32)(q - *baseline_q)), c_position_delta_bits);
+	}
+	else
+	{
+		serialise_size_classed(writer, zigzag((int32)q), c_position_absolute_bits);
+	}
+}
 
-	return (uint32)(buffer_iter - buffer);
+static uint32 deserialise_snapshot_field(Bit_Reader* reader, uint32 field, uint32* baseline_q)
+{
+	if (field >= c_num_position_fields)
+	{
+		return bit_reader_read(reader, c_angle_bits);
+	}
+	else if (baseline_q)
+	{
+		return *baseline_q + (uint32)unzigzag(deserialise_size_classed(reader, c_position_delta_bits));
+	}
+	return (uint32)unzigzag(deserialise_size_classed(reader, c_position_absolute_bits));
 }
-void client_msg_leave_read(uint8* buffer, uint32* out_slot)
+
+static void serialise_player_snapshot_state(Bit_Writer* writer, Player_Snapshot_State* player_snapshot_state)
 {
-	uint8* buffer_iter = buffer;
+	uint32 fields[c_num_snapshot_fields];
+	player_snapshot_state_quantise(player_snapshot_state, fields);
+	for (uint32 i = 0; i < c_num_snapshot_fields; ++i)
+	{
+		serialise_snapshot_field(writer, i, fields[i], 0);
+	}
+}
+
+// a change bit per field, followed by the field if it changed
+static void serialise_player_snapshot_state_delta(Bit_Writer* writer, Player_Snapshot_State* player_snapshot_state, Player_Snapshot_State* baseline_player_snapshot_state)
+{
+	uint32 fields[c_num_snapshot_fields];
+	uint32 baseline_fields[c_num_snapshot_fields];
+	player_snapshot_state_quantise(player_snapshot_state, fields);
+	player_snapshot_state_quantise(baseline_player_snapshot_state, baseline_fields);
+	for (uint32 i = 0; i < c_num_snapshot_fields; ++i)
+	{
+		if (fields[i] != baseline_fields[i])
+		{
+			serialise_bits(writer, 1, 1);
+			serialise_snapshot_field(writer, i, fields[i], &baseline_fields[i]);
+		}
+		else
+		{
+			serialise_bits(writer, 0, 1);
+		}
+	}
+}
 
-	uint8 message_type;
-	deserialise_u8(&buffer_iter, &message_type);
-	assert(message_type == (uint8)Client_Message::Leave);
+static bool32 player_snapshot_state_equals_quantised(Player_Snapshot_State* a, Player_Snapshot_State* b)
+{
+	uint32 a_fields[c_num_snapshot_fields];
+	uint32 b_fields[c_num_snapshot_fields];
+	player_snapshot_state_quantise(a, a_fields);
+	player_snapshot_state_quantise(b, b_fields);
+	for (uint32 i = 0; i < c_num_snapshot_fields; ++i)
+	{
+		if (a_fields[i] != b_fields[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
 
-	deserialise_u32(&buffer_iter, out_slot);
+static void deserialise_player_snapshot_state(Bit_Reader* reader, Player_Snapshot_State* player_snapshot_state)
+{
+	for (uint32 i = 0; i < c_num_snapshot_fields; ++i)
+	{
+		uint32 q = deserialise_snapshot_field(reader, i, 0);
+		player_snapshot_state_set_field(player_snapshot_state, i, snapshot_field_dequantise(i, q));
+	}
 }
 
-uint32 client_msg_input_write(uint8* buffer, uint32 slot, float32 dt, Player_Input* input, uint32 prediction_id)
+// player_snapshot_state must already hold the baseline, which is quantised again to apply the deltas to
+static void deserialise_player_snapshot_state_delta(Bit_Reader* reader, Player_Snapshot_State* player_snapshot_state)
 {
-	uint8* buffer_iter = buffer;
-	
-	serialise_u8(&buffer_iter, (uint8)Client_Message::Input);
-	serialise_u32(&buffer_iter, slot);
-	serialise_f32(&buffer_iter, dt);
-	serialise_input(&buffer_iter, input);
-	serialise_u32(&buffer_iter, prediction_id);
+	uint32 baseline_fields[c_num_snapshot_fields];
+	player_snapshot_state_quantise(player_snapshot_state, baseline_fields);
+	for (uint32 i = 0; i < c_num_snapshot_fields; ++i)
+	{
+		uint32 changed;
+		deserialise_bits(reader, &changed, 1);
+		if (changed)
+		{
+			uint32 q = deserialise_snapshot_field(reader, i, &baseline_fields[i]);
+			player_snapshot_state_set_field(player_snapshot_state, i, snapshot_field_dequantise(i, q));
+		}
+	}
+}
 
-	return (uint32)(buffer_iter - buffer);
+
+void snapshot_history_create(Snapshot_History* history, uint32 max_players, Linear_Allocator* allocator)
+{
+	for (uint32 i = 0; i < c_snapshot_history_capacity; ++i)
+	{
+		Snapshot* snapshot = &history->snapshots[i];
+		snapshot->sequence = 0;
+		snapshot->fragments_received = 0;
+		snapshot->player_snapshot_states = (Player_Snapshot_State*)linear_allocator_alloc(allocator, sizeof(Player_Snapshot_State) * max_players);
+		snapshot->players_present = (bool32*)linear_allocator_alloc(allocator, sizeof(bool32) * max_players);
+		for (uint32 j = 0; j < max_players; ++j)
+		{
+			snapshot->players_present[j] = 0;
+		}
+	}
 }
-void client_msg_input_read(uint8* buffer, uint32* slot, float32* dt, Player_Input* input, uint32* prediction_id)
+
+uint64 snapshot_history_memory_size(uint32 max_players)
 {
-	uint8* buffer_iter = buffer;
+	return (sizeof(Player_Snapshot_State) + sizeof(bool32)) * max_players * c_snapshot_history_capacity;
+}
+
+Snapshot* snapshot_history_get(Snapshot_History* history, uint32 sequence)
+{
+	Snapshot* snapshot = &history->snapshots[sequence & c_snapshot_history_mask];
+	if (sequence && snapshot->sequence == sequence)
+	{
+		return snapshot;
+	}
+	return 0;
+}
+
+Snapshot* snapshot_history_push(Snapshot_History* history, uint32 sequence)
+{
+	assert(sequence);
+	Snapshot* snapshot = &history->snapshots[sequence & c_snapshot_history_mask];
+	snapshot->sequence = sequence;
+	return snapshot;
+}
 
-	uint8 message_type;
-	deserialise_u8(&buffer_iter, &message_type);
-	assert(message_type == (uint8)Client_Message::Input);
 
-	deserialise_u32(&buffer_iter, slot);
-	deserialise_f32(&buffer_iter, dt);
-	deserialise_input(&buffer_iter, input);
-	deserialise_u32(&buffer_iter, prediction_id);
+void player_input_quantise(Player_Input* input)
+{
+	input->pitch = f32_dequantise(f32_quantise(input->pitch, c_pitch_min, c_pitch_precision, c_angle_bits), c_pitch_min, c_pitch_precision);
+	input->yaw = f32_dequantise(f32_quantise(yaw_wrap(input->yaw), c_yaw_min, c_yaw_precision, c_angle_bits), c_yaw_min, c_yaw_precision);
 }
 
+// ids never go below 0, so when the nearest value would it's the one above instead
+uint32 sequence_expand(uint32 low_bits, uint32 reference)
+{
+	constexpr uint32 c_half = 1u << (c_short_sequence_bits - 1);
+	uint32 ahead = (low_bits - reference) & c_short_sequence_mask;
+	uint32 behind = (c_short_sequence_mask + 1) - ahead;
+	if (ahead >= c_half && behind <= reference)
+	{
+		return reference - behind;
+	}
+	return reference + ahead;
+}
 
 
-uint32 server_msg_join_result_write(uint8* buffer, bool32 success, uint32 slot)
+bool32 client_msg_type_read(uint8* buffer, uint32 buffer_size, Client_Message* out_type)
 {
-	uint8* buffer_iter = buffer;
+	Bit_Reader reader = bit_reader(buffer, buffer_size);
+	uint32 type = bit_reader_read(&reader, c_client_message_type_bits);
+	if (reader.is_overrun)
+	{
+		return false;
+	}
 
-	serialise_u8(&buffer_iter, (uint8)Server_Message::Join_Result);
-	serialise_u8(&buffer_iter, success ? 1 : 0);
-	
-	if (success)
+	uint32 min_bits;
+	switch ((Client_Message)type)
 	{
-		serialise_u32(&buffer_iter, slot);
+		case Client_Message::Join:	min_bits = c_client_msg_join_bits; break;
+		case Client_Message::Leave:	min_bits = c_client_msg_leave_bits; break;
+		case Client_Message::Input:	min_bits = c_client_msg_input_bits; break;
+		default: return false;
 	}
 
-	return (uint32)(buffer_iter - buffer);
+	*out_type = (Client_Message)type;
+	return buffer_size >= bits_to_bytes(min_bits);
+}
+
+uint32 client_msg_join_write(uint8* buffer)
+{
+	Bit_Writer writer = bit_writer(buffer);
+
+	serialise_bits(&writer, (uint32)Client_Message::Join, c_client_message_type_bits);
+
+	return (uint32)(bit_writer_flush(&writer) - buffer);
+}
+
+uint32 client_msg_leave_write(uint8* buffer)
+{
+	Bit_Writer writer = bit_writer(buffer);
+
+	serialise_bits(&writer, (uint32)Client_Message::Leave, c_client_message_type_bits);
+
+	return (uint32)(bit_writer_flush(&writer) - buffer);
+}
+
+uint32 client_msg_input_write(uint8* buffer, Player_Input* input, uint32 prediction_id, uint32 ack_sequence)
+{
+	Bit_Writer writer = bit_writer(buffer);
+
+	serialise_bits(&writer, (uint32)Client_Message::Input, c_client_message_type_bits);
+	serialise_input(&writer, input);
+	serialise_bits(&writer, prediction_id & c_short_sequence_mask, c_short_sequence_bits);
+	serialise_bits(&writer, ack_sequence ? 1 : 0, 1);
+	serialise_bits(&writer, ack_sequence & c_short_sequence_mask, c_short_sequence_bits);
+
+	return (uint32)(bit_writer_flush(&writer) - buffer);
+}
+bool32 client_msg_input_read(uint8* buffer, uint32 buffer_size, Player_Input* input, uint32* prediction_id, bool32* has_ack, uint32* ack_sequence)
+{
+	Bit_Reader reader = bit_reader(buffer, buffer_size);
+
+	uint32 message_type;
+	deserialise_bits(&reader, &message_type, c_client_message_type_bits);
+	assert(message_type == (uint32)Client_Message::Input);
+
+	uint32 has_ack_bit;
+	deserialise_input(&reader, input);
+	deserialise_bits(&reader, prediction_id, c_short_sequence_bits);
+	deserialise_bits(&reader, &has_ack_bit, 1);
+	deserialise_bits(&reader, ack_sequence, c_short_sequence_bits);
+	*has_ack = has_ack_bit;
+
+	return !reader.is_overrun;
+}
+
+
+
+bool32 server_msg_type_read(uint8* buffer, uint32 buffer_size, Server_Message* out_type)
+{
+	Bit_Reader reader = bit_reader(buffer, buffer_size);
+	uint32 type = bit_reader_read(&reader, c_server_message_type_bits);
+	if (reader.is_overrun)
+	{
+		return false;
+	}
+
+	uint32 min_bits;
+	switch ((Server_Message)type)
+	{
+		case Server_Message::Join_Result:	min_bits = c_server_msg_join_result_min_bits; break;
+		case Server_Message::State:			min_bits = c_max_state_header_bits; break;
+		default: return false;
+	}
+
+	*out_type = (Server_Message)type;
+	return buffer_size >= bits_to_bytes(min_bits);
 }
-void server_msg_join_result_read(uint8* buffer, bool32* out_success, uint32* out_slot)
+
+uint32 server_msg_join_result_write(uint8* buffer, bool32 success, uint32 slot, uint32 max_players, int32 tick_rate)
 {
-	uint8* buffer_iter = buffer;
+	assert(max_players >= 1 && max_players <= c_max_clients);
+
+	Bit_Writer writer = bit_writer(buffer);
 
-	uint8 message_type;
-	deserialise_u8(&buffer_iter, &message_type);
-	assert(message_type == (uint8)Server_Message::Join_Result);
+	serialise_bits(&writer, (uint32)Server_Message::Join_Result, c_server_message_type_bits);
+	serialise_bits(&writer, success ? 1 : 0, 1);
+
+	if (success)
+	{
+		serialise_bits(&writer, slot, c_slot_bits);
+		serialise_bits(&writer, max_players - 1, c_slot_bits);
+		serialise_bits(&writer, (uint32)tick_rate, c_tick_rate_bits);
+	}
+
+	return (uint32)(bit_writer_flush(&writer) - buffer);
+}
+bool32 server_msg_join_result_read(uint8* buffer, uint32 buffer_size, bool32* out_success, uint32* out_slot, uint32* out_max_players, int32* out_tick_rate)
+{
+	Bit_Reader reader = bit_reader(buffer, buffer_size);
+
+	uint32 message_type;
+	deserialise_bits(&reader, &message_type, c_server_message_type_bits);
+	assert(message_type == (uint32)Server_Message::Join_Result);
+
+	// nothing is written out unless it's all there, so a short packet can't change the caller's slot or room size
+	uint32 success;
+	uint32 slot = 0;
+	uint32 max_players = 0;
+	uint32 tick_rate = 0;
+	deserialise_bits(&reader, &success, 1);
+	if (success)
+	{
+		deserialise_bits(&reader, &slot, c_slot_bits);
+		deserialise_bits(&reader, &max_players, c_slot_bits);
+		deserialise_bits(&reader, &tick_rate, c_tick_rate_bits);
+	}
+	if (reader.is_overrun)
+	{
+		return false;
+	}
 
-	uint8 success;
-	deserialise_u8(&buffer_iter, &success);
 	*out_success = success;
 	if (success)
 	{
-		deserialise_u32(&buffer_iter, out_slot);
+		*out_slot = slot;
+		*out_max_players = max_players + 1;
+		*out_tick_rate = (int32)tick_rate;
+	}
+	return true;
+}
+
+uint32 server_msg_state_players_write(
+	uint8* buffer,
+	Snapshot* snapshot,
+	Snapshot* baseline,
+	uint32 fragment,
+	uint32 max_players)
+{
+	Bit_Writer writer = bit_writer(buffer);
+	bool32 is_needed = false;
+
+	uint32 first_player = fragment * c_state_players_per_fragment;
+	uint32 end_player = first_player + c_state_players_per_fragment;
+	if (end_player > max_players)
+	{
+		end_player = max_players;
+	}
+	for (uint32 i = first_player; i < end_player; ++i)
+	{
+		bool32 is_present = snapshot->players_present[i];
+		Player_Snapshot_State* player_snapshot_state = &snapshot->player_snapshot_states[i];
+
+		if (!baseline)
+		{
+			// full snapshot, just a present bit and then the state
+			serialise_bits(&writer, is_present ? 1 : 0, 1);
+			if (is_present)
+			{
+				serialise_player_snapshot_state(&writer, player_snapshot_state);
+				is_needed = true;
+			}
+			continue;
+		}
+
+		// delta, a changed bit and then only what's changed, so unchanged players cost 1 bit
+		bool32 was_present = baseline->players_present[i];
+		Player_Snapshot_State* baseline_player_snapshot_state = &baseline->player_snapshot_states[i];
+
+		bool32 is_changed = is_present != was_present || 
+							(is_present && !player_snapshot_state_equals_quantised(player_snapshot_state, baseline_player_snapshot_state));
+		serialise_bits(&writer, is_changed ? 1 : 0, 1);
+		if (is_changed)
+		{
+			is_needed = true;
+			serialise_bits(&writer, is_present ? 1 : 0, 1);
+			if (is_present)
+			{
+				if (was_present)
+				{
+					serialise_player_snapshot_state_delta(&writer, player_snapshot_state, baseline_player_snapshot_state);
+				}
+				else
+				{
+					serialise_player_snapshot_state(&writer, player_snapshot_state);
+				}
+			}
+		}
+	}
+
+	if (!is_needed)
+	{
+		return 0;
 	}
+
+	return (uint32)(bit_writer_flush(&writer) - buffer);
 }
 
 uint32 server_msg_state_write(
-	uint8* buffer, 
-	uint32 prediction_id, 
+	uint8* buffer,
+	uint32 sequence,
+	uint32 baseline_sequence,
+	uint32 prediction_id,
 	Player_Extra_State* local_player_extra_state,
-	IP_Endpoint* player_endpoints,
-	Player_Snapshot_State* player_snapshot_states,
-	uint32 max_players)
+	uint32 fragment_mask,
+	uint32 fragment,
+	uint8* players_buffer,
+	uint32 players_size)
 {
-	uint8* buffer_iter = buffer;
+	assert(!baseline_sequence || (sequence - baseline_sequence) < c_snapshot_history_capacity);
+	assert(fragment < c_max_state_fragments);
+
+	Bit_Writer writer = bit_writer(buffer);
 
-	serialise_u8(&buffer_iter, (uint8)Server_Message::State);
-	serialise_u32(&buffer_iter, prediction_id);
-	serialise_vec_3f(&buffer_iter, local_player_extra_state->velocity);
+	serialise_bits(&writer, (uint32)Server_Message::State, c_server_message_type_bits);
+	serialise_u32(&writer, sequence);
+	serialise_bits(&writer, baseline_sequence ? sequence - baseline_sequence : 0, c_baseline_offset_bits);
+	serialise_bits(&writer, prediction_id & c_short_sequence_mask, c_short_sequence_bits);
+	serialise_velocity(&writer, local_player_extra_state->velocity);
+	serialise_bits(&writer, fragment_mask, c_max_state_fragments);
+	serialise_bits(&writer, fragment, c_fragment_bits);
 
-	uint8* num_players_buffer_pos = buffer_iter; // written later
-	serialise_u8(&buffer_iter, 0);
+	// the player block is byte aligned so it can just be copied in
+	uint8* buffer_iter = bit_writer_flush(&writer);
+	memcpy(buffer_iter, players_buffer, players_size);
+	buffer_iter += players_size;
 
-	uint8 num_players = 0;
-	for (uint8 i = 0; i < max_players; ++i)
+	return (uint32)(buffer_iter - buffer);
+}
+// decodes a fragment's player block into the snapshot, if it's cut short the fragment is put back as it
+// was (the baseline's, or empty for a full snapshot) so a good copy of it can still be decoded
+static bool32 deserialise_state_players(Bit_Reader* reader, Snapshot* snapshot, Snapshot* baseline, uint32 fragment, uint32 max_players)
+{
+	uint32 first_player = fragment * c_state_players_per_fragment;
+	uint32 end_player = first_player + c_state_players_per_fragment;
+	if (end_player > max_players)
+	{
+		end_player = max_players;
+	}
+	for (uint32 i = first_player; i < end_player; ++i)
 	{
-		if (player_endpoints[i].address)
+		bool32* is_present = &snapshot->players_present[i];
+		Player_Snapshot_State* player_snapshot_state = &snapshot->player_snapshot_states[i];
+
+		if (!baseline)
 		{
-			++num_players;
+			uint32 present;
+			deserialise_bits(reader, &present, 1);
+			*is_present = present;
+			if (present)
+			{
+				deserialise_player_snapshot_state(reader, player_snapshot_state);
+			}
+			continue;
+		}
 
-			serialise_u8(&buffer_iter, i);
-			serialise_player_snapshot_state(&buffer_iter, &player_snapshot_states[i]);
+		uint32 changed;
+		deserialise_bits(reader, &changed, 1);
+		if (changed)
+		{
+			uint32 present;
+			deserialise_bits(reader, &present, 1);
+			if (present)
+			{
+				if (*is_present)
+				{
+					deserialise_player_snapshot_state_delta(reader, player_snapshot_state);
+				}
+				else
+				{
+					deserialise_player_snapshot_state(reader, player_snapshot_state);
+				}
+			}
+			*is_present = present;
 		}
 	}
 
-	serialise_u8(&num_players_buffer_pos, num_players);
+	if (!reader->is_overrun)
+	{
+		return true;
+	}
 
-	return (uint32)(buffer_iter - buffer);
+	for (uint32 i = first_player; i < end_player; ++i)
+	{
+		if (baseline)
+		{
+			snapshot->players_present[i] = baseline->players_present[i];
+			snapshot->player_snapshot_states[i] = baseline->player_snapshot_states[i];
+		}
+		else
+		{
+			snapshot->players_present[i] = false;
+		}
+	}
+	return false;
 }
-void server_msg_state_read(
+
+bool32 server_msg_state_read(
 	uint8* buffer,
+	uint32 buffer_size,
+	Snapshot_History* history,
+	uint32* out_sequence,
+	uint32 newest_prediction_id,
 	uint32* prediction_id, // most recent prediction id server has received for this player
 	Player_Extra_State* local_player_extra_state,
-	Player_Snapshot_State* player_snapshot_states, // snapshot state of all players
-	bool32* players_present, // a 1 will be written to every slot actually used
-	uint32 max_players) // max number of players the client can handle
+	uint32 max_players,
+	bool32* out_is_complete)
 {
-	uint8* buffer_iter = buffer;
+	// the header is a fixed size, so once it's known to be all there only the player block can be cut short
+	if (buffer_size < bits_to_bytes(c_max_state_header_bits))
+	{
+		return false;
+	}
+	Bit_Reader reader = bit_reader(buffer, buffer_size);
+
+	uint32 message_type;
+	deserialise_bits(&reader, &message_type, c_server_message_type_bits);
+	assert(message_type == (uint32)Server_Message::State);
+
+	uint32 sequence;
+	uint32 baseline_offset;
+	deserialise_u32(&reader, &sequence);
+	deserialise_bits(&reader, &baseline_offset, c_baseline_offset_bits);
+
+	Snapshot* baseline = 0;
+	if (baseline_offset)
+	{
+		baseline = snapshot_history_get(history, sequence - baseline_offset);
+		if (!baseline)
+		{
+			return false;
+		}
+	}
 
-	uint8 message_type;
-	deserialise_u8(&buffer_iter, &message_type);
-	assert(message_type == (uint8)Server_Message::State);
+	// don't let a late packet overwrite a newer snapshot which could still be used as a baseline
+	Snapshot* snapshot = &history->snapshots[sequence & c_snapshot_history_mask];
+	if (!sequence || snapshot->sequence > sequence)
+	{
+		return false;
+	}
 
-	deserialise_u32(&buffer_iter, prediction_id);
-	deserialise_vec_3f(&buffer_iter, &local_player_extra_state->velocity);
+	uint32 prediction_id_low_bits;
+	deserialise_bits(&reader, &prediction_id_low_bits, c_short_sequence_bits);
+	deserialise_velocity(&reader, &local_player_extra_state->velocity);
+	uint32 fragment_mask;
+	uint32 fragment;
+	deserialise_bits(&reader, &fragment_mask, c_max_state_fragments);
+	deserialise_bits(&reader, &fragment, c_fragment_bits);
 
-	bool32* players_present_end = &players_present[max_players];
-	for (bool32* iter = players_present; iter != players_present_end; ++iter)
+	uint32 num_fragments = state_num_fragments(max_players);
+	if (fragment >= num_fragments || (fragment_mask >> num_fragments))
 	{
-		*iter = 0;
+		return false; // not sized for the room we joined
 	}
 
-	uint8 num_players;
-	deserialise_u8(&buffer_iter, &num_players);
-	for (uint8 i = 0; i < num_players; ++i)
+	if (snapshot->sequence == sequence)
 	{
-		uint8 slot;
-		deserialise_u8(&buffer_iter, &slot);
-		assert(slot < max_players);
-		
-		deserialise_player_snapshot_state(&buffer_iter, &player_snapshot_states[slot]);
-		
-		players_present[slot] = 1;
+		if (snapshot->fragments_received & (1 << fragment))
+		{
+			return false;
+		}
 	}
+	else
+	{
+		// fragments which aren't sent are unchanged from the baseline, or empty for a full snapshot
+		snapshot = snapshot_history_push(history, sequence);
+		snapshot->fragments_received = 0;
+		for (uint32 i = 0; i < max_players; ++i)
+		{
+			if (baseline)
+			{
+				snapshot->players_present[i] = baseline->players_present[i];
+				snapshot->player_snapshot_states[i] = baseline->player_snapshot_states[i];
+			}
+			else
+			{
+				snapshot->players_present[i] = false;
+			}
+		}
+	}
+
+	// no player block means nothing at all has changed since the baseline
+	if (fragment_mask & (1 << fragment))
+	{
+		bit_reader_align(&reader);
+		if (!deserialise_state_players(&reader, snapshot, baseline, fragment, max_players))
+		{
+			return false;
+		}
+	}
+
+	snapshot->fragments_received |= 1 << fragment;
+	*out_is_complete = (snapshot->fragments_received & fragment_mask) == fragment_mask;
+	*out_sequence = sequence;
+	*prediction_id = sequence_expand(prediction_id_low_bits, newest_prediction_id);
+
+	return true;
 }
 
 
-} // namespace Net
\ No newline at end of file
+} // namespace Net
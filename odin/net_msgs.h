@@ -14,17 +14,63 @@ namespace Net
 {
 
 
+// messages are bit packed, floats are quantised to these ranges/precisions
+constexpr float32 c_position_precision	= 0.001f; // 1mm, must stay under the client's prediction error tolerance
+// positions cover all of c_player_position_extent, so there's no range here
+constexpr float32 c_velocity_precision	= 0.001f;
+constexpr float32 c_velocity_extent		= 32.0f;
+
+// pitch and yaw are sent at 16 bits, so predict with the same values the server will see
+void player_input_quantise(Player_Input* input);
+
+// prediction ids and acked sequences are sent as just their low bits, readers rebuild them as the value
+// nearest to one they already have, so they have to be within half of this many bits of each other
+constexpr uint32 c_short_sequence_bits = 16;
+
+uint32 sequence_expand(uint32 low_bits, uint32 reference);
+
+
+// state messages are deltas against a snapshot the client has acked, both ends keep a history
+// of recent snapshots to decode against, sequence 0 is never used so it can mean "no snapshot"
+constexpr uint32 c_snapshot_history_capacity = 32; // how far back a delta baseline can be
+constexpr uint32 c_snapshot_history_mask = c_snapshot_history_capacity - 1;
+
+struct Snapshot
+{
+	uint32 sequence;
+	Player_Snapshot_State* player_snapshot_states;
+	bool32* players_present;
+	uint32 fragments_received; // client side, a bit per state message fragment decoded into this snapshot
+};
+
+struct Snapshot_History
+{
+	Snapshot snapshots[c_snapshot_history_capacity];
+};
+
+void		snapshot_history_create(Snapshot_History* history, uint32 max_players, Linear_Allocator* allocator);
+uint64		snapshot_history_memory_size(uint32 max_players);
+Snapshot*	snapshot_history_get(Snapshot_History* history, uint32 sequence); // 0 if not in history
+Snapshot*	snapshot_history_push(Snapshot_History* history, uint32 sequence); // overwrites the oldest snapshot
+
+
 enum class Client_Message : uint8
 {
 	Join,		// tell server we're new here
 	Leave,		// tell server we're leaving
 	Input 		// tell server our user input
 };
+// messages are read straight out of received packets, so every read is given the packet's size and fails
+// rather than read past it. A type read fails if the packet is too short for a message of its type
+bool32	client_msg_type_read(uint8* buffer, uint32 buffer_size, Client_Message* out_type);
 uint32	client_msg_join_write(uint8* buffer);
-uint32	client_msg_leave_write(uint8* buffer, uint32 slot);
-void	client_msg_leave_read(uint8* buffer, uint32* out_slot);
-uint32	client_msg_input_write(uint8* buffer, uint32 slot, float32 dt, Player_Input* input, uint32 prediction_id);
-void	client_msg_input_read(uint8* buffer, uint32* slot, float32* dt, Player_Input* input, uint32* prediction_id);
+// the server knows which slot a client is in from its endpoint, so client messages don't carry it
+uint32	client_msg_leave_write(uint8* buffer);
+// one input per server tick, the server simulates each for one of its ticks (the tick rate comes in the join result),
+// ack_sequence is the newest complete snapshot the client has, or 0 if it has none yet
+uint32	client_msg_input_write(uint8* buffer, Player_Input* input, uint32 prediction_id, uint32 ack_sequence);
+// prediction_id and ack_sequence come back as their low c_short_sequence_bits, see sequence_expand
+bool32	client_msg_input_read(uint8* buffer, uint32 buffer_size, Player_Input* input, uint32* prediction_id, bool32* has_ack, uint32* ack_sequence);
 
 
 enum class Server_Message : uint8
@@ -32,22 +78,54 @@ enum class Server_Message : uint8
 	Join_Result,// tell client they're accepted/rejected
 	State 		// tell client game state
 };
-uint32	server_msg_join_result_write(uint8* buffer, bool32 success, uint32 slot);
-void	server_msg_join_result_read(uint8* buffer, bool32* out_success, uint32* out_slot);
+// a state message's players are split into fragments of up to c_state_players_per_fragment, each sent in
+// its own packet so that big rooms still fit in c_packet_budget_per_tick. Fragments where nothing has
+// changed since the baseline (or with nobody in, for a full snapshot) are left out
+constexpr uint32 c_state_players_per_fragment = 64;
+constexpr uint32 c_max_state_fragments = (c_max_clients + c_state_players_per_fragment - 1) / c_state_players_per_fragment;
+
+constexpr uint32 state_num_fragments(uint32 max_players)
+{
+	return (max_players + c_state_players_per_fragment - 1) / c_state_players_per_fragment;
+}
+
+bool32	server_msg_type_read(uint8* buffer, uint32 buffer_size, Server_Message* out_type);
+// max_players is the size of the room the client has joined, which state messages are sized for
+uint32	server_msg_join_result_write(uint8* buffer, bool32 success, uint32 slot, uint32 max_players, int32 tick_rate);
+bool32	server_msg_join_result_read(uint8* buffer, uint32 buffer_size, bool32* out_success, uint32* out_slot, uint32* out_max_players, int32* out_tick_rate);
+// a fragment's player block only depends on the baseline, so it's written once per tick for each baseline
+// in use and then copied in after each client's header by server_msg_state_write, returns 0 if the
+// fragment can be left out
+uint32	server_msg_state_players_write(
+	uint8* buffer,
+	Snapshot* snapshot,
+	Snapshot* baseline, // 0 to send the full snapshot
+	uint32 fragment,
+	uint32 max_players);
+// one packet per fragment in fragment_mask, or if the mask is empty a single packet with no player block
 uint32	server_msg_state_write(
 	uint8* buffer, 
+	uint32 sequence,
+	uint32 baseline_sequence, // 0 if the player blocks are a full snapshot
 	uint32 prediction_id, 
 	Player_Extra_State* local_player_extra_state,
-	IP_Endpoint* player_endpoints,
-	Player_Snapshot_State* player_snapshot_states,
-	uint32 max_players);
-void	server_msg_state_read(
+	uint32 fragment_mask, // bit per fragment sent this tick
+	uint32 fragment, // which this packet is, its bit in fragment_mask isn't set if there's no player block
+	uint8* players_buffer, // written by server_msg_state_players_write
+	uint32 players_size);
+// decodes into the sequence's snapshot in history, which starts as a copy of the baseline, returns false 
+// if it's stale, a duplicate, cut short, or the baseline is no longer in history. Once every fragment sent 
+// for the sequence has arrived out_is_complete is set, and only then should it be used or acked
+bool32	server_msg_state_read(
 	uint8* buffer,
-	uint32* prediction_id, // most recent prediction id server has received for this player
+	uint32 buffer_size,
+	Snapshot_History* history,
+	uint32* out_sequence,
+	uint32 newest_prediction_id, // the newest this client has sent, which the received one is rebuilt against
+	uint32* prediction_id, // the input the server last simulated for this player, see client_msg_input_write
 	Player_Extra_State* local_player_extra_state,
-	Player_Snapshot_State* player_snapshot_states, // snapshot state of all players
-	bool32* players_present, // a 1 will be written to every slot actually used
-	uint32 max_players); // max number of players the client can handle
+	uint32 max_players, // from the join result
+	bool32* out_is_complete);
 	
 
 
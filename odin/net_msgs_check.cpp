@@ -0,0 +1,502 @@
+#include "core.h"
+#include "maths.h"
+#include "net_msgs.h"
+#include "player.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+
+
+// round trips every message through its writer and reader, checking quantised values come back within
+// tolerance (at the edges of their ranges too), and that packets cut short are rejected rather than read
+// past. Run by ctest, exits non-zero if anything fails
+
+
+constexpr float32 c_position_tolerance	= (Net::c_position_precision * 0.5f) + (c_player_position_extent * FLT_EPSILON); // plus float32 error at the extent
+constexpr float32 c_velocity_tolerance	= (Net::c_velocity_precision * 0.5f) + 0.0001f;
+constexpr float32 c_angle_tolerance		= (c_pi * 2.0f) / 65536.0f; // half a 16 bit step, plus float32 error
+constexpr uint32 c_check_max_players	= 70; // two fragments, the second only partly used
+constexpr float32 c_check_seconds_per_tick = 1.0f / 30.0f;
+
+static uint32 s_num_checks;
+static uint32 s_num_failures;
+
+static void check(bool32 condition, const char* what, float32 got = 0.0f, float32 expected = 0.0f)
+{
+	++s_num_checks;
+	if (!condition)
+	{
+		++s_num_failures;
+		printf("FAILED: %s (got %f, expected %f)\n", what, got, expected);
+	}
+}
+
+static void check_near(float32 got, float32 expected, float32 tolerance, const char* what)
+{
+	check(fabsf(got - expected) <= tolerance, what, got, expected);
+}
+
+// yaw wraps, so -pi and pi are the same angle
+static void check_angle_near(float32 got, float32 expected, float32 tolerance, const char* what)
+{
+	float32 diff = got - expected;
+	diff -= (c_pi * 2.0f) * roundf(diff / (c_pi * 2.0f));
+	check(fabsf(diff) <= tolerance, what, got, expected);
+}
+
+// values under the range come back as its min, values over it saturate at the top of what the bits can
+// hold, which can be a little past max, but never wrap around
+static void check_quantised_near(float32 got, float32 expected, float32 min, float32 max, float32 tolerance, const char* what)
+{
+	if (expected < min)
+	{
+		check_near(got, min, tolerance, what);
+	}
+	else if (expected > max)
+	{
+		check(got >= max - tolerance && got <= expected, what, got, expected);
+	}
+	else
+	{
+		check_near(got, expected, tolerance, what);
+	}
+}
+
+
+static void check_input_round_trip()
+{
+	const float32 pitches[] = { 0.0f, -c_pi * 0.5f, c_pi * 0.5f, -0.3f, 85.0f * c_deg_to_rad, 0.0001f };
+	const float32 yaws[] = { 0.0f, -c_pi, c_pi, -0.5f, c_pi * 3.0f, -c_pi * 3.0f + 0.1f, 100.0f, -100.0f };
+	const uint32 ids[] = { 0, 1, 0x7fffffff, 0xffffffff };
+
+	uint8 buffer[c_packet_budget_per_tick];
+	for (uint32 i = 0; i < sizeof(pitches) / sizeof(pitches[0]); ++i)
+	{
+		for (uint32 j = 0; j < sizeof(yaws) / sizeof(yaws[0]); ++j)
+		{
+			uint32 buttons = (i * 7 + j) & 31;
+			Player_Input input = {};
+			input.up = buttons & 1;
+			input.down = (buttons >> 1) & 1;
+			input.left = (buttons >> 2) & 1;
+			input.right = (buttons >> 3) & 1;
+			input.jump = (buttons >> 4) & 1;
+			input.pitch = pitches[i];
+			input.yaw = yaws[j];
+			uint32 prediction_id = ids[(i + j) % 4];
+			uint32 ack_sequence = ids[(i + j + 1) % 4];
+
+			uint32 size = Net::client_msg_input_write(buffer, &input, prediction_id, ack_sequence);
+
+			Net::Client_Message type;
+			Player_Input read_input;
+			uint32 read_prediction_id;
+			bool32 read_has_ack;
+			uint32 read_ack_sequence;
+			check(Net::client_msg_type_read(buffer, size, &type) && type == Net::Client_Message::Input, "input type");
+			check(Net::client_msg_input_read(buffer, size, &read_input, &read_prediction_id, &read_has_ack, &read_ack_sequence), "input read");
+			// buttons come back as any non-zero value, not necessarily 1
+			check(	(read_input.up != 0) == (input.up != 0) &&
+					(read_input.down != 0) == (input.down != 0) &&
+					(read_input.left != 0) == (input.left != 0) &&
+					(read_input.right != 0) == (input.right != 0) &&
+					(read_input.jump != 0) == (input.jump != 0), "input buttons");
+			// ids are rebuilt against whatever the server has that's nearest, here the id itself
+			check(	Net::sequence_expand(read_prediction_id, prediction_id) == prediction_id &&
+					(read_has_ack != 0) == (ack_sequence != 0) &&
+					Net::sequence_expand(read_ack_sequence, ack_sequence) == ack_sequence, "input ids");
+			check_near(read_input.pitch, input.pitch, c_angle_tolerance, "input pitch");
+			check_angle_near(read_input.yaw, input.yaw, c_angle_tolerance, "input yaw");
+			check(read_input.yaw >= -c_pi && read_input.yaw <= c_pi, "input yaw wrapped", read_input.yaw, input.yaw);
+
+			// the client predicts with player_input_quantise's values, which must be exactly what the server reads
+			Player_Input quantised_input = input;
+			Net::player_input_quantise(&quantised_input);
+			check(quantised_input.pitch == read_input.pitch && quantised_input.yaw == read_input.yaw, "player_input_quantise matches the server", quantised_input.yaw, read_input.yaw);
+
+			for (uint32 short_size = 0; short_size < size; ++short_size)
+			{
+				check(	!Net::client_msg_type_read(buffer, short_size, &type) ||
+						!Net::client_msg_input_read(buffer, short_size, &read_input, &read_prediction_id, &read_has_ack, &read_ack_sequence), "short input rejected", (float32)short_size);
+			}
+		}
+	}
+
+	Net::Client_Message type;
+	uint32 size = Net::client_msg_join_write(buffer);
+	check(Net::client_msg_type_read(buffer, size, &type) && type == Net::Client_Message::Join, "join type");
+	check(!Net::client_msg_type_read(buffer, 0, &type), "empty packet rejected");
+	size = Net::client_msg_leave_write(buffer);
+	check(Net::client_msg_type_read(buffer, size, &type) && type == Net::Client_Message::Leave, "leave type");
+	buffer[0] = 0xff; // the type bits hold a value that isn't a message
+	check(!Net::client_msg_type_read(buffer, size, &type), "unknown client message type rejected");
+}
+
+static void check_sequence_expand()
+{
+	struct Expand_Case
+	{
+		uint32 value;
+		uint32 reference;
+	};
+	const Expand_Case cases[] =
+	{
+		{ 0, 0 },
+		{ 1, 0 },
+		{ 65535, 0 }, // nearest would be -1, but ids never go below 0
+		{ 32767, 0 },
+		{ 65541, 65530 }, // the low bits wrapped ahead of the reference
+		{ 65530, 65541 }, // and behind it
+		{ 100000, 100000 + 32767 },
+		{ 100000, 100000 - 32767 },
+		{ 0xffffffff, 0xfffffff0 },
+		{ 3, 0xfffffff0 }, // wrapped all the way round
+	};
+	for (uint32 i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+	{
+		uint32 low_bits = cases[i].value & ((1u << Net::c_short_sequence_bits) - 1);
+		uint32 expanded = Net::sequence_expand(low_bits, cases[i].reference);
+		check(expanded == cases[i].value, "sequence expanded to the nearest value", (float32)expanded, (float32)cases[i].value);
+	}
+}
+
+static void check_join_result_round_trip()
+{
+	uint8 buffer[c_packet_budget_per_tick];
+	const uint32 max_players[] = { 1, 32, c_max_clients };
+	const int32 tick_rates[] = { 1, 30, c_max_server_tick_rate };
+	for (uint32 i = 0; i < 3; ++i)
+	{
+		uint32 slot = max_players[i] - 1;
+		uint32 size = Net::server_msg_join_result_write(buffer, true, slot, max_players[i], tick_rates[i]);
+
+		Net::Server_Message type;
+		bool32 success = false;
+		uint32 read_slot = 0;
+		uint32 read_max_players = 0;
+		int32 read_tick_rate = 0;
+		check(Net::server_msg_type_read(buffer, size, &type) && type == Net::Server_Message::Join_Result, "join result type");
+		check(Net::server_msg_join_result_read(buffer, size, &success, &read_slot, &read_max_players, &read_tick_rate), "join result read");
+		check(success && read_slot == slot && read_max_players == max_players[i] && read_tick_rate == tick_rates[i], "join result values");
+
+		for (uint32 short_size = 0; short_size < size; ++short_size)
+		{
+			read_slot = 1234;
+			bool32 is_read =	Net::server_msg_type_read(buffer, short_size, &type) &&
+								Net::server_msg_join_result_read(buffer, short_size, &success, &read_slot, &read_max_players, &read_tick_rate);
+			check(!is_read && read_slot == 1234, "short join result rejected and left alone", (float32)short_size);
+		}
+	}
+
+	uint32 size = Net::server_msg_join_result_write(buffer, false, 0, 1, 0);
+	bool32 success = true;
+	uint32 read_slot;
+	uint32 read_max_players;
+	int32 read_tick_rate;
+	check(Net::server_msg_join_result_read(buffer, size, &success, &read_slot, &read_max_players, &read_tick_rate) && !success, "rejected join result");
+}
+
+
+struct Check_State_Packet
+{
+	uint8 data[c_packet_budget_per_tick];
+	uint32 size;
+};
+
+// every fragment of a snapshot as the server would send it, returns the number of packets
+static uint32 state_packets_write(	Net::Snapshot* snapshot, Net::Snapshot* baseline, uint32 prediction_id, Player_Extra_State* extra_state,
+									Check_State_Packet* out_packets)
+{
+	uint8 players_buffers[Net::c_max_state_fragments][c_packet_budget_per_tick];
+	uint32 players_sizes[Net::c_max_state_fragments];
+	uint32 fragment_mask = 0;
+	uint32 num_fragments = Net::state_num_fragments(c_check_max_players);
+	for (uint32 fragment = 0; fragment < num_fragments; ++fragment)
+	{
+		players_sizes[fragment] = Net::server_msg_state_players_write(players_buffers[fragment], snapshot, baseline, fragment, c_check_max_players);
+		if (players_sizes[fragment])
+		{
+			fragment_mask |= 1 << fragment;
+		}
+	}
+
+	uint32 num_packets = 0;
+	for (uint32 fragment = 0; fragment < num_fragments; ++fragment)
+	{
+		if (!(fragment_mask & (1 << fragment)) && (fragment_mask || fragment))
+		{
+			continue;
+		}
+		out_packets[num_packets].size = Net::server_msg_state_write(
+			out_packets[num_packets].data,
+			snapshot->sequence,
+			baseline ? baseline->sequence : 0,
+			prediction_id,
+			extra_state,
+			fragment_mask,
+			fragment,
+			players_buffers[fragment],
+			players_sizes[fragment]);
+		++num_packets;
+	}
+	return num_packets;
+}
+
+static void check_snapshot_near(Net::Snapshot* got, Net::Snapshot* expected, const char* what)
+{
+	for (uint32 i = 0; i < c_check_max_players; ++i)
+	{
+		check(got->players_present[i] == expected->players_present[i], what);
+		if (!expected->players_present[i])
+		{
+			continue;
+		}
+
+		Player_Snapshot_State* got_state = &got->player_snapshot_states[i];
+		Player_Snapshot_State* expected_state = &expected->player_snapshot_states[i];
+		check_quantised_near(got_state->position.x, expected_state->position.x, -c_player_position_extent, c_player_position_extent, c_position_tolerance, what);
+		check_quantised_near(got_state->position.y, expected_state->position.y, -c_player_position_extent, c_player_position_extent, c_position_tolerance, what);
+		check_quantised_near(got_state->position.z, expected_state->position.z, -c_player_position_extent, c_player_position_extent, c_position_tolerance, what);
+		check_near(got_state->pitch, expected_state->pitch, c_angle_tolerance, what);
+		check_angle_near(got_state->yaw, expected_state->yaw, c_angle_tolerance, what);
+		if (expected_state->position.z == 0.0f)
+		{
+			check(got_state->position.z == 0.0f, "grounded z comes back as exactly 0", got_state->position.z);
+		}
+	}
+}
+
+// reads the packets in order, cutting each short at every length first, which must all be rejected
+// without disturbing what the full packet then decodes to
+static void state_packets_read(Check_State_Packet* packets, uint32 num_packets, Net::Snapshot_History* history, uint32 expected_prediction_id, Player_Extra_State* expected_extra_state)
+{
+	for (uint32 packet_index = 0; packet_index < num_packets; ++packet_index)
+	{
+		Check_State_Packet* packet = &packets[packet_index];
+		uint32 sequence;
+		uint32 prediction_id;
+		Player_Extra_State extra_state;
+		bool32 is_complete = false;
+		for (uint32 short_size = 0; short_size < packet->size; ++short_size)
+		{
+			Net::Server_Message type;
+			bool32 is_read =	Net::server_msg_type_read(packet->data, short_size, &type) &&
+								Net::server_msg_state_read(packet->data, short_size, history, &sequence, expected_prediction_id + 3, &prediction_id, &extra_state, c_check_max_players, &is_complete);
+			check(!is_read, "short state rejected", (float32)short_size);
+		}
+
+		Net::Server_Message type;
+		check(Net::server_msg_type_read(packet->data, packet->size, &type) && type == Net::Server_Message::State, "state type");
+		// the client is always a few inputs ahead of what the server has simulated
+		check(Net::server_msg_state_read(packet->data, packet->size, history, &sequence, expected_prediction_id + 3, &prediction_id, &extra_state, c_check_max_players, &is_complete), "state read");
+		check(is_complete == (packet_index == num_packets - 1), "state complete once every fragment is in");
+		check(prediction_id == expected_prediction_id, "state prediction id");
+		check_quantised_near(extra_state.velocity.x, expected_extra_state->velocity.x, -Net::c_velocity_extent, Net::c_velocity_extent, c_velocity_tolerance, "state velocity x");
+		check_quantised_near(extra_state.velocity.y, expected_extra_state->velocity.y, -Net::c_velocity_extent, Net::c_velocity_extent, c_velocity_tolerance, "state velocity y");
+		check_quantised_near(extra_state.velocity.z, expected_extra_state->velocity.z, -Net::c_velocity_extent, Net::c_velocity_extent, c_velocity_tolerance, "state velocity z");
+	}
+}
+
+static void check_state_round_trip(Linear_Allocator* allocator)
+{
+	Net::Snapshot_History server_history;
+	Net::Snapshot_History client_history;
+	Net::snapshot_history_create(&server_history, c_check_max_players, allocator);
+	Net::snapshot_history_create(&client_history, c_check_max_players, allocator);
+
+	// edge values first, then whatever's left spread over the ranges, every third player missing
+	const Player_Snapshot_State edges[] =
+	{
+		{ { -c_player_position_extent, -c_player_position_extent, 0.0f }, -c_pi * 0.5f, -c_pi },
+		{ { c_player_position_extent, c_player_position_extent, c_player_position_extent }, c_pi * 0.5f, c_pi },
+		{ { -0.0004f, 0.0004f, 0.0004f }, 0.0f, 0.0f },
+		{ { -123.4567f, 98.7654f, 1.2345f }, -1.0f, c_pi * 5.0f },
+		{ { 300.0f, -300.0f, 100.0f }, 0.5f, -c_pi * 2.5f },
+		{ { -5432.1098f, 8191.9994f, 2047.0005f }, 0.25f, 1.0f },
+		{ { 20000.0f, -1.0e30f, -20000.0f }, 0.0f, 0.0f }, // out of the world, tick_player never gets here
+	};
+	uint32 num_edges = sizeof(edges) / sizeof(edges[0]);
+
+	Net::Snapshot* snapshot = Net::snapshot_history_push(&server_history, 1);
+	for (uint32 i = 0; i < c_check_max_players; ++i)
+	{
+		snapshot->players_present[i] = (i % 3) != 2 || i < num_edges;
+		if (i < num_edges)
+		{
+			snapshot->player_snapshot_states[i] = edges[i];
+		}
+		else
+		{
+			float32 t = (float32)i / c_check_max_players;
+			snapshot->player_snapshot_states[i].position = vec_3f((t * 16000.0f) - 8000.0f, 8000.0f - (t * 15990.0f), t * 60.0f);
+			snapshot->player_snapshot_states[i].pitch = (t - 0.5f) * c_pi;
+			snapshot->player_snapshot_states[i].yaw = (t * 20.0f) - 10.0f;
+		}
+	}
+	Player_Extra_State extra_state = {};
+	extra_state.velocity = vec_3f(-Net::c_velocity_extent, Net::c_velocity_extent, -40.0f); // the last out of range
+
+	Check_State_Packet packets[Net::c_max_state_fragments];
+	uint32 num_packets = state_packets_write(snapshot, 0, 7, &extra_state, packets);
+	check(num_packets == 2, "a full snapshot sends every fragment", (float32)num_packets, 2.0f);
+	state_packets_read(packets, num_packets, &client_history, 7, &extra_state);
+	check_snapshot_near(Net::snapshot_history_get(&client_history, 1), snapshot, "full snapshot");
+
+	// a delta against it, some players moving, leaving and joining, and the second fragment unchanged
+	Net::Snapshot* baseline = snapshot;
+	snapshot = Net::snapshot_history_push(&server_history, 2);
+	for (uint32 i = 0; i < c_check_max_players; ++i)
+	{
+		snapshot->players_present[i] = baseline->players_present[i];
+		snapshot->player_snapshot_states[i] = baseline->player_snapshot_states[i];
+	}
+	snapshot->player_snapshot_states[0].position.x += 0.5f;
+	snapshot->player_snapshot_states[1].yaw = -c_pi;
+	snapshot->player_snapshot_states[3].position.z = 0.0f;
+	snapshot->players_present[6] = false;
+	snapshot->players_present[8] = true;
+	snapshot->player_snapshot_states[8].position = vec_3f(-1.0f, -2.0f, 3.0f);
+	extra_state.velocity = vec_3f(0.0f, 0.0f, 0.0f);
+
+	num_packets = state_packets_write(snapshot, baseline, 8, &extra_state, packets);
+	check(num_packets == 1, "a delta leaves out unchanged fragments", (float32)num_packets, 1.0f);
+	state_packets_read(packets, num_packets, &client_history, 8, &extra_state);
+	check_snapshot_near(Net::snapshot_history_get(&client_history, 2), snapshot, "delta snapshot");
+
+	// nothing changed at all, a header with no player block
+	Net::Snapshot* unchanged = Net::snapshot_history_push(&server_history, 3);
+	for (uint32 i = 0; i < c_check_max_players; ++i)
+	{
+		unchanged->players_present[i] = snapshot->players_present[i];
+		unchanged->player_snapshot_states[i] = snapshot->player_snapshot_states[i];
+	}
+	num_packets = state_packets_write(unchanged, snapshot, 9, &extra_state, packets);
+	check(num_packets == 1, "an unchanged delta is one packet", (float32)num_packets, 1.0f);
+	state_packets_read(packets, num_packets, &client_history, 9, &extra_state);
+	check_snapshot_near(Net::snapshot_history_get(&client_history, 3), unchanged, "unchanged snapshot");
+}
+
+// a player walking forwards (and jumping now and then) from the origin, well past where positions used to be
+// clamped, then put near the edge of the world and walked into it, every tick sent as a delta against the one
+// before so any drift between the server's state and the client's copy would build up
+static void check_walk_round_trip(Linear_Allocator* allocator)
+{
+	Net::Snapshot_History server_history;
+	Net::Snapshot_History client_history;
+	Net::snapshot_history_create(&server_history, c_check_max_players, allocator);
+	Net::snapshot_history_create(&client_history, c_check_max_players, allocator);
+
+	Player_Snapshot_State state = {};
+	Player_Extra_State extra_state = {};
+	Player_Input input = {};
+	input.up = true;
+	input.yaw = -c_pi * 0.25f; // towards +x and +y
+	Net::player_input_quantise(&input);
+
+	constexpr uint32 c_walk_ticks = 60 * 30; // 600m at full speed, about 420m along each axis
+	constexpr uint32 c_edge_ticks = 5 * 30;
+	Check_State_Packet packets[Net::c_max_state_fragments];
+	uint32 num_mismatches = 0;
+	for (uint32 sequence = 1; sequence <= c_walk_ticks + c_edge_ticks; ++sequence)
+	{
+		if (sequence == c_walk_ticks + 1)
+		{
+			state.position = vec_3f(c_player_position_extent - 20.0f, c_player_position_extent - 10.0f, 0.0f);
+		}
+		input.jump = (sequence % 45) == 0;
+		tick_player(&state, &extra_state, c_check_seconds_per_tick, &input);
+
+		Net::Snapshot* baseline = Net::snapshot_history_get(&server_history, sequence - 1);
+		Net::Snapshot* snapshot = Net::snapshot_history_push(&server_history, sequence);
+		for (uint32 i = 0; i < c_check_max_players; ++i)
+		{
+			snapshot->players_present[i] = i == 0;
+		}
+		snapshot->player_snapshot_states[0] = state;
+
+		uint32 num_packets = state_packets_write(snapshot, baseline, sequence, &extra_state, packets);
+		Player_Snapshot_State* got = 0;
+		for (uint32 packet_index = 0; packet_index < num_packets; ++packet_index)
+		{
+			uint32 read_sequence;
+			uint32 prediction_id;
+			Player_Extra_State read_extra_state;
+			bool32 is_complete = false;
+			if (Net::server_msg_state_read(packets[packet_index].data, packets[packet_index].size, &client_history, &read_sequence, sequence, &prediction_id, &read_extra_state, c_check_max_players, &is_complete) &&
+				is_complete)
+			{
+				got = &Net::snapshot_history_get(&client_history, read_sequence)->player_snapshot_states[0];
+			}
+		}
+		if (sequence == c_walk_ticks)
+		{
+			check(state.position.x > 400.0f && state.position.y > 400.0f, "walked well past where positions used to be clamped", state.position.x, 400.0f);
+		}
+		if (!got ||
+			fabsf(got->position.x - state.position.x) > c_position_tolerance ||
+			fabsf(got->position.y - state.position.y) > c_position_tolerance ||
+			fabsf(got->position.z - state.position.z) > c_position_tolerance ||
+			(state.position.z == 0.0f && got->position.z != 0.0f))
+		{
+			++num_mismatches;
+		}
+	}
+	check(num_mismatches == 0, "walking player's position round trips every tick", (float32)num_mismatches, 0.0f);
+	check(	state.position.x == c_player_position_extent && state.position.y == c_player_position_extent, 
+			"tick_player keeps players in the world", state.position.y, c_player_position_extent);
+}
+
+// nan and infinities can't crash or be undefined, they come out as something in range
+static void check_non_finite_round_trip(Linear_Allocator* allocator)
+{
+	Net::Snapshot_History server_history;
+	Net::Snapshot_History client_history;
+	Net::snapshot_history_create(&server_history, c_check_max_players, allocator);
+	Net::snapshot_history_create(&client_history, c_check_max_players, allocator);
+
+	Net::Snapshot* snapshot = Net::snapshot_history_push(&server_history, 1);
+	for (uint32 i = 0; i < c_check_max_players; ++i)
+	{
+		snapshot->players_present[i] = i == 0;
+	}
+	snapshot->player_snapshot_states[0].position = vec_3f(NAN, INFINITY, -INFINITY);
+	snapshot->player_snapshot_states[0].pitch = NAN;
+	snapshot->player_snapshot_states[0].yaw = INFINITY;
+	Player_Extra_State extra_state = {};
+	extra_state.velocity = vec_3f(NAN, INFINITY, -INFINITY);
+
+	Check_State_Packet packets[Net::c_max_state_fragments];
+	uint32 num_packets = state_packets_write(snapshot, 0, 1, &extra_state, packets);
+	uint32 sequence;
+	uint32 prediction_id;
+	Player_Extra_State read_extra_state;
+	bool32 is_complete = false;
+	check(	num_packets == 1 &&
+			Net::server_msg_state_read(packets[0].data, packets[0].size, &client_history, &sequence, 1, &prediction_id, &read_extra_state, c_check_max_players, &is_complete), 
+			"non finite state read");
+	Player_Snapshot_State* got = &Net::snapshot_history_get(&client_history, 1)->player_snapshot_states[0];
+	check(	got->position.x == 0.0f && got->position.y == c_player_position_extent && got->position.z == -c_player_position_extent, 
+			"non finite positions come back as 0 or the extent");
+	check(	std::isfinite(got->pitch) && std::isfinite(got->yaw) && 
+			std::isfinite(read_extra_state.velocity.x) && std::isfinite(read_extra_state.velocity.y) && std::isfinite(read_extra_state.velocity.z), 
+			"non finite angles and velocity come back finite");
+}
+
+
+int main()
+{
+	Linear_Allocator allocator;
+	linear_allocator_create(&allocator, (Net::snapshot_history_memory_size(c_check_max_players) * 6) + kilobytes(64));
+
+	check_input_round_trip();
+	check_sequence_expand();
+	check_join_result_round_trip();
+	check_state_round_trip(&allocator);
+	check_walk_round_trip(&allocator);
+	check_non_finite_round_trip(&allocator);
+
+	printf("%u of %u checks passed\n", s_num_checks - s_num_failures, s_num_checks);
+	return s_num_failures ? 1 : 0;
+}
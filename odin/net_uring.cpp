@@ -0,0 +1,458 @@
+#include "net_uring.h"
+
+#include "metrics.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+
+namespace Net
+{
+
+
+constexpr uint32 c_uring_sq_entries		= 256;
+constexpr uint32 c_uring_cq_entries		= 1024; // one multishot recv can post a lot of completions between reaps
+constexpr uint32 c_uring_recv_buffers	= 256; // must be a power of 2
+constexpr uint32 c_uring_send_slots		= 256;
+constexpr uint16 c_uring_buffer_group	= 0;
+constexpr uint64 c_uring_recv_user_data	= (uint64)-1; // sends use their slot index
+
+// provided buffers are filled by recvmsg as header, then source address, then payload
+constexpr uint32 c_uring_recv_buffer_size = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + c_packet_budget_per_tick;
+
+struct Uring
+{
+	int fd;
+	SOCKET sock;
+
+	// mapped rings shared with the kernel
+	void* ring_memory;
+	size_t ring_memory_size;
+	io_uring_sqe* sqes;
+	size_t sqes_size;
+
+	uint32* sq_head;
+	uint32* sq_tail;
+	uint32 sq_mask;
+	uint32* sq_array;
+	uint32 sq_local_tail; // sqes written but not yet published to the kernel
+	uint32 num_unsubmitted;
+	bool32 is_enabled; // the first submit enables the ring
+
+	uint32* cq_head;
+	uint32* cq_tail;
+	uint32 cq_mask;
+	io_uring_cqe* cqes;
+
+	// receiving, one multishot recvmsg picks buffers out of the provided buffer ring
+	io_uring_buf_ring* buf_ring;
+	size_t buf_ring_size;
+	uint16 buf_ring_tail;
+	uint8* recv_buffers;
+	msghdr recv_msg;
+	bool32 is_recv_armed;
+	uint32* ready_buffer_ids; // completed receives not yet handed out
+	uint32 ready_head;
+	uint32 ready_tail;
+
+	// sending, packets are copied in so the caller can reuse its buffers straight away
+	uint8* send_buffers;
+	msghdr* send_msgs;
+	iovec* send_iovecs;
+	sockaddr_in* send_addresses;
+	uint32* free_send_slots;
+	uint32 num_free_send_slots;
+};
+
+// publishes any queued sqes and submits them, optionally waiting for completions, on failure errno is
+// left as the syscall set it so a wait cut short by a signal (EINTR) can be told apart
+static bool32 uring_enter(Uring* uring, uint32 min_complete, uint32 flags)
+{
+	if (!uring->is_enabled)
+	{
+		// created disabled, so the thread using it (not necessarily the one which created it) becomes the single issuer
+		if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_ENABLE_RINGS, 0, 0) < 0)
+		{
+			log("[net] io_uring enabling ring failed: %d\n", errno);
+			return false;
+		}
+		uring->is_enabled = true;
+	}
+
+	__atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+
+	int result = (int)syscall(__NR_io_uring_enter, uring->fd, uring->num_unsubmitted, min_complete, flags, 0, 0);
+	if (result < 0)
+	{
+		int error = errno;
+		if (error != EINTR)
+		{
+			log("[net] io_uring_enter() failed: %d\n", error);
+		}
+		errno = error;
+		return false;
+	}
+	uring->num_unsubmitted -= (uint32)result;
+
+	return true;
+}
+
+static io_uring_sqe* uring_get_sqe(Uring* uring)
+{
+	uint32 head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+	if (uring->sq_local_tail - head == c_uring_sq_entries)
+	{
+		uring_submit(uring);
+		head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+		if (uring->sq_local_tail - head == c_uring_sq_entries)
+		{
+			return 0;
+		}
+	}
+
+	uint32 index = uring->sq_local_tail & uring->sq_mask;
+	uring->sq_array[index] = index;
+	++uring->sq_local_tail;
+	++uring->num_unsubmitted;
+
+	io_uring_sqe* sqe = &uring->sqes[index];
+	*sqe = {};
+	return sqe;
+}
+
+static void uring_arm_recv(Uring* uring)
+{
+	io_uring_sqe* sqe = uring_get_sqe(uring);
+	if (!sqe)
+	{
+		return;
+	}
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = uring->sock;
+	sqe->addr = (uint64)&uring->recv_msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = c_uring_buffer_group;
+	sqe->user_data = c_uring_recv_user_data;
+
+	uring->is_recv_armed = true;
+}
+
+// handles everything in the completion queue, receives are put aside for uring_receive
+static void uring_reap(Uring* uring)
+{
+	uint32 head = *uring->cq_head;
+	uint32 tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head)
+	{
+		io_uring_cqe* cqe = &uring->cqes[head & uring->cq_mask];
+
+		if (cqe->user_data == c_uring_recv_user_data)
+		{
+			if (!(cqe->flags & IORING_CQE_F_MORE))
+			{
+				uring->is_recv_armed = false; // kernel stopped it (e.g. ran out of buffers), so it needs arming again
+			}
+
+			if (cqe->flags & IORING_CQE_F_BUFFER)
+			{
+				uint32 buffer_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+				if (cqe->res >= 0)
+				{
+					// every one of these holds a buffer, so this can't overflow
+					uring->ready_buffer_ids[uring->ready_tail & (c_uring_recv_buffers - 1)] = buffer_id;
+					++uring->ready_tail;
+				}
+				else
+				{
+					uring_release_buffer(uring, buffer_id);
+				}
+			}
+			else if (cqe->res == -ENOBUFS)
+			{
+				metrics_add(Metric_Counter::Net_Uring_Out_Of_Buffers);
+			}
+			else if (cqe->res < 0)
+			{
+				log("[net] io_uring recvmsg failed: %d\n", -cqe->res);
+			}
+		}
+		else
+		{
+			if (cqe->res < 0)
+			{
+				log("[net] io_uring sendmsg failed: %d\n", -cqe->res);
+			}
+
+			uring->free_send_slots[uring->num_free_send_slots] = (uint32)cqe->user_data;
+			++uring->num_free_send_slots;
+		}
+	}
+	__atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+bool32 uring_create(Uring** out_uring, SOCKET sock, Linear_Allocator* allocator)
+{
+	// SINGLE_ISSUER arrived in the same kernel (6.0) as multishot recvmsg, so older kernels fail here
+	io_uring_params params = {};
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_R_DISABLED;
+	params.cq_entries = c_uring_cq_entries;
+	int fd = (int)syscall(__NR_io_uring_setup, c_uring_sq_entries, &params);
+	if (fd < 0)
+	{
+		log("[net] io_uring_setup() failed: %d\n", errno);
+		return false;
+	}
+
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		log("[net] io_uring is too old\n");
+		close(fd);
+		return false;
+	}
+
+	size_t sq_size = params.sq_off.array + (params.sq_entries * sizeof(uint32));
+	size_t cq_size = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+	size_t ring_memory_size = sq_size > cq_size ? sq_size : cq_size;
+	void* ring_memory = mmap(0, ring_memory_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	size_t sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqes = mmap(0, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	size_t buf_ring_size = c_uring_recv_buffers * sizeof(io_uring_buf);
+	void* buf_ring = mmap(0, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); // must be page aligned
+	if (ring_memory == MAP_FAILED || sqes == MAP_FAILED || buf_ring == MAP_FAILED)
+	{
+		log("[net] io_uring mmap() failed: %d\n", errno);
+		if (ring_memory != MAP_FAILED)
+		{
+			munmap(ring_memory, ring_memory_size);
+		}
+		if (sqes != MAP_FAILED)
+		{
+			munmap(sqes, sqes_size);
+		}
+		if (buf_ring != MAP_FAILED)
+		{
+			munmap(buf_ring, buf_ring_size);
+		}
+		close(fd);
+		return false;
+	}
+
+	io_uring_buf_reg buf_reg = {};
+	buf_reg.ring_addr = (uint64)buf_ring;
+	buf_reg.ring_entries = c_uring_recv_buffers;
+	buf_reg.bgid = c_uring_buffer_group;
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &buf_reg, 1) < 0)
+	{
+		log("[net] io_uring provided buffer ring not supported: %d\n", errno);
+		munmap(ring_memory, ring_memory_size);
+		munmap(sqes, sqes_size);
+		munmap(buf_ring, buf_ring_size);
+		close(fd);
+		return false;
+	}
+
+	Uring* uring = (Uring*)linear_allocator_alloc(allocator, sizeof(Uring));
+	*uring = {};
+	uring->fd = fd;
+	uring->sock = sock;
+
+	uint8* ring_bytes = (uint8*)ring_memory;
+	uring->ring_memory = ring_memory;
+	uring->ring_memory_size = ring_memory_size;
+	uring->sqes = (io_uring_sqe*)sqes;
+	uring->sqes_size = sqes_size;
+	uring->sq_head = (uint32*)&ring_bytes[params.sq_off.head];
+	uring->sq_tail = (uint32*)&ring_bytes[params.sq_off.tail];
+	uring->sq_mask = *(uint32*)&ring_bytes[params.sq_off.ring_mask];
+	uring->sq_array = (uint32*)&ring_bytes[params.sq_off.array];
+	uring->sq_local_tail = *uring->sq_tail;
+	uring->cq_head = (uint32*)&ring_bytes[params.cq_off.head];
+	uring->cq_tail = (uint32*)&ring_bytes[params.cq_off.tail];
+	uring->cq_mask = *(uint32*)&ring_bytes[params.cq_off.ring_mask];
+	uring->cqes = (io_uring_cqe*)&ring_bytes[params.cq_off.cqes];
+
+	uring->buf_ring = (io_uring_buf_ring*)buf_ring;
+	uring->buf_ring_size = buf_ring_size;
+	uring->recv_buffers = linear_allocator_alloc(allocator, c_uring_recv_buffers * c_uring_recv_buffer_size);
+	uring->ready_buffer_ids = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * c_uring_recv_buffers);
+	for (uint32 i = 0; i < c_uring_recv_buffers; ++i)
+	{
+		uring_release_buffer(uring, i);
+	}
+	uring->recv_msg.msg_namelen = sizeof(sockaddr_in);
+
+	uring->send_buffers = linear_allocator_alloc(allocator, c_uring_send_slots * c_packet_budget_per_tick);
+	uring->send_msgs = (msghdr*)linear_allocator_alloc(allocator, sizeof(msghdr) * c_uring_send_slots);
+	uring->send_iovecs = (iovec*)linear_allocator_alloc(allocator, sizeof(iovec) * c_uring_send_slots);
+	uring->send_addresses = (sockaddr_in*)linear_allocator_alloc(allocator, sizeof(sockaddr_in) * c_uring_send_slots);
+	uring->free_send_slots = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * c_uring_send_slots);
+	for (uint32 i = 0; i < c_uring_send_slots; ++i)
+	{
+		uring->free_send_slots[i] = i;
+	}
+	uring->num_free_send_slots = c_uring_send_slots;
+
+	*out_uring = uring;
+
+	return true;
+}
+
+uint64 uring_memory_size()
+{
+	return	sizeof(Uring) + 
+			(c_uring_recv_buffers * (c_uring_recv_buffer_size + sizeof(uint32))) + 
+			(c_uring_send_slots * (c_packet_budget_per_tick + sizeof(msghdr) + sizeof(iovec) + sizeof(sockaddr_in) + sizeof(uint32)));
+}
+
+void uring_destroy(Uring* uring)
+{
+	// closing the ring cancels anything still in flight
+	close(uring->fd);
+	munmap(uring->ring_memory, uring->ring_memory_size);
+	munmap(uring->sqes, uring->sqes_size);
+	munmap(uring->buf_ring, uring->buf_ring_size);
+}
+
+bool32 uring_send(Uring* uring, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint)
+{
+	if (!uring->num_free_send_slots)
+	{
+		uring_reap(uring);
+	}
+	while (!uring->num_free_send_slots)
+	{
+		// every slot is in flight, wait for the kernel to finish some, receives completing wake this up too
+		// so keep waiting until it's a send
+		if (!uring_enter(uring, 1, IORING_ENTER_GETEVENTS) && errno != EINTR)
+		{
+			log("[net] io_uring out of send slots\n");
+			return false;
+		}
+		uring_reap(uring);
+	}
+
+	io_uring_sqe* sqe = uring_get_sqe(uring);
+	if (!sqe)
+	{
+		log("[net] io_uring submission queue full\n");
+		return false;
+	}
+
+	--uring->num_free_send_slots;
+	uint32 slot = uring->free_send_slots[uring->num_free_send_slots];
+
+	uint8* buffer = &uring->send_buffers[slot * c_packet_budget_per_tick];
+	memcpy(buffer, packet, packet_size);
+
+	sockaddr_in* address = &uring->send_addresses[slot];
+	*address = {};
+	address->sin_family = AF_INET;
+	address->sin_addr.s_addr = htonl(endpoint->address);
+	address->sin_port = htons(endpoint->port);
+
+	iovec* iov = &uring->send_iovecs[slot];
+	iov->iov_base = buffer;
+	iov->iov_len = packet_size;
+
+	msghdr* msg = &uring->send_msgs[slot];
+	*msg = {};
+	msg->msg_name = address;
+	msg->msg_namelen = sizeof(*address);
+	msg->msg_iov = iov;
+	msg->msg_iovlen = 1;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = uring->sock;
+	sqe->addr = (uint64)msg;
+	sqe->len = 1;
+	sqe->user_data = slot;
+
+	return true;
+}
+
+bool32 uring_submit(Uring* uring)
+{
+	if (!uring->num_unsubmitted)
+	{
+		return true;
+	}
+
+	return uring_enter(uring, 0, 0);
+}
+
+bool32 uring_receive(Uring* uring, uint8** out_packet, uint32* out_packet_size, IP_Endpoint* out_from, uint32* out_buffer_id)
+{
+	if (uring->ready_head == uring->ready_tail)
+	{
+		uring_reap(uring);
+	}
+	if (uring->ready_head == uring->ready_tail)
+	{
+		// nothing waiting, so one syscall to submit anything queued and let the kernel post what it has
+		if (!uring->is_recv_armed)
+		{
+			uring_arm_recv(uring);
+		}
+		uring_enter(uring, 0, IORING_ENTER_GETEVENTS);
+		uring_reap(uring);
+
+		if (uring->ready_head == uring->ready_tail)
+		{
+			return false;
+		}
+	}
+
+	uint32 buffer_id = uring->ready_buffer_ids[uring->ready_head & (c_uring_recv_buffers - 1)];
+	++uring->ready_head;
+
+	uint8* buffer = &uring->recv_buffers[buffer_id * c_uring_recv_buffer_size];
+	io_uring_recvmsg_out* recv_out = (io_uring_recvmsg_out*)buffer;
+	sockaddr_in* from = (sockaddr_in*)&recv_out[1];
+	uint8* payload = &buffer[sizeof(io_uring_recvmsg_out) + uring->recv_msg.msg_namelen + uring->recv_msg.msg_controllen];
+	uint32 max_payload_size = c_uring_recv_buffer_size - (uint32)(payload - buffer);
+
+	*out_packet = payload;
+	*out_packet_size = recv_out->payloadlen;
+	if (recv_out->payloadlen > max_payload_size)
+	{
+		*out_packet_size = max_payload_size;
+		metrics_add(Metric_Counter::Net_Uring_Truncated);
+	}
+	*out_from = {};
+	out_from->address = ntohl(from->sin_addr.s_addr);
+	out_from->port = ntohs(from->sin_port);
+	*out_buffer_id = buffer_id;
+
+	return true;
+}
+
+void uring_release_buffer(Uring* uring, uint32 buffer_id)
+{
+	// not buf_ring->bufs, in c++ the kernel header's flexible array trick puts that 8 bytes too far in
+	io_uring_buf* bufs = (io_uring_buf*)uring->buf_ring;
+	io_uring_buf* buf = &bufs[uring->buf_ring_tail & (c_uring_recv_buffers - 1)];
+	buf->addr = (uint64)&uring->recv_buffers[buffer_id * c_uring_recv_buffer_size];
+	buf->len = c_uring_recv_buffer_size;
+	buf->bid = (uint16)buffer_id;
+	++uring->buf_ring_tail;
+	__atomic_store_n(&uring->buf_ring->tail, uring->buf_ring_tail, __ATOMIC_RELEASE);
+}
+
+SOCKET uring_wait_handle(Uring* uring)
+{
+	return uring->fd;
+}
+
+
+} // namespace Net
+#endif // #ifdef __linux__
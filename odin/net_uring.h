@@ -0,0 +1,33 @@
+#pragma once
+
+#include "net.h"
+
+
+
+// io_uring driven udp sockets for linux, used by Net for Socket_Type::Io_Uring
+#ifdef __linux__
+namespace Net
+{
+
+
+struct Uring;
+
+// returns false if the kernel doesn't have what's needed (multishot recvmsg and provided buffer
+// rings, 6.0+), in which case the socket should be used the normal way. Only the thread which
+// first sends or receives on the ring can use it after that
+bool32 uring_create(Uring** out_uring, SOCKET sock, Linear_Allocator* allocator);
+void uring_destroy(Uring* uring);
+// what uring_create takes from its allocator
+uint64 uring_memory_size();
+// queued until uring_submit
+bool32 uring_send(Uring* uring, uint8* packet, uint32 packet_size, IP_Endpoint* endpoint);
+bool32 uring_submit(Uring* uring);
+// the packet is left in the kernel's provided buffer, which goes back with uring_release_buffer
+bool32 uring_receive(Uring* uring, uint8** out_packet, uint32* out_packet_size, IP_Endpoint* out_from, uint32* out_buffer_id);
+void uring_release_buffer(Uring* uring, uint32 buffer_id);
+// the ring's fd, readable when there are completions, receives must already be armed by a uring_receive
+SOCKET uring_wait_handle(Uring* uring);
+
+
+} // namespace Net
+#endif // #ifdef __linux__
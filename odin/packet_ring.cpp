@@ -0,0 +1,111 @@
+#include "packet_ring.h"
+
+
+
+struct Packet_Ring_Header
+{
+	uint32 size; // of the whole entry including header and padding
+	uint32 is_free;
+};
+
+static_assert(sizeof(Packet_Ring_Header) == 8, "entries are 8 byte aligned, so any gap at the end of the ring fits a header");
+
+static uint32 packet_ring_entry_size(uint32 size)
+{
+	return (sizeof(Packet_Ring_Header) + size + 7) & ~7u;
+}
+
+
+void packet_ring_create(Packet_Ring* ring, uint32 capacity, Linear_Allocator* allocator)
+{
+	assert((capacity & 7) == 0);
+
+	*ring = {};
+	ring->bytes = linear_allocator_alloc(allocator, capacity);
+	ring->capacity = capacity;
+}
+
+uint8* packet_ring_alloc(Packet_Ring* ring, uint32 size)
+{
+	uint32 entry_size = packet_ring_entry_size(size);
+
+	if (!ring->used)
+	{
+		ring->head = 0;
+		ring->tail = 0;
+	}
+
+	if (ring->head >= ring->tail && (ring->used == 0 || ring->head != ring->tail))
+	{
+		// free space is after head, then before tail
+		if (entry_size > ring->capacity - ring->head)
+		{
+			if (entry_size > ring->tail)
+			{
+				return 0;
+			}
+
+			// pad out the end of the ring and wrap
+			uint32 padding_size = ring->capacity - ring->head;
+			if (padding_size)
+			{
+				Packet_Ring_Header* padding = (Packet_Ring_Header*)&ring->bytes[ring->head];
+				padding->size = padding_size;
+				padding->is_free = true;
+				ring->used += padding_size;
+			}
+			ring->head = 0;
+		}
+	}
+	else if (entry_size > ring->tail - ring->head)
+	{
+		// free space is only between head and tail
+		return 0;
+	}
+
+	Packet_Ring_Header* header = (Packet_Ring_Header*)&ring->bytes[ring->head];
+	header->size = entry_size;
+	header->is_free = false;
+	ring->used += entry_size;
+	ring->head += entry_size;
+	if (ring->head == ring->capacity)
+	{
+		ring->head = 0;
+	}
+
+	return (uint8*)&header[1];
+}
+
+void packet_ring_trim(Packet_Ring* ring, uint8* data, uint32 size)
+{
+	Packet_Ring_Header* header = &((Packet_Ring_Header*)data)[-1];
+	uint32 entry_size = packet_ring_entry_size(size);
+	uint32 offset = (uint32)((uint8*)header - ring->bytes);
+	assert(((offset + header->size) % ring->capacity) == ring->head);
+
+	ring->used -= header->size - entry_size;
+	header->size = entry_size;
+	ring->head = offset + entry_size;
+}
+
+void packet_ring_free(Packet_Ring* ring, uint8* data)
+{
+	Packet_Ring_Header* header = &((Packet_Ring_Header*)data)[-1];
+	header->is_free = true;
+
+	while (ring->used)
+	{
+		Packet_Ring_Header* tail = (Packet_Ring_Header*)&ring->bytes[ring->tail];
+		if (!tail->is_free)
+		{
+			break;
+		}
+
+		ring->used -= tail->size;
+		ring->tail += tail->size;
+		if (ring->tail == ring->capacity)
+		{
+			ring->tail = 0;
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "core.h"
+
+
+
+// variable sized packets packed one after another in a byte ring, each behind an 8 byte header and
+// padded to 8 bytes, so a small packet takes a few dozen bytes rather than a whole c_packet_budget_per_tick.
+// Packets can be freed in any order, the space only comes back as the oldest ones are freed
+struct Packet_Ring
+{
+	uint8* bytes;
+	uint32 capacity; // bytes, a multiple of 8
+	uint32 head; // where the next entry goes
+	uint32 tail; // oldest entry
+	uint32 used; // bytes between tail and head, to tell full from empty
+};
+
+void	packet_ring_create(Packet_Ring* ring, uint32 capacity, Linear_Allocator* allocator);
+// returns 0 when there's no room
+uint8*	packet_ring_alloc(Packet_Ring* ring, uint32 size);
+// gives back the unused end of the most recent alloc
+void	packet_ring_trim(Packet_Ring* ring, uint8* data, uint32 size);
+void	packet_ring_free(Packet_Ring* ring, uint8* data);
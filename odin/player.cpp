@@ -1,5 +1,7 @@
 #include "player.h"
 
+#include "profile.h"
+
 #include <math.h>
 
 
@@ -15,6 +17,8 @@ void tick_player(	Player_Snapshot_State* player_snapshot_state,
 					float32 dt, 
 					Player_Input* player_input)
 {
+	PROFILE_SCOPE("tick_player");
+
 	// get desired movement direction, based on wasd input
 	float32 cos_yaw = cosf(player_input->yaw);
 	float32 sin_yaw = sinf(player_input->yaw);
@@ -84,7 +88,6 @@ void tick_player(	Player_Snapshot_State* player_snapshot_state,
 		Vec_3f position_delta = vec_3f_mul(vec_3f_add(velocity, final_velocity), 0.5f * dt);
 
 		player_snapshot_state->position = vec_3f_add(player_snapshot_state->position, position_delta);
-		player_snapshot_state->position.z = f32_max(player_snapshot_state->position.z, 0.0f);
 
 		player_extra_state->velocity = final_velocity;
 	}
@@ -93,4 +96,8 @@ void tick_player(	Player_Snapshot_State* player_snapshot_state,
 		player_snapshot_state->position = vec_3f_add(player_snapshot_state->position, vec_3f_mul(velocity, dt));
 		player_extra_state->velocity = velocity;
 	}
+
+	player_snapshot_state->position.x = f32_clamp(player_snapshot_state->position.x, -c_player_position_extent, c_player_position_extent);
+	player_snapshot_state->position.y = f32_clamp(player_snapshot_state->position.y, -c_player_position_extent, c_player_position_extent);
+	player_snapshot_state->position.z = f32_clamp(player_snapshot_state->position.z, 0.0f, c_player_position_extent);
 }
\ No newline at end of file
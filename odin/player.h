@@ -5,6 +5,10 @@
 
 
 
+// players are kept within [-extent, extent] in x and y and [0, extent] in z, float32 still has better than
+// 1mm precision out here, and state messages are sized to carry any position in it
+constexpr float32 c_player_position_extent = 8192.0f;
+
 struct Player_Input
 {
 	bool32 up, down, left, right, jump;
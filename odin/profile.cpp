@@ -0,0 +1,280 @@
+#include "profile.h"
+
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <time.h>
+
+
+
+constexpr uint32 c_profile_spare_threads = 8; // zone buffers for threads which start after the first capture
+
+struct Profile_Zone
+{
+	const char* name;
+	int64 start; // clock_now()
+	int64 end;
+};
+
+// written only by its own thread, read by the trace writer once the capture is over
+struct Profile_Thread
+{
+	Profile_Zone* zones; // from the profiler's allocator when the thread first records a zone, 0 if it ran out
+	std::atomic<uint32> num_zones;
+	std::atomic<uint32> generation; // which capture the zones are from
+	uint32 num_dropped;
+	char name[32];
+};
+
+struct Profiler
+{
+	std::mutex threads_mutex; // for adding threads and handing out zone buffers
+	Linear_Allocator allocator; // for zone buffers, created when the first capture starts
+	bool32 has_allocator;
+	Profile_Thread threads[c_profile_max_threads]; // never handed back, processes start a bounded number of threads
+	std::atomic<uint32> num_threads;
+	std::atomic<uint32> requested_ticks;
+	std::atomic_bool is_writing;
+	std::thread writer;
+	// only touched by the thread calling profile_tick
+	uint32 ticks_remaining;
+	uint32 last_generation;
+	int64 capture_start;
+};
+
+std::atomic<uint32> g_profile_capture_generation;
+static Profiler s_profiler;
+static thread_local Profile_Thread* t_profile_thread;
+
+
+// 0 if there are no more threads to be had
+static Profile_Thread* profile_thread(const char* name)
+{
+	if (t_profile_thread)
+	{
+		return t_profile_thread;
+	}
+
+	std::lock_guard<std::mutex> lock(s_profiler.threads_mutex);
+	uint32 thread_index = s_profiler.num_threads.load(std::memory_order_relaxed);
+	if (thread_index == c_profile_max_threads)
+	{
+		return 0;
+	}
+
+	Profile_Thread* thread = &s_profiler.threads[thread_index];
+	thread->zones = 0;
+	thread->num_zones.store(0, std::memory_order_relaxed);
+	thread->generation.store(0, std::memory_order_relaxed);
+	thread->num_dropped = 0;
+	if (name)
+	{
+		snprintf(thread->name, sizeof(thread->name), "%s", name);
+	}
+	else
+	{
+		snprintf(thread->name, sizeof(thread->name), "thread %u", thread_index);
+	}
+	s_profiler.num_threads.store(thread_index + 1, std::memory_order_release);
+	t_profile_thread = thread;
+	return thread;
+}
+
+void profile_thread_name(const char* name)
+{
+	profile_thread(name);
+}
+
+void profile_zone_end(const char* name, int64 start, uint32 generation)
+{
+	int64 end = clock_now();
+
+	// zones still open when the capture ended are left out
+	if (g_profile_capture_generation.load(std::memory_order_acquire) != generation)
+	{
+		return;
+	}
+
+	Profile_Thread* thread = profile_thread(0);
+	if (!thread)
+	{
+		return;
+	}
+
+	// each thread starts its buffer afresh with its first zone of a capture
+	if (thread->generation.load(std::memory_order_relaxed) != generation)
+	{
+		if (!thread->zones)
+		{
+			std::lock_guard<std::mutex> lock(s_profiler.threads_mutex);
+			uint64 zones_size = sizeof(Profile_Zone) * c_profile_max_zones_per_thread;
+			if (s_profiler.allocator.bytes_remaining >= zones_size)
+			{
+				thread->zones = (Profile_Zone*)linear_allocator_alloc(&s_profiler.allocator, zones_size);
+			}
+		}
+		thread->num_zones.store(0, std::memory_order_relaxed);
+		thread->num_dropped = 0;
+		thread->generation.store(generation, std::memory_order_release);
+	}
+
+	uint32 num_zones = thread->num_zones.load(std::memory_order_relaxed);
+	if (!thread->zones || num_zones == c_profile_max_zones_per_thread)
+	{
+		++thread->num_dropped;
+		return;
+	}
+	Profile_Zone* zone = &thread->zones[num_zones];
+	zone->name = name;
+	zone->start = start;
+	zone->end = end;
+	thread->num_zones.store(num_zones + 1, std::memory_order_release);
+}
+
+// names are escaped for json, control characters are left out
+static void profile_json_string_write(FILE* file, const char* s)
+{
+	fputc('"', file);
+	for (; *s; ++s)
+	{
+		if (*s == '"' || *s == '\\')
+		{
+			fputc('\\', file);
+			fputc(*s, file);
+		}
+		else if ((uint8)*s >= ' ')
+		{
+			fputc(*s, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static void profile_trace_write(uint32 generation, int64 capture_start, int64 capture_end)
+{
+	char file_name[64];
+	time_t now = time(0);
+	tm local_now;
+#ifdef __linux__
+	localtime_r(&now, &local_now);
+#else
+	localtime_s(&local_now, &now);
+#endif // #ifdef __linux__
+	strftime(file_name, sizeof(file_name), "odin_trace_%Y%m%d_%H%M%S.json", &local_now);
+	FILE* file = file_open(file_name, "wb");
+	if (!file)
+	{
+		log("[profile] failed to open %s\n", file_name);
+		s_profiler.is_writing.store(false, std::memory_order_release);
+		return;
+	}
+
+	// timestamps are microseconds from the start of the capture
+	float64 clock_ticks_per_us = clock_frequency() / 1000000.0;
+	uint32 num_zones_written = 0;
+	uint32 num_dropped = 0;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"capture\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":0,\"dur\":%.3f}", (capture_end - capture_start) / clock_ticks_per_us);
+	uint32 num_threads = s_profiler.num_threads.load(std::memory_order_acquire);
+	for (uint32 thread_index = 0; thread_index < num_threads; ++thread_index)
+	{
+		Profile_Thread* thread = &s_profiler.threads[thread_index];
+		uint32 tid = thread_index + 1;
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":", tid);
+		profile_json_string_write(file, thread->name);
+		fprintf(file, "}}");
+		if (thread->generation.load(std::memory_order_acquire) != generation)
+		{
+			continue;
+		}
+
+		uint32 num_zones = thread->num_zones.load(std::memory_order_acquire);
+		for (uint32 i = 0; i < num_zones; ++i)
+		{
+			Profile_Zone* zone = &thread->zones[i];
+			fprintf(file, ",\n{\"name\":");
+			profile_json_string_write(file, zone->name);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				tid, (zone->start - capture_start) / clock_ticks_per_us, (zone->end - zone->start) / clock_ticks_per_us);
+		}
+		num_zones_written += num_zones;
+		num_dropped += thread->num_dropped;
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	if (num_dropped)
+	{
+		log("[profile] %u zones dropped, more than %u on a thread or no buffer left for it\n", num_dropped, c_profile_max_zones_per_thread);
+	}
+	log("[profile] wrote %u zones to %s\n", num_zones_written, file_name);
+	s_profiler.is_writing.store(false, std::memory_order_release);
+}
+
+void profile_capture_request(uint32 num_ticks)
+{
+	s_profiler.requested_ticks.store(num_ticks, std::memory_order_relaxed);
+}
+
+void profile_tick()
+{
+	if (s_profiler.ticks_remaining)
+	{
+		--s_profiler.ticks_remaining;
+		if (!s_profiler.ticks_remaining)
+		{
+			// the buffers are left alone until the writer is done, as another capture won't start till then
+			uint32 generation = g_profile_capture_generation.load(std::memory_order_relaxed);
+			g_profile_capture_generation.store(0, std::memory_order_release);
+			s_profiler.is_writing.store(true, std::memory_order_relaxed);
+			s_profiler.writer = std::thread(&profile_trace_write, generation, s_profiler.capture_start, clock_now());
+		}
+		return;
+	}
+
+	if (!s_profiler.requested_ticks.load(std::memory_order_relaxed) || s_profiler.is_writing.load(std::memory_order_acquire))
+	{
+		return;
+	}
+
+	uint32 num_ticks = s_profiler.requested_ticks.exchange(0, std::memory_order_relaxed);
+	if (s_profiler.writer.joinable())
+	{
+		s_profiler.writer.join();
+	}
+	log("[profile] capturing %u ticks\n", num_ticks);
+	if (!s_profiler.has_allocator)
+	{
+		// threads name themselves as they start, so most are known by now
+		std::lock_guard<std::mutex> lock(s_profiler.threads_mutex);
+		uint32 num_threads = s_profiler.num_threads.load(std::memory_order_relaxed) + c_profile_spare_threads;
+		if (num_threads > c_profile_max_threads)
+		{
+			num_threads = c_profile_max_threads;
+		}
+		linear_allocator_create(&s_profiler.allocator, sizeof(Profile_Zone) * c_profile_max_zones_per_thread * num_threads);
+		s_profiler.has_allocator = true;
+	}
+	++s_profiler.last_generation;
+	if (!s_profiler.last_generation)
+	{
+		s_profiler.last_generation = 1;
+	}
+	s_profiler.ticks_remaining = num_ticks;
+	s_profiler.capture_start = clock_now();
+	g_profile_capture_generation.store(s_profiler.last_generation, std::memory_order_release);
+}
+
+void profile_shutdown()
+{
+	// a capture still running is cut short and written out
+	if (s_profiler.ticks_remaining)
+	{
+		s_profiler.ticks_remaining = 1;
+		profile_tick();
+	}
+	if (s_profiler.writer.joinable())
+	{
+		s_profiler.writer.join();
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "core.h"
+
+#include <atomic>
+
+
+
+// PROFILE_SCOPE("name") times from there to the end of the scope, but only while a capture is running,
+// otherwise it's one relaxed load. A capture runs for a number of ticks (see profile_tick), each thread's
+// zones going into its own buffer, then they're written out on a thread of its own as chrome trace json
+// (chrome://tracing or ui.perfetto.dev), named odin_trace_<date>_<time>.json in the working directory.
+// Names must outlive the capture, e.g. be literals
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) Profile_Scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+constexpr uint32 c_profile_max_threads			= 128;
+constexpr uint32 c_profile_max_zones_per_thread	= 128 * 1024; // per capture, the rest are dropped
+
+extern std::atomic<uint32> g_profile_capture_generation; // 0 while not capturing
+
+// the thread's name in traces, call as the thread starts
+void	profile_thread_name(const char* name);
+// starts a capture of num_ticks at the next profile_tick, safe to call from a signal handler
+void	profile_capture_request(uint32 num_ticks);
+// call once per tick (or frame) from one thread, which is what captures are counted in
+void	profile_tick();
+// waits for the last trace to be written
+void	profile_shutdown();
+void	profile_zone_end(const char* name, int64 start, uint32 generation);
+
+struct Profile_Scope
+{
+	const char* name;
+	int64 start;
+	uint32 generation;
+
+	Profile_Scope(const char* in_name)
+	{
+		name = in_name;
+		start = 0;
+		generation = g_profile_capture_generation.load(std::memory_order_relaxed);
+		if (generation)
+		{
+			start = clock_now();
+		}
+	}
+
+	// for zones which turn out to have nothing in, like a receive which found no packets
+	void discard()
+	{
+		generation = 0;
+	}
+
+	~Profile_Scope()
+	{
+		if (generation)
+		{
+			profile_zone_end(name, start, generation);
+		}
+	}
+};
@@ -1,192 +1,1869 @@
 #include "server.h"
 
 #include "core.h"
+#include "metrics.h"
 #include "net.h"
 #include "net_msgs.h"
 #include "player.h"
+#include "profile.h"
+#include "timer_wheel.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 
-void server_main(std::atomic_bool* should_run)
+
+constexpr uint32 c_receive_batch_size			= 64;
+constexpr uint32 c_client_msg_queue_capacity	= 4096; // queue from each receive shard, must be a power of 2
+constexpr uint32 c_max_tick_phases				= 8;
+
+// a client message decoded off the wire, so receive shards can hand them to the dispatcher, and it to rooms
+struct Client_Msg_Record
+{
+	Net::Client_Message type;
+	Net::IP_Endpoint from;
+	int64 receive_time; // clock_now() when it came off the socket
+	uint32 slot; // filled in by the dispatcher when it's routed to a room
+	Player_Input input;
+	uint32 prediction_id; // low bits as sent, the room rebuilds it and ack_sequence with Net::sequence_expand
+	bool32 has_ack;
+	uint32 ack_sequence;
+};
+
+// single producer (a receive shard, or the dispatcher) single consumer (the dispatcher, or a room)
+struct Client_Msg_Queue
+{
+	alignas(64) std::atomic<uint32> head; // next record to write
+	alignas(64) std::atomic<uint32> tail; // next record to read
+	Client_Msg_Record* records;
+	uint32 mask; // capacity - 1
+};
+
+struct Receive_Shard
+{
+	Net::Socket* sock; // its own, or with a single shard possibly shared with the dispatcher, which only sends on it
+	Client_Msg_Queue* queue;
+	Net::Packet_View* packet_views;
+	Client_Msg_Record* records;
+	std::atomic_bool* should_run;
+};
+
+// capacity must be a power of 2
+static Client_Msg_Queue* client_msg_queue_create(uint32 capacity, Linear_Allocator* allocator)
+{
+	uint8* memory = linear_allocator_alloc(allocator, sizeof(Client_Msg_Queue) + 63);
+	Client_Msg_Queue* queue = (Client_Msg_Queue*)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+	queue->head.store(0, std::memory_order_relaxed);
+	queue->tail.store(0, std::memory_order_relaxed);
+	queue->records = (Client_Msg_Record*)linear_allocator_alloc(allocator, sizeof(Client_Msg_Record) * capacity);
+	queue->mask = capacity - 1;
+	return queue;
+}
+
+static bool32 client_msg_queue_push(Client_Msg_Queue* queue, Client_Msg_Record* record)
+{
+	uint32 head = queue->head.load(std::memory_order_relaxed);
+	if (head - queue->tail.load(std::memory_order_acquire) == queue->mask + 1)
+	{
+		return false;
+	}
+
+	queue->records[head & queue->mask] = *record;
+	queue->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+static uint32 client_msg_queue_pop(Client_Msg_Queue* queue, Client_Msg_Record* out_records, uint32 max_records)
+{
+	uint32 tail = queue->tail.load(std::memory_order_relaxed);
+	uint32 num_records = queue->head.load(std::memory_order_acquire) - tail;
+	if (num_records > max_records)
+	{
+		num_records = max_records;
+	}
+
+	for (uint32 i = 0; i < num_records; ++i)
+	{
+		out_records[i] = queue->records[(tail + i) & queue->mask];
+	}
+	queue->tail.store(tail + num_records, std::memory_order_release);
+
+	return num_records;
+}
+
+constexpr uint32 c_input_queue_capacity = 8; // must be a power of 2, inputs further ahead than this push the oldest out
+constexpr uint32 c_input_queue_mask = c_input_queue_capacity - 1;
+// a missing input is waited for (repeating the last one) until the newest is this far past it, so inputs
+// arriving out of order still get simulated, and only then treated as lost
+constexpr uint32 c_input_queue_target_depth = 2;
+static_assert(c_input_queue_target_depth < c_input_queue_capacity - 1, "a missing input must be given up on before the ring could overwrite it");
+
+// a client's inputs waiting to be simulated, one each tick in prediction_id order, so however 
+// many arrive at once each client costs one tick_player per tick
+struct Input_Queue
+{
+	Player_Input inputs[c_input_queue_capacity];
+	uint32 prediction_ids[c_input_queue_capacity]; // which input is in each entry, so stale ones can be told apart
+	uint32 next_prediction_id; // the next one to simulate
+	uint32 newest_prediction_id;
+	bool32 is_started; // nothing is simulated until the first input arrives
+	Player_Input last_input;
+};
+
+static void input_queue_reset(Input_Queue* queue)
+{
+	*queue = {};
+	for (uint32 i = 0; i < c_input_queue_capacity; ++i)
+	{
+		queue->prediction_ids[i] = (uint32)-1;
+	}
+}
+
+static void input_queue_push(Input_Queue* queue, uint32 prediction_id, Player_Input* input)
+{
+	if (!queue->is_started)
+	{
+		queue->is_started = true;
+		queue->next_prediction_id = prediction_id;
+		queue->newest_prediction_id = prediction_id;
+	}
+
+	// ids are compared by difference so they still order correctly when they wrap
+	if ((int32)(prediction_id - queue->next_prediction_id) < 0)
+	{
+		return; // too late, this tick has already been simulated with a repeat
+	}
+	if (prediction_id - queue->next_prediction_id >= c_input_queue_capacity)
+	{
+		// client has got too far ahead, skip the oldest rather than let it build up delay
+		queue->next_prediction_id = prediction_id - c_input_queue_capacity + 1;
+	}
+	if ((int32)(prediction_id - queue->newest_prediction_id) > 0)
+	{
+		queue->newest_prediction_id = prediction_id;
+	}
+
+	uint32 index = prediction_id & c_input_queue_mask;
+	queue->inputs[index] = *input;
+	queue->prediction_ids[index] = prediction_id;
+}
+
+// the input to simulate this tick, returns false if there hasn't been one yet
+// when the next input hasn't arrived the last one is repeated, and out_prediction_id is the 
+// one the client should treat the result as coming from
+static bool32 input_queue_pop(Input_Queue* queue, Player_Input* out_input, uint32* out_prediction_id)
+{
+	if (!queue->is_started)
+	{
+		return false;
+	}
+
+	uint32 index = queue->next_prediction_id & c_input_queue_mask;
+	if (queue->prediction_ids[index] == queue->next_prediction_id)
+	{
+		queue->last_input = queue->inputs[index];
+		*out_prediction_id = queue->next_prediction_id;
+		++queue->next_prediction_id;
+	}
+	else if ((int32)(queue->newest_prediction_id - queue->next_prediction_id) > (int32)c_input_queue_target_depth)
+	{
+		// inputs well past it have arrived, so this one was lost (or is very late), skip it
+		*out_prediction_id = queue->next_prediction_id;
+		++queue->next_prediction_id;
+	}
+	else
+	{
+		// client is running behind, or this input may still turn up, repeat without using up its next input
+		*out_prediction_id = queue->next_prediction_id - 1;
+	}
+
+	*out_input = queue->last_input;
+	return true;
+}
+
+// receives a batch of packets and decodes them, returns the number of records
+static uint32 client_msgs_receive(Net::Socket* sock, Net::Packet_View* packet_views, Client_Msg_Record* out_records)
+{
+	Profile_Scope receive_scope("receive");
+	uint32 num_received = Net::socket_receive_views(sock, packet_views, c_receive_batch_size);
+	if (!num_received)
+	{
+		receive_scope.discard();
+		return 0;
+	}
+	int64 receive_time = clock_now();
+
+	uint32 num_records = 0;
+	for (uint32 i = 0; i < num_received; ++i)
+	{
+		uint8* packet = packet_views[i].data;
+		uint32 packet_size = packet_views[i].size;
+		Client_Msg_Record* record = &out_records[num_records];
+		if (!Net::client_msg_type_read(packet, packet_size, &record->type))
+		{
+			metrics_add(Metric_Counter::Client_Msg_Invalid);
+			continue;
+		}
+		record->from = packet_views[i].from;
+		record->receive_time = receive_time;
+
+		switch (record->type)
+		{
+			case Net::Client_Message::Join:
+				metrics_add(Metric_Counter::Client_Msg_Join_Bytes, packet_size);
+			break;
+
+			case Net::Client_Message::Leave:
+				metrics_add(Metric_Counter::Client_Msg_Leave_Bytes, packet_size);
+			break;
+
+			case Net::Client_Message::Input:
+				if (!Net::client_msg_input_read(packet, packet_size, &record->input, &record->prediction_id, &record->has_ack, &record->ack_sequence))
+				{
+					metrics_add(Metric_Counter::Client_Msg_Invalid);
+					continue;
+				}
+				metrics_add(Metric_Counter::Client_Msg_Input_Bytes, packet_size);
+			break;
+		}
+
+		++num_records;
+	}
+
+	Net::socket_release_views(sock, num_received);
+
+	return num_records;
+}
+
+static void receive_shard_main(Receive_Shard* shard)
+{
+	profile_thread_name("receive shard");
+	while (shard->should_run->load(std::memory_order_relaxed))
+	{
+		uint32 num_records = client_msgs_receive(shard->sock, shard->packet_views, shard->records);
+		for (uint32 i = 0; i < num_records; ++i)
+		{
+			if (!client_msg_queue_push(shard->queue, &shard->records[i]))
+			{
+				metrics_add(Metric_Counter::Server_Msgs_Dropped_Shard_Queue);
+				log("[server] receive shard queue full, dropping client message\n");
+			}
+		}
+
+		if (!num_records)
+		{
+			if (Net::socket_wait_handle(shard->sock) == INVALID_SOCKET)
+			{
+				// nothing to wait on (e.g. in process sockets), so just don't spin
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			else
+			{
+				Net::socket_wait(shard->sock, 1);
+			}
+		}
+	}
+}
+
+constexpr uint32 c_num_state_players_buffers = Net::c_snapshot_history_capacity + 1; // one set of player blocks per baseline, plus one for the full snapshot
+constexpr uint32 c_min_state_packets_per_worker = 8; // below this waking workers costs more than it saves
+constexpr uint32 c_state_packets_per_send = 256; // state packets are encoded and sent in batches of up to this many
+
+// what a thread ticking rooms needs to build state packets: player blocks for each baseline in use this
+// tick, encoded once and shared by every client on that baseline, and the batch of packets being built
+struct State_Scratch
+{
+	uint32 num_fragments; // enough for the biggest room
+	uint8* players_buffers; // c_packet_budget_per_tick per fragment per baseline
+	uint32* players_sizes; // per fragment per baseline, 0 if the fragment is left out
+	uint32* players_baselines; // which baseline each set of blocks is for, (uint32)-1 if none yet this tick
+	uint32* players_masks; // which fragments are sent for each baseline
+	uint32* packet_slots; // which client each packet is for
+	uint32* packet_players; // which set of player blocks
+	uint32* packet_fragments;
+	uint8* state_buffers; // c_packet_budget_per_tick per packet
+	uint32* state_sizes;
+	Net::IP_Endpoint* state_endpoints;
+};
+
+static uint64 state_scratch_memory_size(uint32 num_fragments)
+{
+	uint64 players_size = ((c_packet_budget_per_tick + sizeof(uint32)) * num_fragments) + (sizeof(uint32) * 2);
+	uint64 packet_size = c_packet_budget_per_tick + (sizeof(uint32) * 4) + sizeof(Net::IP_Endpoint);
+	return (players_size * c_num_state_players_buffers) + (packet_size * c_state_packets_per_send);
+}
+
+static void state_scratch_create(State_Scratch* scratch, uint32 num_fragments, Linear_Allocator* allocator)
+{
+	Linear_Allocator scratch_allocator;
+	linear_allocator_create_sub_allocator(allocator, &scratch_allocator, state_scratch_memory_size(num_fragments));
+
+	uint32 num_blocks = c_num_state_players_buffers * num_fragments;
+	scratch->num_fragments		= num_fragments;
+	scratch->players_buffers	=						linear_allocator_alloc(&scratch_allocator, c_packet_budget_per_tick	* num_blocks);
+	scratch->players_sizes		= (uint32*)				linear_allocator_alloc(&scratch_allocator, sizeof(uint32)				* num_blocks);
+	scratch->players_baselines	= (uint32*)				linear_allocator_alloc(&scratch_allocator, sizeof(uint32)				* c_num_state_players_buffers);
+	scratch->players_masks		= (uint32*)				linear_allocator_alloc(&scratch_allocator, sizeof(uint32)				* c_num_state_players_buffers);
+	scratch->packet_slots		= (uint32*)				linear_allocator_alloc(&scratch_allocator, sizeof(uint32)				* c_state_packets_per_send);
+	scratch->packet_players		= (uint32*)				linear_allocator_alloc(&scratch_allocator, sizeof(uint32)				* c_state_packets_per_send);
+	scratch->packet_fragments	= (uint32*)				linear_allocator_alloc(&scratch_allocator, sizeof(uint32)				* c_state_packets_per_send);
+	scratch->state_buffers		=						linear_allocator_alloc(&scratch_allocator, c_packet_budget_per_tick	* c_state_packets_per_send);
+	scratch->state_sizes		= (uint32*)				linear_allocator_alloc(&scratch_allocator, sizeof(uint32)				* c_state_packets_per_send);
+	scratch->state_endpoints	= (Net::IP_Endpoint*)	linear_allocator_alloc(&scratch_allocator, sizeof(Net::IP_Endpoint)	* c_state_packets_per_send);
+}
+
+// what every encode worker reads, and where they write their packets
+struct State_Encode_Job
+{
+	uint32 tick_number;
+	uint32* player_prediction_ids;
+	Player_Extra_State* player_extra_states;
+	State_Scratch* scratch;
+};
+
+// the share of the job's packets a worker writes
+struct State_Encode_Worker
+{
+	uint32 first_packet;
+	uint32 num_packets;
+};
+
+// fixed workers, woken to write a share of the state packets, the thread ticking the room does a share too
+struct State_Encode_Pool
+{
+	std::mutex mutex;
+	std::condition_variable start_conditions[c_max_state_encode_workers]; // one each, so only workers with a share are woken
+	std::condition_variable done_condition;
+	uint32 generation; // bumped to start the workers
+	uint32 num_started; // workers [1, num_started) have a share this generation
+	uint32 num_busy;
+	bool32 should_stop;
+	State_Encode_Job job;
+	State_Encode_Worker* workers; // [0] is the ticking thread's
+	uint32 num_workers;
+	std::thread threads[c_max_state_encode_workers];
+};
+
+// each client's header in front of a copy of the player block for its baseline and the packet's fragment
+static void state_packets_encode(State_Encode_Job* job, State_Encode_Worker* worker)
+{
+	PROFILE_SCOPE("encode");
+	State_Scratch* scratch = job->scratch;
+	uint32 end_packet = worker->first_packet + worker->num_packets;
+	for (uint32 packet_index = worker->first_packet; packet_index < end_packet; ++packet_index)
+	{
+		uint32 slot = scratch->packet_slots[packet_index];
+		uint32 players_index = scratch->packet_players[packet_index];
+		uint32 fragment = scratch->packet_fragments[packet_index];
+		uint32 block_index = (players_index * scratch->num_fragments) + fragment;
+
+		scratch->state_sizes[packet_index] = Net::server_msg_state_write(
+			&scratch->state_buffers[packet_index * c_packet_budget_per_tick],
+			job->tick_number,
+			scratch->players_baselines[players_index],
+			job->player_prediction_ids[slot],
+			&job->player_extra_states[slot],
+			scratch->players_masks[players_index],
+			fragment,
+			&scratch->players_buffers[block_index * c_packet_budget_per_tick],
+			scratch->players_sizes[block_index]);
+	}
+}
+
+static void state_encode_worker_main(State_Encode_Pool* pool, uint32 worker_index)
+{
+	char thread_name[32];
+	snprintf(thread_name, sizeof(thread_name), "encode worker %u", worker_index);
+	profile_thread_name(thread_name);
+
+	uint32 generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(pool->mutex);
+			while ((pool->generation == generation || worker_index >= pool->num_started) && !pool->should_stop)
+			{
+				pool->start_conditions[worker_index].wait(lock);
+			}
+			if (pool->should_stop)
+			{
+				return;
+			}
+			generation = pool->generation;
+		}
+
+		state_packets_encode(&pool->job, &pool->workers[worker_index]);
+
+		{
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			--pool->num_busy;
+		}
+		pool->done_condition.notify_one();
+	}
+}
+
+// splits the job's num_packets between the workers and returns once they're all encoded
+static void state_encode_pool_run(State_Encode_Pool* pool, State_Encode_Job* job, uint32 num_packets)
+{
+	pool->job = *job;
+
+	uint32 num_workers = num_packets / c_min_state_packets_per_worker;
+	if (num_workers > pool->num_workers)
+	{
+		num_workers = pool->num_workers;
+	}
+	if (num_workers < 1)
+	{
+		num_workers = 1;
+	}
+
+	uint32 first_packet = 0;
+	for (uint32 i = 0; i < num_workers; ++i)
+	{
+		uint32 worker_num_packets = (num_packets - first_packet) / (num_workers - i);
+		pool->workers[i].first_packet = first_packet;
+		pool->workers[i].num_packets = worker_num_packets;
+		first_packet += worker_num_packets;
+	}
+
+	if (num_workers == 1)
+	{
+		state_packets_encode(&pool->job, &pool->workers[0]);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		++pool->generation;
+		pool->num_started = num_workers;
+		pool->num_busy = num_workers - 1;
+	}
+	for (uint32 i = 1; i < num_workers; ++i)
+	{
+		pool->start_conditions[i].notify_one();
+	}
+
+	state_packets_encode(&pool->job, &pool->workers[0]);
+
+	std::unique_lock<std::mutex> lock(pool->mutex);
+	while (pool->num_busy)
+	{
+		pool->done_condition.wait(lock);
+	}
+}
+
+static void histogram_log(Metrics_Histogram_Snapshot* histogram, const char* name)
+{
+	log("[server] %s over %llu samples: p50 < %lluus, p99 < %lluus, max < %lluus\n", 
+		name,
+		histogram->total, 
+		metrics_histogram_percentile(histogram, 0.5f), 
+		metrics_histogram_percentile(histogram, 0.99f), 
+		metrics_histogram_percentile(histogram, 1.0f));
+
+	char buckets_str[512];
+	int buckets_str_length = 0;
+	for (uint32 i = 0; i < c_metrics_histogram_buckets - 1; ++i)
+	{
+		if (histogram->counts[i])
+		{
+			buckets_str_length += snprintf(&buckets_str[buckets_str_length], sizeof(buckets_str) - buckets_str_length, " <%lluus:%llu", (uint64)1 << i, histogram->counts[i]);
+		}
+	}
+	if (histogram->counts[c_metrics_histogram_buckets - 1])
+	{
+		buckets_str_length += snprintf(&buckets_str[buckets_str_length], sizeof(buckets_str) - buckets_str_length, " >=%lluus:%llu", (uint64)1 << (c_metrics_histogram_buckets - 2), histogram->counts[c_metrics_histogram_buckets - 1]);
+	}
+	log("[server]   %s\n", buckets_str_length ? buckets_str : " none");
+}
+
+#ifdef __linux__
+constexpr uint64 c_tick_wait_timer_event = 0;
+constexpr uint64 c_tick_wait_socket_event = 1;
+
+// epoll on a timerfd firing every tick, plus the socket if there is one to wait on
+static bool32 tick_wait_create(int* out_epoll_fd, int* out_timer_fd, SOCKET socket_handle, float32 seconds_per_tick)
+{
+	int epoll_fd = epoll_create1(0);
+	int timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (epoll_fd == -1 || timer_fd == -1)
+	{
+		log("[server] epoll_create1()/timerfd_create() failed: %d\n", errno);
+		if (epoll_fd != -1)
+		{
+			close(epoll_fd);
+		}
+		if (timer_fd != -1)
+		{
+			close(timer_fd);
+		}
+		return false;
+	}
+
+	// absolute and periodic, so ticks don't drift however late each wake up is
+	uint64 nanoseconds_per_tick = (uint64)(seconds_per_tick * 1000000000.0);
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64 first_tick = ((uint64)now.tv_sec * 1000000000) + now.tv_nsec + nanoseconds_per_tick;
+	itimerspec timer_spec = {};
+	timer_spec.it_value.tv_sec = first_tick / 1000000000;
+	timer_spec.it_value.tv_nsec = first_tick % 1000000000;
+	timer_spec.it_interval.tv_sec = nanoseconds_per_tick / 1000000000;
+	timer_spec.it_interval.tv_nsec = nanoseconds_per_tick % 1000000000;
+	timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer_spec, 0);
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = c_tick_wait_timer_event;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+	if (socket_handle != INVALID_SOCKET)
+	{
+		event.data.u64 = c_tick_wait_socket_event;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_handle, &event);
+	}
+
+	// the default 50us of timer slack would be most of the jitter
+	prctl(PR_SET_TIMERSLACK, 1);
+
+	*out_epoll_fd = epoll_fd;
+	*out_timer_fd = timer_fd;
+
+	return true;
+}
+
+// blocks until a packet arrives or the tick is due, returns how many ticks are due, more than 1 if the wake up was late
+static uint32 tick_wait(int epoll_fd, int timer_fd)
+{
+	epoll_event events[2];
+	int num_events = epoll_wait(epoll_fd, events, 2, -1);
+
+	uint32 num_ticks_due = 0;
+	for (int i = 0; i < num_events; ++i)
+	{
+		if (events[i].data.u64 == c_tick_wait_timer_event)
+		{
+			uint64 num_expirations;
+			if (read(timer_fd, &num_expirations, sizeof(num_expirations)) == sizeof(num_expirations))
+			{
+				num_ticks_due = (uint32)num_expirations;
+			}
+		}
+	}
+
+	return num_ticks_due;
+}
+#endif // #ifdef __linux__
+
+// slots in use packed at the front, so per client loops only visit those, with where each slot is for O(1) removal
+struct Active_List
+{
+	uint32* slots;
+	uint32* positions; // by slot
+	uint32 count;
+};
+
+static void active_list_create(Active_List* list, uint32 capacity, Linear_Allocator* allocator)
+{
+	list->slots = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * capacity);
+	list->positions = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * capacity);
+	list->count = 0;
+}
+
+static void active_list_add(Active_List* list, uint32 slot)
+{
+	list->slots[list->count] = slot;
+	list->positions[slot] = list->count;
+	++list->count;
+}
+
+// moves the last slot into the gap, so removing while walking the list should go backwards
+static void active_list_remove(Active_List* list, uint32 slot)
+{
+	--list->count;
+	uint32 last_slot = list->slots[list->count];
+	list->slots[list->positions[slot]] = last_slot;
+	list->positions[last_slot] = list->positions[slot];
+}
+
+// one independent game, ticked on its own deadline by the dispatcher or whichever room worker picks it up.
+// Everything here belongs to the thread ticking it, apart from the inbox the dispatcher routes its clients'
+// messages into, and is_ticking which hands it back and forth. Per client state is one array per field,
+// sized for the room's capacity
+struct Room
+{
+	Client_Msg_Queue* inbox;
+	std::atomic_bool is_ticking; // set by the dispatcher when it schedules a tick, cleared once the tick is done
+	uint32 capacity;
+	uint32 tick_number;
+	Active_List active_clients;
+	Net::IP_Endpoint* client_endpoints;
+	bool32* players_present; // copied into each snapshot
+	Player_Snapshot_State* player_snapshot_states;
+	Player_Extra_State* player_extra_states;
+	uint32* player_prediction_ids;
+	Input_Queue* input_queues;
+	uint32* client_first_sequences;
+	uint32* client_acked_sequences;
+	Net::Snapshot_History snapshot_history;
+	Client_Msg_Record* records; // inbox is drained into here
+};
+
+// big enough for every client to have a full input queue waiting, twice over
+static uint32 room_inbox_capacity(uint32 capacity)
+{
+	uint32 inbox_capacity = 1;
+	while (inbox_capacity < capacity * c_input_queue_capacity * 2)
+	{
+		inbox_capacity *= 2;
+	}
+	return inbox_capacity;
+}
+
+static uint64 room_memory_size(uint32 capacity)
+{
+	uint64 client_size =	(sizeof(uint32) * 2) + sizeof(Net::IP_Endpoint) + sizeof(bool32) + sizeof(Player_Snapshot_State) +
+							sizeof(Player_Extra_State) + sizeof(uint32) + sizeof(Input_Queue) + (sizeof(uint32) * 2);
+	return	sizeof(Client_Msg_Queue) + 63 + (sizeof(Client_Msg_Record) * (room_inbox_capacity(capacity) + c_receive_batch_size)) +
+			(client_size * capacity) + Net::snapshot_history_memory_size(capacity);
+}
+
+// each room gets its own block, so a room's data stays together whichever thread ticks it
+static void room_create(Room* room, uint32 capacity, Linear_Allocator* allocator)
+{
+	Linear_Allocator room_allocator;
+	linear_allocator_create_sub_allocator(allocator, &room_allocator, room_memory_size(capacity));
+
+	room->inbox = client_msg_queue_create(room_inbox_capacity(capacity), &room_allocator);
+	room->is_ticking.store(false, std::memory_order_relaxed);
+	room->capacity = capacity;
+	room->tick_number = 0;
+	active_list_create(&room->active_clients, capacity, &room_allocator);
+	room->client_endpoints			= (Net::IP_Endpoint*)		linear_allocator_alloc(&room_allocator, sizeof(Net::IP_Endpoint)		* capacity);
+	room->players_present			= (bool32*)					linear_allocator_alloc(&room_allocator, sizeof(bool32)					* capacity);
+	room->player_snapshot_states	= (Player_Snapshot_State*)	linear_allocator_alloc(&room_allocator, sizeof(Player_Snapshot_State)	* capacity);
+	room->player_extra_states		= (Player_Extra_State*)		linear_allocator_alloc(&room_allocator, sizeof(Player_Extra_State)		* capacity);
+	room->player_prediction_ids		= (uint32*)					linear_allocator_alloc(&room_allocator, sizeof(uint32)					* capacity);
+	room->input_queues				= (Input_Queue*)			linear_allocator_alloc(&room_allocator, sizeof(Input_Queue)				* capacity);
+	room->client_first_sequences	= (uint32*)					linear_allocator_alloc(&room_allocator, sizeof(uint32)					* capacity);
+	room->client_acked_sequences	= (uint32*)					linear_allocator_alloc(&room_allocator, sizeof(uint32)					* capacity);
+	Net::snapshot_history_create(&room->snapshot_history, capacity, &room_allocator);
+	room->records					= (Client_Msg_Record*)		linear_allocator_alloc(&room_allocator, sizeof(Client_Msg_Record)		* c_receive_batch_size);
+
+	for (uint32 i = 0; i < capacity; ++i)
+	{
+		room->players_present[i] = false;
+	}
+}
+
+// encodes the batch of packets in scratch, spread over encode_pool if there is one, and sends them
+// returns how long the sending took, so it can be told apart from the encoding
+static int64 room_state_packets_send(Room* room, Net::Socket* sock, State_Scratch* scratch, State_Encode_Pool* encode_pool, uint32 num_packets)
+{
+	State_Encode_Job job;
+	job.tick_number = room->tick_number;
+	job.player_prediction_ids = room->player_prediction_ids;
+	job.player_extra_states = room->player_extra_states;
+	job.scratch = scratch;
+	if (encode_pool)
+	{
+		state_encode_pool_run(encode_pool, &job, num_packets);
+	}
+	else
+	{
+		State_Encode_Worker worker;
+		worker.first_packet = 0;
+		worker.num_packets = num_packets;
+		state_packets_encode(&job, &worker);
+	}
+
+	uint64 num_bytes = 0;
+	for (uint32 i = 0; i < num_packets; ++i)
+	{
+		num_bytes += scratch->state_sizes[i];
+	}
+	metrics_add(Metric_Counter::Server_Msg_State_Bytes, num_bytes);
+
+	PROFILE_SCOPE("send");
+	int64 send_start = clock_now();
+	if (!Net::socket_send_batch(sock, scratch->state_buffers, c_packet_budget_per_tick, scratch->state_sizes, scratch->state_endpoints, num_packets))
+	{
+		log("[server] failed to send state packets\n");
+	}
+	return clock_now() - send_start;
+}
+
+// handles whatever the dispatcher has routed to the room, simulates one input per client, then encodes and
+// sends everyone's state, with encode_pool (if not 0) spreading the packet writing over more threads
+static void room_tick(Room* room, Net::Socket* sock, float32 seconds_per_tick, State_Scratch* scratch, State_Encode_Pool* encode_pool)
+{
+	PROFILE_SCOPE("room tick");
+	int64 inbox_start = clock_now();
+
+	uint32 num_records;
+	while ((num_records = client_msg_queue_pop(room->inbox, room->records, c_receive_batch_size)) > 0)
+	{
+		PROFILE_SCOPE("inbox");
+		for (uint32 record_index = 0; record_index < num_records; ++record_index)
+		{
+			Client_Msg_Record* record = &room->records[record_index];
+			uint32 slot = record->slot;
+
+			switch (record->type)
+			{
+				case Net::Client_Message::Join:
+					if (!room->players_present[slot])
+					{
+						active_list_add(&room->active_clients, slot);
+						room->players_present[slot] = true;
+					}
+					room->client_endpoints[slot] = record->from;
+					room->player_snapshot_states[slot] = {};
+					room->player_extra_states[slot] = {};
+					room->player_prediction_ids[slot] = 0;
+					input_queue_reset(&room->input_queues[slot]);
+					room->client_first_sequences[slot] = room->tick_number + 1; // first snapshot this client will be sent
+					room->client_acked_sequences[slot] = 0;
+				break;
+
+				case Net::Client_Message::Leave:
+					if (room->players_present[slot])
+					{
+						active_list_remove(&room->active_clients, slot);
+						room->players_present[slot] = false;
+					}
+				break;
+
+				case Net::Client_Message::Input:
+					if (room->players_present[slot])
+					{
+						Input_Queue* input_queue = &room->input_queues[slot];
+						uint32 prediction_id = Net::sequence_expand(record->prediction_id, input_queue->is_started ? input_queue->newest_prediction_id : 0);
+						input_queue_push(input_queue, prediction_id, &record->input);
+
+						// acks can arrive out of order, only ever move forwards, and can't be for a snapshot not sent yet
+						if (record->has_ack)
+						{
+							uint32 ack_sequence = Net::sequence_expand(record->ack_sequence, room->tick_number);
+							if (ack_sequence > room->client_acked_sequences[slot] && ack_sequence <= room->tick_number)
+							{
+								room->client_acked_sequences[slot] = ack_sequence;
+							}
+						}
+					}
+				break;
+			}
+		}
+	}
+
+	// update clients, simulating one input each
+	int64 simulate_start = clock_now();
+	uint32* active_slots = room->active_clients.slots;
+	uint32 num_active = room->active_clients.count;
+	{
+		PROFILE_SCOPE("simulate");
+		for (uint32 i = 0; i < num_active; ++i)
+		{
+			uint32 slot = active_slots[i];
+			Player_Input input;
+			if (input_queue_pop(&room->input_queues[slot], &input, &room->player_prediction_ids[slot]))
+			{
+				tick_player(&room->player_snapshot_states[slot], &room->player_extra_states[slot], seconds_per_tick, &input);
+			}
+		}
+	}
+	++room->tick_number;
+
+	PROFILE_SCOPE("broadcast");
+	int64 broadcast_start = clock_now();
+	int64 send_time = 0;
+
+	// store this tick's snapshot, state packets are deltas against whichever snapshot each client last acked,
+	// the state of absent players is never sent so only present ones are copied
+	Net::Snapshot* snapshot = Net::snapshot_history_push(&room->snapshot_history, room->tick_number);
+	memcpy(snapshot->players_present, room->players_present, sizeof(bool32) * room->capacity);
+	for (uint32 i = 0; i < num_active; ++i)
+	{
+		uint32 slot = active_slots[i];
+		snapshot->player_snapshot_states[slot] = room->player_snapshot_states[slot];
+	}
+
+	// player blocks are encoded once per baseline in use, then each client gets a packet per fragment
+	// that's changed since its baseline, which is its own header in front of a copy of the block
+	for (uint32 i = 0; i < c_num_state_players_buffers; ++i)
+	{
+		scratch->players_baselines[i] = (uint32)-1;
+	}
+	uint32 num_fragments = Net::state_num_fragments(room->capacity);
+	uint32 num_state_packets = 0;
+	for (uint32 i = 0; i < num_active; ++i)
+	{
+		uint32 slot = active_slots[i];
+
+		// only use the ack as a baseline if it was sent to this client and is still in history
+		uint32 baseline_sequence = room->client_acked_sequences[slot];
+		Net::Snapshot* baseline = 0;
+		if (baseline_sequence >= room->client_first_sequences[slot])
+		{
+			baseline = Net::snapshot_history_get(&room->snapshot_history, baseline_sequence);
+		}
+		if (!baseline)
+		{
+			baseline_sequence = 0;
+		}
+
+		uint32 players_index = baseline ? (baseline_sequence & Net::c_snapshot_history_mask) : Net::c_snapshot_history_capacity;
+		if (scratch->players_baselines[players_index] != baseline_sequence)
+		{
+			uint32 fragment_mask = 0;
+			for (uint32 fragment = 0; fragment < num_fragments; ++fragment)
+			{
+				uint32 block_index = (players_index * scratch->num_fragments) + fragment;
+				scratch->players_sizes[block_index] = Net::server_msg_state_players_write(
+					&scratch->players_buffers[block_index * c_packet_budget_per_tick], snapshot, baseline, fragment, room->capacity);
+				if (scratch->players_sizes[block_index])
+				{
+					fragment_mask |= 1 << fragment;
+				}
+			}
+			scratch->players_baselines[players_index] = baseline_sequence;
+			scratch->players_masks[players_index] = fragment_mask;
+		}
+
+		// with nothing changed at all there's still a packet, for the header
+		uint32 fragment_mask = scratch->players_masks[players_index];
+		for (uint32 fragment = 0; fragment < num_fragments; ++fragment)
+		{
+			if ((fragment_mask & (1 << fragment)) || (!fragment_mask && !fragment))
+			{
+				if (num_state_packets == c_state_packets_per_send)
+				{
+					send_time += room_state_packets_send(room, sock, scratch, encode_pool, num_state_packets);
+					num_state_packets = 0;
+				}
+
+				scratch->packet_slots[num_state_packets] = slot;
+				scratch->packet_players[num_state_packets] = players_index;
+				scratch->packet_fragments[num_state_packets] = fragment;
+				scratch->state_endpoints[num_state_packets] = room->client_endpoints[slot];
+				++num_state_packets;
+			}
+		}
+	}
+
+	if (num_state_packets)
+	{
+		send_time += room_state_packets_send(room, sock, scratch, encode_pool, num_state_packets);
+	}
+
+	int64 broadcast_end = clock_now();
+	metrics_add(Metric_Counter::Server_Room_Inbox_Ns, clock_ticks_to_ns(simulate_start - inbox_start));
+	metrics_add(Metric_Counter::Server_Room_Simulate_Ns, clock_ticks_to_ns(broadcast_start - simulate_start));
+	metrics_add(Metric_Counter::Server_Room_Encode_Ns, clock_ticks_to_ns(broadcast_end - broadcast_start - send_time));
+	metrics_add(Metric_Counter::Server_Room_Send_Ns, clock_ticks_to_ns(send_time));
+}
+
+// a room worker's state packet scratch, and how long its room ticks have taken since the dispatcher last logged stats
+struct Room_Worker
+{
+	State_Scratch state_scratch;
+	std::atomic<int64> tick_time_total; // in clock_now() ticks
+	std::atomic<int64> tick_time_max;
+	std::atomic<uint32> num_ticks;
+};
+
+static void room_worker_record_tick(Room_Worker* worker, int64 tick_time)
+{
+	// only the worker writes these, the dispatcher just reads and resets them
+	worker->tick_time_total.fetch_add(tick_time, std::memory_order_relaxed);
+	worker->num_ticks.fetch_add(1, std::memory_order_relaxed);
+	if (tick_time > worker->tick_time_max.load(std::memory_order_relaxed))
+	{
+		worker->tick_time_max.store(tick_time, std::memory_order_relaxed);
+	}
+
+	metrics_add(Metric_Counter::Server_Room_Ticks);
+	metrics_histogram_add(Metric_Histogram::Server_Room_Tick_Time_Us, (uint64)(tick_time / (clock_frequency() / 1000000)));
+}
+
+// room indices waiting to tick, the owning worker takes from the front and idle workers steal from the back
+struct Room_Deque
+{
+	std::mutex mutex;
+	uint32* room_indices;
+	uint32 mask; // capacity - 1
+	uint32 head; // next to take
+	uint32 tail; // next to fill
+};
+
+// room workers, each with its own deque of due rooms. The dispatcher deals rooms out round robin, and a
+// worker whose deque is empty steals from the others, so a few slow rooms don't hold up the rest
+struct Room_Scheduler
+{
+	Room_Deque deques[c_max_room_workers];
+	uint32 num_workers;
+	uint32 next_deque;
+	std::mutex wake_mutex;
+	std::condition_variable wake_condition;
+	uint32 num_queued; // guarded by wake_mutex
+	bool32 should_stop; // guarded by wake_mutex
+	Room* rooms;
+	Room_Worker* workers;
+	Net::Socket* sock;
+	float32 seconds_per_tick;
+	std::thread threads[c_max_room_workers];
+};
+
+static void room_scheduler_push(Room_Scheduler* scheduler, uint32 room_index)
+{
+	Room_Deque* deque = &scheduler->deques[scheduler->next_deque];
+	scheduler->next_deque = (scheduler->next_deque + 1) % scheduler->num_workers;
+	{
+		// a room is only ever queued once at a time, so there's always space
+		std::lock_guard<std::mutex> lock(deque->mutex);
+		deque->room_indices[deque->tail & deque->mask] = room_index;
+		++deque->tail;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(scheduler->wake_mutex);
+		++scheduler->num_queued;
+	}
+	scheduler->wake_condition.notify_one();
+}
+
+// returns false if every deque is empty
+static bool32 room_scheduler_take(Room_Scheduler* scheduler, uint32 worker_index, uint32* out_room_index)
+{
+	bool32 is_taken = false;
+	for (uint32 i = 0; i < scheduler->num_workers && !is_taken; ++i)
+	{
+		Room_Deque* deque = &scheduler->deques[(worker_index + i) % scheduler->num_workers];
+		std::lock_guard<std::mutex> lock(deque->mutex);
+		if (deque->head != deque->tail)
+		{
+			if (i == 0)
+			{
+				*out_room_index = deque->room_indices[deque->head & deque->mask];
+				++deque->head;
+			}
+			else
+			{
+				--deque->tail;
+				*out_room_index = deque->room_indices[deque->tail & deque->mask];
+			}
+			is_taken = true;
+		}
+	}
+
+	if (is_taken)
+	{
+		std::lock_guard<std::mutex> lock(scheduler->wake_mutex);
+		--scheduler->num_queued;
+	}
+
+	return is_taken;
+}
+
+static void room_worker_main(Room_Scheduler* scheduler, uint32 worker_index)
+{
+	char thread_name[32];
+	snprintf(thread_name, sizeof(thread_name), "room worker %u", worker_index);
+	profile_thread_name(thread_name);
+
+	Room_Worker* worker = &scheduler->workers[worker_index];
+	while (true)
+	{
+		uint32 room_index;
+		if (!room_scheduler_take(scheduler, worker_index, &room_index))
+		{
+			std::unique_lock<std::mutex> lock(scheduler->wake_mutex);
+			while (!scheduler->num_queued && !scheduler->should_stop)
+			{
+				scheduler->wake_condition.wait(lock);
+			}
+			if (scheduler->should_stop)
+			{
+				return;
+			}
+			continue;
+		}
+
+		Room* room = &scheduler->rooms[room_index];
+		int64 tick_start = clock_now();
+		room_tick(room, scheduler->sock, scheduler->seconds_per_tick, &worker->state_scratch, /*encode_pool*/ 0);
+		room_worker_record_tick(worker, clock_now() - tick_start);
+		room->is_ticking.store(false, std::memory_order_release);
+	}
+}
+
+constexpr uint32 c_no_connection = (uint32)-1;
+
+// which room and slot each client is in, owned by the dispatcher (the thread in server_main).
+// A connection is room_index * room_capacity + slot
+struct Connection_Table
+{
+	Net::Endpoint_Map connections;
+	Net::IP_Endpoint* endpoints; // by connection
+	int64* last_heard_times; // by connection, clock_now() of the last message
+	uint32* free_slots; // a stack of free slots per room, lowest on top
+	uint32* num_free_slots; // by room
+	uint32* pending_leaves; // connections which have gone but whose leave didn't fit in the room's inbox yet
+	uint32 num_pending_leaves;
+	uint32 num_connections;
+	uint32 num_rooms_occupied;
+	Timer_Wheel timeouts; // a timer per connection, in milliseconds
+	int64 timeout; // in clock_now() ticks
+	int64 clock_ticks_per_ms;
+	uint32 room_capacity;
+	uint32 num_rooms;
+};
+
+static uint64 connection_table_memory_size(uint32 num_rooms, uint32 room_capacity)
+{
+	uint32 num_connections = num_rooms * room_capacity;
+	uint64 map_size = 1;
+	while (map_size < num_connections * 2)
+	{
+		map_size *= 2;
+	}
+	return	(map_size * (sizeof(Net::IP_Endpoint) + sizeof(uint32))) +
+			(num_connections * (sizeof(Net::IP_Endpoint) + sizeof(int64) + (sizeof(uint32) * 5) + sizeof(uint64))) +
+			(num_rooms * sizeof(uint32));
+}
+
+static void connection_table_create(Connection_Table* table, uint32 num_rooms, uint32 room_capacity, int64 timeout, int64 now, Linear_Allocator* allocator)
+{
+	uint32 num_connections = num_rooms * room_capacity;
+	Net::endpoint_map_create(&table->connections, num_connections, allocator);
+	table->endpoints = (Net::IP_Endpoint*)linear_allocator_alloc(allocator, sizeof(Net::IP_Endpoint) * num_connections);
+	table->last_heard_times = (int64*)linear_allocator_alloc(allocator, sizeof(int64) * num_connections);
+	table->free_slots = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * num_connections);
+	table->num_free_slots = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * num_rooms);
+	table->pending_leaves = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * num_connections);
+	table->num_pending_leaves = 0;
+	table->num_connections = 0;
+	table->num_rooms_occupied = 0;
+	table->timeout = timeout;
+	table->clock_ticks_per_ms = clock_frequency() / 1000;
+	timer_wheel_create(&table->timeouts, num_connections, now / table->clock_ticks_per_ms, allocator);
+	table->room_capacity = room_capacity;
+	table->num_rooms = num_rooms;
+
+	for (uint32 room_index = 0; room_index < num_rooms; ++room_index)
+	{
+		uint32* room_free_slots = &table->free_slots[room_index * room_capacity];
+		for (uint32 i = 0; i < room_capacity; ++i)
+		{
+			room_free_slots[i] = room_capacity - 1 - i;
+		}
+		table->num_free_slots[room_index] = room_capacity;
+	}
+}
+
+// rounded up to the next millisecond, so a connection is never found due before it's actually timed out
+static void connection_table_timeout_schedule(Connection_Table* table, uint32 connection)
+{
+	uint64 deadline = (uint64)((table->last_heard_times[connection] + table->timeout) / table->clock_ticks_per_ms) + 1;
+	timer_wheel_schedule(&table->timeouts, connection, deadline);
+}
+
+// puts the client in the first room with space, so rooms fill up rather than everyone being spread thin,
+// returns c_no_connection if every room is full
+static uint32 connection_table_add(Connection_Table* table, Net::IP_Endpoint* endpoint, int64 now)
+{
+	for (uint32 room_index = 0; room_index < table->num_rooms; ++room_index)
+	{
+		if (table->num_free_slots[room_index])
+		{
+			if (table->num_free_slots[room_index] == table->room_capacity)
+			{
+				++table->num_rooms_occupied;
+				metrics_set(Metric_Gauge::Server_Rooms_Occupied, table->num_rooms_occupied);
+			}
+			++table->num_connections;
+			metrics_set(Metric_Gauge::Server_Clients, table->num_connections);
+
+			--table->num_free_slots[room_index];
+			uint32 slot = table->free_slots[(room_index * table->room_capacity) + table->num_free_slots[room_index]];
+			uint32 connection = (room_index * table->room_capacity) + slot;
+			Net::endpoint_map_set(&table->connections, endpoint, connection);
+			table->endpoints[connection] = *endpoint;
+			table->last_heard_times[connection] = now;
+			connection_table_timeout_schedule(table, connection);
+			return connection;
+		}
+	}
+
+	return c_no_connection;
+}
+
+// stops routing messages from the client, but its slot stays taken until connection_table_free_slot
+static void connection_table_disconnect(Connection_Table* table, uint32 connection)
 {
-	// todo(jbr) option to create a window and render on server
+	Net::endpoint_map_remove(&table->connections, &table->endpoints[connection]);
+	timer_wheel_cancel(&table->timeouts, connection);
+}
+
+static void connection_table_free_slot(Connection_Table* table, uint32 connection)
+{
+	uint32 room_index = connection / table->room_capacity;
+	uint32 slot = connection % table->room_capacity;
+	table->free_slots[(room_index * table->room_capacity) + table->num_free_slots[room_index]] = slot;
+	++table->num_free_slots[room_index];
+
+	--table->num_connections;
+	metrics_set(Metric_Gauge::Server_Clients, table->num_connections);
+	if (table->num_free_slots[room_index] == table->room_capacity)
+	{
+		--table->num_rooms_occupied;
+		metrics_set(Metric_Gauge::Server_Rooms_Occupied, table->num_rooms_occupied);
+	}
+}
+
+// for a client the room was never told about
+static void connection_table_remove(Connection_Table* table, uint32 connection)
+{
+	connection_table_disconnect(table, connection);
+	connection_table_free_slot(table, connection);
+}
+
+static bool32 connection_table_push_leave(Connection_Table* table, Room* rooms, uint32 connection)
+{
+	Client_Msg_Record leave = {};
+	leave.type = Net::Client_Message::Leave;
+	leave.slot = connection % table->room_capacity;
+	return client_msg_queue_push(rooms[connection / table->room_capacity].inbox, &leave);
+}
+
+// a leave can't be dropped, the room would keep a ghost player in a slot which could then be handed to someone
+// else, so if the inbox is full the slot is held and the leave retried by connection_table_retry_leaves
+static void connection_table_leave(Connection_Table* table, Room* rooms, uint32 connection)
+{
+	connection_table_disconnect(table, connection);
+	if (connection_table_push_leave(table, rooms, connection))
+	{
+		connection_table_free_slot(table, connection);
+	}
+	else
+	{
+		metrics_add(Metric_Counter::Server_Msgs_Dropped_Inbox);
+		log("[server] room %u inbox full, leave will be retried\n", connection / table->room_capacity);
+		table->pending_leaves[table->num_pending_leaves] = connection;
+		++table->num_pending_leaves;
+	}
+}
+
+static void connection_table_retry_leaves(Connection_Table* table, Room* rooms)
+{
+	for (uint32 i = 0; i < table->num_pending_leaves;)
+	{
+		uint32 connection = table->pending_leaves[i];
+		if (connection_table_push_leave(table, rooms, connection))
+		{
+			connection_table_free_slot(table, connection);
+			--table->num_pending_leaves;
+			table->pending_leaves[i] = table->pending_leaves[table->num_pending_leaves];
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+static bool32 connection_table_is_room_empty(Connection_Table* table, uint32 room_index)
+{
+	return table->num_free_slots[room_index] == table->room_capacity;
+}
+
+// returns the next connection which has timed out by now, the connection is left for the caller to remove.
+// Messages arriving only update last_heard_times rather than moving the timer, so when a timer comes due the
+// client has either really timed out, or it's rearmed for timeout after it was last heard from
+static bool32 connection_table_pop_timed_out(Connection_Table* table, int64 now, uint32* out_connection)
+{
+	timer_wheel_advance(&table->timeouts, (uint64)(now / table->clock_ticks_per_ms));
+
+	uint32 connection;
+	while (timer_wheel_pop_expired(&table->timeouts, &connection))
+	{
+		if (now - table->last_heard_times[connection] > table->timeout)
+		{
+			*out_connection = connection;
+			return true;
+		}
+
+		connection_table_timeout_schedule(table, connection);
+	}
+
+	return false;
+}
 
+// what server_main has opened and started so far, so that giving up part way through setting up and
+// shutting down normally both go through server_shutdown, which only stops and closes what's there
+struct Server_Resources
+{
 	Linear_Allocator allocator;
-	linear_allocator_create(&allocator, megabytes(8));
+	Receive_Shard* receive_shards;
+	uint32 num_shard_sockets; // the receive shards' own sockets opened so far
+	Net::Socket* sock; // 0 until it's opened
+	std::atomic_bool receive_should_run;
+	std::thread receive_threads[c_max_receive_shards];
+	uint32 num_receive_threads;
+	State_Encode_Pool* state_encode_pool; // 0 until its threads are started
+	Room_Scheduler* room_scheduler; // 0 until its threads are started
+	int epoll_fd;
+	int timer_fd;
+};
 
-	Net::Socket sock;
-	if (!Net::socket(&sock))
+static void server_shutdown(Server_Resources* resources)
+{
+	Room_Scheduler* room_scheduler = resources->room_scheduler;
+	if (room_scheduler)
 	{
-		log("[server] Net::socket() failed");
-		return;
+		{
+			std::lock_guard<std::mutex> lock(room_scheduler->wake_mutex);
+			room_scheduler->should_stop = true;
+		}
+		room_scheduler->wake_condition.notify_all();
+		for (uint32 i = 0; i < room_scheduler->num_workers; ++i)
+		{
+			room_scheduler->threads[i].join();
+		}
+	}
+
+	State_Encode_Pool* state_encode_pool = resources->state_encode_pool;
+	if (state_encode_pool)
+	{
+		{
+			std::lock_guard<std::mutex> lock(state_encode_pool->mutex);
+			state_encode_pool->should_stop = true;
+		}
+		for (uint32 i = 1; i < state_encode_pool->num_workers; ++i)
+		{
+			state_encode_pool->start_conditions[i].notify_one();
+		}
+		for (uint32 i = 1; i < state_encode_pool->num_workers; ++i)
+		{
+			state_encode_pool->threads[i].join();
+		}
+	}
+
+	resources->receive_should_run.store(false, std::memory_order_relaxed);
+	for (uint32 i = 0; i < resources->num_receive_threads; ++i)
+	{
+		resources->receive_threads[i].join();
 	}
-	Net::socket_set_fake_lag_s(&sock, 0.0f, &allocator); // no fake lag on server
+
+	// before the shards' own sockets, which it may be sending through
+	if (resources->sock)
+	{
+		Net::socket_close(resources->sock);
+	}
+	for (uint32 i = 0; i < resources->num_shard_sockets; ++i)
+	{
+		Net::socket_close(resources->receive_shards[i].sock);
+	}
+
+#ifdef __linux__
+	if (resources->epoll_fd != -1)
+	{
+		close(resources->epoll_fd);
+		close(resources->timer_fd);
+	}
+#endif // #ifdef __linux__
+
+	linear_allocator_destroy(&resources->allocator);
+}
+
+void server_main(std::atomic_bool* should_run, Server_Config* config)
+{
+	profile_thread_name("server");
+
+	Net::Socket_Type socket_type = config->socket_type;
+	uint32 num_receive_shards = config->num_receive_shards;
+	int32 tick_rate = config->tick_rate;
+	if (tick_rate < 1)
+	{
+		tick_rate = 1;
+	}
+	else if (tick_rate > c_max_server_tick_rate)
+	{
+		tick_rate = c_max_server_tick_rate;
+	}
+	uint32 max_clients = config->max_clients;
+	if (max_clients < 1)
+	{
+		max_clients = 1;
+	}
+	else if (max_clients > c_max_clients)
+	{
+		max_clients = c_max_clients;
+	}
+	uint32 num_rooms = config->num_rooms;
+	if (num_rooms < 1)
+	{
+		num_rooms = 1;
+	}
+	else if (num_rooms > c_max_rooms)
+	{
+		num_rooms = c_max_rooms;
+	}
+	uint32 num_room_workers = config->num_room_workers;
+	if (num_room_workers > c_max_room_workers)
+	{
+		num_room_workers = c_max_room_workers;
+	}
+	Server_Fast_Forward* fast_forward = config->fast_forward;
+	if (fast_forward && num_room_workers)
+	{
+		log("[server] fast forwarding ticks rooms on the server_main thread, so a tick is done when it says so\n");
+		num_room_workers = 0;
+	}
+
+	// rooms ticked by room workers are sent from those threads, and a ring can only be used from one thread
+	if (num_room_workers && socket_type == Net::Socket_Type::Io_Uring)
+	{
+		log("[server] room workers send from several threads, which io_uring can't, using udp sockets instead\n");
+		socket_type = Net::Socket_Type::Udp;
+	}
+
+	// todo(jbr) option to create a window and render on server
+
+	Server_Resources resources;
+	resources.receive_shards = 0;
+	resources.num_shard_sockets = 0;
+	resources.sock = 0;
+	resources.receive_should_run.store(true, std::memory_order_relaxed);
+	resources.num_receive_threads = 0;
+	resources.state_encode_pool = 0;
+	resources.room_scheduler = 0;
+	resources.epoll_fd = -1;
+	resources.timer_fd = -1;
+
+	Linear_Allocator* allocator = &resources.allocator;
+	uint32 num_state_fragments = Net::state_num_fragments(max_clients);
+	uint32 num_state_scratches = num_room_workers ? num_room_workers : 1;
+	linear_allocator_create(allocator, 
+		megabytes(8) + 
+		(num_rooms * room_memory_size(max_clients)) + 
+		connection_table_memory_size(num_rooms, max_clients) + 
+		(num_state_scratches * state_scratch_memory_size(num_state_fragments)));
 
 	Net::IP_Endpoint local_endpoint = {};
 	local_endpoint.address = INADDR_ANY;
-	local_endpoint.port = c_port;
-	if (!Net::socket_bind(&sock, &local_endpoint))
+	local_endpoint.port = config->port;
+
+	// with receive shards, each has a thread draining packets and decoding them, which are queued for
+	// this thread, so a slow tick doesn't hold up receiving. A single shard shares this thread's socket,
+	// except with io_uring where a ring can only be used from one thread. Otherwise each shard has its
+	// own socket on the port and the kernel keeps each client on one shard
+	if (num_receive_shards > c_max_receive_shards)
 	{
-		log("[server] Net::socket_bind() failed");
-		return;
+		num_receive_shards = c_max_receive_shards;
+	}
+	bool32 shard_shares_socket = num_receive_shards == 1 && socket_type != Net::Socket_Type::Io_Uring;
+	Receive_Shard* receive_shards = 0;
+	if (num_receive_shards)
+	{
+		receive_shards = (Receive_Shard*)linear_allocator_alloc(allocator, sizeof(Receive_Shard) * num_receive_shards);
+		resources.receive_shards = receive_shards;
+		for (uint32 i = 0; i < num_receive_shards; ++i)
+		{
+			Receive_Shard* shard = &receive_shards[i];
+			shard->sock = 0;
+			if (!shard_shares_socket)
+			{
+				shard->sock = (Net::Socket*)linear_allocator_alloc(allocator, sizeof(Net::Socket));
+				if (!Net::socket(shard->sock, socket_type, allocator))
+				{
+					log("[server] failed to create receive shard %u\n", i);
+					server_shutdown(&resources);
+					return;
+				}
+				++resources.num_shard_sockets;
+				if (!Net::socket_set_reuse_port(shard->sock) ||
+					!Net::socket_bind(shard->sock, &local_endpoint))
+				{
+					log("[server] failed to bind receive shard %u\n", i);
+					server_shutdown(&resources);
+					return;
+				}
+			}
+			shard->queue = client_msg_queue_create(c_client_msg_queue_capacity, allocator);
+			shard->packet_views = (Net::Packet_View*)linear_allocator_alloc(allocator, sizeof(Net::Packet_View) * c_receive_batch_size);
+			shard->records = (Client_Msg_Record*)linear_allocator_alloc(allocator, sizeof(Client_Msg_Record) * c_receive_batch_size);
+			shard->should_run = &resources.receive_should_run;
+		}
+
+		// without steering the kernel spreads a client's packets over the shards by its own hash, which
+		// could move clients between shards and reorder their messages
+		if (!shard_shares_socket && !Net::socket_set_reuse_port_steering(receive_shards[0].sock, num_receive_shards))
+		{
+			log("[server] couldn't steer clients to receive shards, run with a single receive shard\n");
+			server_shutdown(&resources);
+			return;
+		}
+	}
+
+	// this thread's socket. When shards have their own, it only sends, from the first shard's socket's port,
+	// and isn't bound itself, as any socket bound to the port would be handed a share of the packets
+	Net::Socket sock;
+	if (receive_shards && !shard_shares_socket)
+	{
+		Net::socket_send_only(&sock, receive_shards[0].sock);
+		resources.sock = &sock;
+	}
+	else
+	{
+		if (!Net::socket(&sock, socket_type, allocator))
+		{
+			log("[server] Net::socket() failed\n");
+			server_shutdown(&resources);
+			return;
+		}
+		resources.sock = &sock;
+		if (!Net::socket_bind(&sock, &local_endpoint))
+		{
+			log("[server] Net::socket_bind() failed\n");
+			server_shutdown(&resources);
+			return;
+		}
+		if (shard_shares_socket)
+		{
+			receive_shards[0].sock = &sock;
+		}
+	}
+
+	if (receive_shards)
+	{
+		for (uint32 i = 0; i < num_receive_shards; ++i)
+		{
+			resources.receive_threads[i] = std::thread(&receive_shard_main, &receive_shards[i]);
+			++resources.num_receive_threads;
+		}
 	}
 
 	constexpr uint32	c_socket_buffer_size	= c_packet_budget_per_tick;
-	uint8*				socket_buffer			= linear_allocator_alloc(&allocator, c_socket_buffer_size);
-	Net::IP_Endpoint*	client_endpoints		= (Net::IP_Endpoint*)linear_allocator_alloc(&allocator, sizeof(Net::IP_Endpoint) * c_max_clients);
-	
-	for (uint32 i = 0; i < c_max_clients; ++i)
+	uint8*				socket_buffer			= linear_allocator_alloc(allocator, c_socket_buffer_size);
+	Net::Packet_View*	packet_views			= (Net::Packet_View*)linear_allocator_alloc(allocator, sizeof(Net::Packet_View) * c_receive_batch_size);
+	Client_Msg_Record*	client_msg_records		= (Client_Msg_Record*)linear_allocator_alloc(allocator, sizeof(Client_Msg_Record) * c_receive_batch_size);
+
+	// this thread is the dispatcher, it owns the sockets and who is connected where, and routes each
+	// client's messages to its room, which only sees them when it next ticks
+	constexpr float32 c_client_timeout 	= 5.0f;
+	Connection_Table connection_table;
+	connection_table_create(&connection_table, num_rooms, max_clients, (int64)(c_client_timeout * clock_frequency()), clock_now(), allocator);
+	metrics_set(Metric_Gauge::Server_Tick_Rate, tick_rate);
+	metrics_set(Metric_Gauge::Server_Rooms, num_rooms);
+	metrics_set(Metric_Gauge::Server_Rooms_Occupied, 0);
+	metrics_set(Metric_Gauge::Server_Clients, 0);
+
+	Room* rooms = (Room*)linear_allocator_alloc(allocator, sizeof(Room) * num_rooms);
+	for (uint32 i = 0; i < num_rooms; ++i)
+	{
+		room_create(&rooms[i], max_clients, allocator);
+	}
+
+	// without room workers rooms are ticked on this thread, and can spread encoding over encode workers
+	uint32 num_state_encode_workers = config->num_state_encode_workers;
+	if (num_state_encode_workers < 1)
+	{
+		num_state_encode_workers = 1;
+	}
+	else if (num_state_encode_workers > c_max_state_encode_workers)
+	{
+		num_state_encode_workers = c_max_state_encode_workers;
+	}
+	if (num_room_workers && num_state_encode_workers > 1)
+	{
+		log("[server] room workers encode their own rooms' state packets, ignoring encode workers\n");
+		num_state_encode_workers = 1;
+	}
+	State_Encode_Pool state_encode_pool;
+	state_encode_pool.generation = 0;
+	state_encode_pool.num_started = 0;
+	state_encode_pool.num_busy = 0;
+	state_encode_pool.should_stop = false;
+	state_encode_pool.job = {};
+	state_encode_pool.workers = (State_Encode_Worker*)linear_allocator_alloc(allocator, sizeof(State_Encode_Worker) * num_state_encode_workers);
+	state_encode_pool.num_workers = num_state_encode_workers;
+	for (uint32 i = 1; i < num_state_encode_workers; ++i)
+	{
+		state_encode_pool.threads[i] = std::thread(&state_encode_worker_main, &state_encode_pool, i);
+	}
+	resources.state_encode_pool = &state_encode_pool;
+
+	float32 seconds_per_tick = 1.0f / tick_rate;
+
+	// each room worker has its own scratch and tick times, or there's just workers[0] when ticking on this thread
+	uint32 num_stats_workers = num_state_scratches;
+	Room_Worker* room_workers = (Room_Worker*)linear_allocator_alloc(allocator, sizeof(Room_Worker) * num_stats_workers);
+	for (uint32 i = 0; i < num_stats_workers; ++i)
+	{
+		state_scratch_create(&room_workers[i].state_scratch, num_state_fragments, allocator);
+		room_workers[i].tick_time_total.store(0, std::memory_order_relaxed);
+		room_workers[i].tick_time_max.store(0, std::memory_order_relaxed);
+		room_workers[i].num_ticks.store(0, std::memory_order_relaxed);
+	}
+
+	Room_Scheduler room_scheduler;
+	room_scheduler.num_workers = num_room_workers;
+	room_scheduler.next_deque = 0;
+	room_scheduler.num_queued = 0;
+	room_scheduler.should_stop = false;
+	room_scheduler.rooms = rooms;
+	room_scheduler.workers = room_workers;
+	room_scheduler.sock = &sock;
+	room_scheduler.seconds_per_tick = seconds_per_tick;
+	if (num_room_workers)
 	{
-		client_endpoints[i] = {};
+		uint32 deque_capacity = 1;
+		while (deque_capacity < num_rooms)
+		{
+			deque_capacity *= 2;
+		}
+		for (uint32 i = 0; i < num_room_workers; ++i)
+		{
+			Room_Deque* deque = &room_scheduler.deques[i];
+			deque->room_indices = (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * deque_capacity);
+			deque->mask = deque_capacity - 1;
+			deque->head = 0;
+			deque->tail = 0;
+		}
+		for (uint32 i = 0; i < num_room_workers; ++i)
+		{
+			room_scheduler.threads[i] = std::thread(&room_worker_main, &room_scheduler, i);
+		}
+		resources.room_scheduler = &room_scheduler;
 	}
 
-	float32*				time_since_heard_from_clients	= (float32*)				linear_allocator_alloc(&allocator, sizeof(float32)					* c_max_clients);
-	Player_Snapshot_State*	player_snapshot_states			= (Player_Snapshot_State*)	linear_allocator_alloc(&allocator, sizeof(Player_Snapshot_State)	* c_max_clients);
-	Player_Extra_State*		player_extra_states				= (Player_Extra_State*)		linear_allocator_alloc(&allocator, sizeof(Player_Extra_State)		* c_max_clients);
-	uint32*					player_prediction_ids			= (uint32*)					linear_allocator_alloc(&allocator, sizeof(uint32)					* c_max_clients);
-	
-	uint32 tick_number = 0;
+	// rather than every room ticking at once, room r is due in phase r % num_tick_phases, and the
+	// phases are spread evenly over each tick, which flattens out the cpu and send load
+	uint32 num_tick_phases = num_rooms < c_max_tick_phases ? num_rooms : c_max_tick_phases;
+	float32 seconds_per_phase = seconds_per_tick / num_tick_phases;
+	uint32 phase = 0;
 	Timer tick_timer = timer();
 
-	constexpr int32 c_tick_rate = 30;
-	constexpr float32 c_seconds_per_tick = 1.0f / c_tick_rate;
-	constexpr float32 c_client_timeout 	= 5.0f;
+	// how long messages waited between receive and this thread, how long room ticks took, and how
+	// many times a room was due again before its last tick finished, logged every stats_interval_s
+	Metrics_Histogram_Snapshot	receive_latency_at_last_stats;
+	uint32						num_overruns		= 0;
+	Timer						stats_timer			= timer();
+	int64						clock_ticks_per_us	= clock_frequency() / 1000000;
+	metrics_histogram_read(g_metrics, Metric_Histogram::Server_Receive_Latency_Us, &receive_latency_at_last_stats);
+
+	// by default spin between phases, which keeps latency lowest but burns a core even with nobody connected
+	int epoll_fd = -1;
+	int timer_fd = -1;
+	if (config->wait_for_events && !fast_forward)
+	{
+#ifdef __linux__
+		// shards hand messages over by queue so there's nothing to wait on, those are handled as each phase starts
+		SOCKET wait_handle = receive_shards ? INVALID_SOCKET : Net::socket_wait_handle(&sock);
+		if (!receive_shards && wait_handle == INVALID_SOCKET)
+		{
+			log("[server] this socket type can't be waited on, spinning instead\n");
+		}
+		else if (!tick_wait_create(&epoll_fd, &timer_fd, wait_handle, seconds_per_phase))
+		{
+			log("[server] failed to set up waiting, spinning instead\n");
+		}
+#else
+		log("[server] waiting for events is linux only, spinning instead\n");
+#endif // #ifdef __linux__
+	}
+	resources.epoll_fd = epoll_fd;
+	resources.timer_fd = timer_fd;
 
 	while (should_run->load(std::memory_order_relaxed))
 	{
-		while (timer_get_s(&tick_timer) < c_seconds_per_tick) // todo(jbr) make this loop friendly to cloud hypervisors
+		uint32 num_phases_due = 0;
+		while (true)
 		{
-			// read all available packets
-			uint32 bytes_received;
-			Net::IP_Endpoint from;
-			while (Net::socket_receive(&sock, socket_buffer, c_socket_buffer_size, &bytes_received, &from))
+			// read before receiving, so everything sent for the ticks it allows is received below
+			uint32 fast_forward_tick_limit = fast_forward ? fast_forward->tick_limit.load(std::memory_order_acquire) : 0;
+
+			// read all available messages a batch at a time, from the socket or the receive shards
+			while (true)
 			{
-				switch ((Net::Client_Message)socket_buffer[0])
+				uint32 num_records = 0;
+				if (receive_shards)
+				{
+					for (uint32 i = 0; i < num_receive_shards && num_records < c_receive_batch_size; ++i)
+					{
+						num_records += client_msg_queue_pop(receive_shards[i].queue, &client_msg_records[num_records], c_receive_batch_size - num_records);
+					}
+				}
+				else
+				{
+					num_records = client_msgs_receive(&sock, packet_views, client_msg_records);
+				}
+
+				if (!num_records)
+				{
+					break;
+				}
+
+				PROFILE_SCOPE("dispatch");
+				int64 handle_start = clock_now();
+				for (uint32 record_index = 0; record_index < num_records; ++record_index)
 				{
-					case Net::Client_Message::Join:
+					Client_Msg_Record* record = &client_msg_records[record_index];
+					Net::IP_Endpoint* from = &record->from;
+
+					if (receive_shards)
 					{
-						char from_str[22];
-						ip_endpoint_to_str(from_str, sizeof(from_str), &from);
-						log("[server] Client_Message::Join from %s\n", from_str);
+						metrics_histogram_add(Metric_Histogram::Server_Receive_Latency_Us, (uint64)((handle_start - record->receive_time) / clock_ticks_per_us));
+					}
 
-						uint32 slot = (uint32)-1;
-						for (uint32 i = 0; i < c_max_clients; ++i)
+					uint32 connection = Net::endpoint_map_get(&connection_table.connections, from);
+					switch (record->type)
+					{
+						case Net::Client_Message::Join:
 						{
-							if (client_endpoints[i].address == 0)
+							char from_str[22];
+							ip_endpoint_to_str(from_str, sizeof(from_str), from);
+							log("[server] Client_Message::Join from %s\n", from_str);
+
+							if (connection != Net::c_endpoint_map_not_found)
 							{
-								slot = i;
+								// already in, the join result must have been lost so resend it
+								uint32 join_result_msg_size = Net::server_msg_join_result_write(socket_buffer, /*success*/ true, connection % max_clients, max_clients, tick_rate);
+								metrics_add(Metric_Counter::Server_Msg_Join_Result_Bytes, join_result_msg_size);
+								Net::socket_send(&sock, socket_buffer, join_result_msg_size, from);
 								break;
 							}
-						}
 
-					
-						if (slot != (uint32)-1)
-						{
-							log("[server] client will be assigned to slot %hu\n", slot);
+							connection = connection_table_add(&connection_table, from, handle_start);
+							if (connection != c_no_connection)
+							{
+								uint32 room_index = connection / max_clients;
+								record->slot = connection % max_clients;
+								log("[server] client will be assigned to room %u slot %u\n", room_index, record->slot);
 
-							bool32 success = true;
-							uint32 join_result_msg_size = Net::server_msg_join_result_write(socket_buffer, success, slot);
-							if (Net::socket_send(&sock, socket_buffer, join_result_msg_size, &from))
+								bool32 success = true;
+								uint32 join_result_msg_size = Net::server_msg_join_result_write(socket_buffer, success, record->slot, max_clients, tick_rate);
+								metrics_add(Metric_Counter::Server_Msg_Join_Result_Bytes, join_result_msg_size);
+								if (!Net::socket_send(&sock, socket_buffer, join_result_msg_size, from))
+								{
+									connection_table_remove(&connection_table, connection);
+								}
+								else if (!client_msg_queue_push(rooms[room_index].inbox, record))
+								{
+									// the client thinks it's in, but will time out
+									metrics_add(Metric_Counter::Server_Msgs_Dropped_Inbox);
+									log("[server] room %u inbox full, dropping join\n", room_index);
+									connection_table_remove(&connection_table, connection);
+								}
+								else
+								{
+									metrics_add(Metric_Counter::Server_Joins);
+								}
+							}
+							else
 							{
-								client_endpoints[slot] = from;
-								time_since_heard_from_clients[slot] = 0.0f;
-								player_snapshot_states[slot] = {};
-								player_extra_states[slot] = {};
-								player_prediction_ids[slot] = 0;
+								log("[server] could not find a slot for player\n");
+
+								bool32 success = false;
+								uint32 join_result_msg_size = Net::server_msg_join_result_write(socket_buffer, success, (uint32)-1, max_clients, tick_rate);
+								metrics_add(Metric_Counter::Server_Msg_Join_Result_Bytes, join_result_msg_size);
+								metrics_add(Metric_Counter::Server_Joins_Rejected);
+								Net::socket_send(&sock, socket_buffer, join_result_msg_size, from);
 							}
 						}
-						else
-						{
-							log("[server] could not find a slot for player\n");
-						
-							bool32 success = false;
-							uint32 join_result_msg_size = Net::server_msg_join_result_write(socket_buffer, success, slot);
-							Net::socket_send(&sock, socket_buffer, join_result_msg_size, &from);
-						}
-					}
-					break;
-
-					case Net::Client_Message::Leave:
-					{
-						uint32 slot;
-						Net::client_msg_leave_read(socket_buffer, &slot);
+						break;
 
-						if (Net::ip_endpoint_equals(&client_endpoints[slot], &from))
+						case Net::Client_Message::Leave:
 						{
-							client_endpoints[slot] = {};
 							char from_str[22];
-							ip_endpoint_to_str(from_str, sizeof(from_str), &from);
-							log("[server] Client_Message::Leave from %hu(%s)\n", slot, from_str);
-						}
-						else
-						{
-							char from_str[22];
-							char client_endpoint_str[22];
-							ip_endpoint_to_str(from_str, sizeof(from_str), &from);
-							ip_endpoint_to_str(client_endpoint_str, sizeof(client_endpoint_str), &client_endpoints[slot]);
-							log("[server] Client_Message::Leave from %hu(%s), espected (%s)\n", 
-								slot, from_str, client_endpoint_str);
+							ip_endpoint_to_str(from_str, sizeof(from_str), from);
+							if (connection != Net::c_endpoint_map_not_found)
+							{
+								log("[server] Client_Message::Leave from room %u slot %u(%s)\n", connection / max_clients, connection % max_clients, from_str);
+								connection_table_leave(&connection_table, rooms, connection);
+								metrics_add(Metric_Counter::Server_Leaves);
+							}
+							else
+							{
+								metrics_add(Metric_Counter::Server_Msgs_Not_Connected);
+								log("[server] Client_Message::Leave discarded, %s isn't connected\n", from_str);
+							}
 						}
-					}
-					break;
-
-					case Net::Client_Message::Input:
-					{
-						uint32 slot;
-						float32 dt;
-						Player_Input input;
-						uint32 prediction_id;
-						Net::client_msg_input_read(socket_buffer, &slot, &dt, &input, &prediction_id);
+						break;
 
-						if (Net::ip_endpoint_equals(&client_endpoints[slot], &from))
-						{
-							tick_player(&player_snapshot_states[slot], &player_extra_states[slot], dt, &input);
-							
-							player_prediction_ids[slot] = prediction_id; 
-							time_since_heard_from_clients[slot] = 0.0f;
-						}
-						else
+						case Net::Client_Message::Input:
 						{
-							log("[server] Client_Message::Input discarded, was from %u:%hu but expected %u:%hu\n", from.address, from.port, client_endpoints[slot].address, client_endpoints[slot].port);
+							if (connection != Net::c_endpoint_map_not_found)
+							{
+								connection_table.last_heard_times[connection] = record->receive_time;
+								record->slot = connection % max_clients;
+
+								// a full inbox means the room is well behind, so this input would be too late anyway
+								if (!client_msg_queue_push(rooms[connection / max_clients].inbox, record))
+								{
+									metrics_add(Metric_Counter::Server_Msgs_Dropped_Inbox);
+								}
+							}
+							else
+							{
+								metrics_add(Metric_Counter::Server_Msgs_Not_Connected);
+								log("[server] Client_Message::Input discarded, %u:%hu isn't connected\n", from->address, from->port);
+							}
 						}
+						break;
 					}
+				}
+				metrics_add(Metric_Counter::Server_Dispatch_Ns, clock_ticks_to_ns(clock_now() - handle_start));
+			}
+
+			if (fast_forward)
+			{
+				if (fast_forward->ticks_done.load(std::memory_order_relaxed) < fast_forward_tick_limit)
+				{
+					num_phases_due = num_tick_phases;
+				}
+				else if (!should_run->load(std::memory_order_relaxed))
+				{
 					break;
 				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			else if (epoll_fd == -1)
+			{
+				while (timer_get_s(&tick_timer) >= seconds_per_phase)
+				{
+					timer_shift_start(&tick_timer, seconds_per_phase);
+					++num_phases_due;
+				}
+			}
+#ifdef __linux__
+			else
+			{
+				num_phases_due = tick_wait(epoll_fd, timer_fd);
+			}
+#endif // #ifdef __linux__
+			if (num_phases_due)
+			{
+				break;
 			}
 		}
-		timer_shift_start(&tick_timer, c_seconds_per_tick);
-		
-		// update clients
-		for (uint32 i = 0; i < c_max_clients; ++i)
+
+		// if this thread fell behind catch up on the phases it missed, rather than the same rooms always
+		// being the ones to lose a tick, but tick each room at most once
+		if (num_phases_due > num_tick_phases)
+		{
+			num_phases_due = num_tick_phases;
+		}
+		connection_table_retry_leaves(&connection_table, rooms);
+
+		// only clients whose timer has come due are looked at
+		uint32 timed_out_connection;
+		while (connection_table_pop_timed_out(&connection_table, clock_now(), &timed_out_connection))
+		{
+			PROFILE_SCOPE("timeout");
+			// todo(jbr) when receiving messages from an endpoint that isn't connected,
+			// send a message back to them saying "go away"
+			log("[server] client in room %u slot %u timed out\n", timed_out_connection / max_clients, timed_out_connection % max_clients);
+			connection_table_leave(&connection_table, rooms, timed_out_connection);
+			metrics_add(Metric_Counter::Server_Timeouts);
+		}
+
+		for (; num_phases_due; --num_phases_due)
 		{
-			if (client_endpoints[i].address)
+			for (uint32 room_index = phase; room_index < num_rooms; room_index += num_tick_phases)
+			{
+				Room* room = &rooms[room_index];
+
+				// empty rooms don't tick, any leaves still in the inbox are handled before the next join
+				if (connection_table_is_room_empty(&connection_table, room_index))
+				{
+					continue;
+				}
+
+				if (room->is_ticking.load(std::memory_order_acquire))
+				{
+					// still ticking from last time, skip rather than queue up behind it
+					++num_overruns;
+					metrics_add(Metric_Counter::Server_Room_Tick_Overruns);
+					continue;
+				}
+
+				if (num_room_workers)
+				{
+					room->is_ticking.store(true, std::memory_order_relaxed);
+					room_scheduler_push(&room_scheduler, room_index);
+				}
+				else
+				{
+					int64 tick_start = clock_now();
+					room_tick(room, &sock, seconds_per_tick, &room_workers[0].state_scratch, &state_encode_pool);
+					room_worker_record_tick(&room_workers[0], clock_now() - tick_start);
+				}
+			}
+			phase = (phase + 1) % num_tick_phases;
+
+			// a tick is done once every phase has had its turn
+			if (!phase)
 			{
-				time_since_heard_from_clients[i] += c_seconds_per_tick;
-				if (time_since_heard_from_clients[i] > c_client_timeout)
+				if (config->ticks_profiler)
 				{
-					// todo(jbr) when receiving messages from a client whose slot doesn't match with
-					// the endpoint we have, send a message back to them saying "go away"
-					log("[server] client %hu timed out\n", i);
-					client_endpoints[i] = {};
+					profile_tick();
+				}
+				if (fast_forward)
+				{
+					fast_forward->ticks_done.fetch_add(1, std::memory_order_release);
 				}
 			}
 		}
-		++tick_number;
-		
-		// create and send state packets
-		for (uint32 i = 0; i < c_max_clients; ++i)
+
+		if (config->stats_interval_s > 0.0f && timer_get_s(&stats_timer) >= config->stats_interval_s)
 		{
-			if (client_endpoints[i].address)
+			int64 tick_time_total = 0;
+			int64 tick_time_max = 0;
+			uint32 num_ticks = 0;
+			for (uint32 i = 0; i < num_stats_workers; ++i)
 			{
-				uint32 state_msg_size = Net::server_msg_state_write(socket_buffer, player_prediction_ids[i], &player_extra_states[i], client_endpoints, player_snapshot_states, c_max_clients);
-
-				if (!Net::socket_send(&sock, socket_buffer, state_msg_size, &client_endpoints[i]))
+				tick_time_total += room_workers[i].tick_time_total.exchange(0, std::memory_order_relaxed);
+				num_ticks += room_workers[i].num_ticks.exchange(0, std::memory_order_relaxed);
+				int64 worker_tick_time_max = room_workers[i].tick_time_max.exchange(0, std::memory_order_relaxed);
+				if (worker_tick_time_max > tick_time_max)
 				{
-					log("[server] sendto failed: %d\n", WSAGetLastError());
+					tick_time_max = worker_tick_time_max;
 				}
 			}
+
+			log("[server] %u room ticks: mean %.3fms, max %.3fms, %u overruns\n",
+				num_ticks,
+				num_ticks ? (tick_time_total / num_ticks) / (clock_ticks_per_us * 1000.0f) : 0.0f,
+				tick_time_max / (clock_ticks_per_us * 1000.0f),
+				num_overruns);
+			if (receive_shards)
+			{
+				Metrics_Histogram_Snapshot receive_latency_now;
+				Metrics_Histogram_Snapshot receive_latency;
+				metrics_histogram_read(g_metrics, Metric_Histogram::Server_Receive_Latency_Us, &receive_latency_now);
+				metrics_histogram_diff(&receive_latency_now, &receive_latency_at_last_stats, &receive_latency);
+				histogram_log(&receive_latency, "receive latency");
+				receive_latency_at_last_stats = receive_latency_now;
+			}
+
+			num_overruns = 0;
+			stats_timer = timer();
 		}
 	}
 
-	Net::socket_close(&sock);
-}
\ No newline at end of file
+	server_shutdown(&resources);
+}
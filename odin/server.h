@@ -3,7 +3,40 @@
 #include <atomic>
 
 #include "core.h"
+#include "net.h"
 
 
 
-void server_main(std::atomic_bool* should_run);
\ No newline at end of file
+constexpr int32 c_default_server_tick_rate = 30;
+constexpr uint32 c_max_receive_shards = 16;
+constexpr uint32 c_max_state_encode_workers = 16;
+constexpr uint32 c_max_rooms = 1024;
+constexpr uint32 c_max_room_workers = 64;
+
+// runs ticks back to back rather than by the clock, for benchmarking. Whoever drives the server sends
+// a tick's messages then raises tick_limit, and a tick only runs once everything sent before the limit
+// was raised has been handled. Rooms all tick on the server_main thread, so by the time ticks_done has
+// gone up the tick's state has been sent
+struct Server_Fast_Forward
+{
+	std::atomic<uint32> tick_limit;
+	std::atomic<uint32> ticks_done;
+};
+
+struct Server_Config
+{
+	uint16 port;
+	int32 tick_rate; // clamped to [1, c_max_server_tick_rate]
+	uint32 max_clients; // per room, clamped to [1, c_max_clients], which is what the protocol has room for, everything per client is sized for this at startup
+	uint32 num_rooms; // independent games on the one port, each client joins the first with a free slot
+	uint32 num_room_workers; // threads ticking rooms, 0 ticks them all on the server_main thread
+	Net::Socket_Type socket_type;
+	uint32 num_receive_shards; // 0 receives on the tick thread, 1 on a thread of its own, > 1 spreads packet intake over that many threads with SO_REUSEPORT (linux only)
+	bool32 wait_for_events; // sleep in epoll until a packet arrives or the next tick is due, rather than spinning (linux only)
+	uint32 num_state_encode_workers; // threads encoding state packets each room tick, including the server_main thread, so 1 for no extra threads, only used without room workers
+	float32 stats_interval_s; // how often to log room tick time and receive latency, 0 for never
+	bool32 ticks_profiler; // call profile_tick every tick, false when something else (e.g. a client's frames) does
+	Server_Fast_Forward* fast_forward; // 0 to tick in real time
+};
+
+void server_main(std::atomic_bool* should_run, Server_Config* config);
\ No newline at end of file
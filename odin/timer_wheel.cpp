@@ -0,0 +1,177 @@
+#include "timer_wheel.h"
+
+
+
+constexpr uint32 c_timer_wheel_slot_mask		= c_timer_wheel_slots - 1;
+constexpr uint32 c_timer_wheel_expired_list	= c_timer_wheel_levels * c_timer_wheel_slots;
+
+
+static void timer_wheel_link(Timer_Wheel* wheel, uint32 timer, uint32 list)
+{
+	uint32 head = wheel->heads[list];
+	wheel->nexts[timer] = head;
+	wheel->prevs[timer] = c_timer_wheel_no_timer;
+	if (head != c_timer_wheel_no_timer)
+	{
+		wheel->prevs[head] = timer;
+	}
+	wheel->heads[list] = timer;
+	wheel->lists[timer] = list;
+}
+
+static void timer_wheel_unlink(Timer_Wheel* wheel, uint32 timer)
+{
+	uint32 next = wheel->nexts[timer];
+	uint32 prev = wheel->prevs[timer];
+	if (prev != c_timer_wheel_no_timer)
+	{
+		wheel->nexts[prev] = next;
+	}
+	else
+	{
+		wheel->heads[wheel->lists[timer]] = next;
+	}
+	if (next != c_timer_wheel_no_timer)
+	{
+		wheel->prevs[next] = prev;
+	}
+	wheel->lists[timer] = c_timer_wheel_no_timer;
+}
+
+// level n holds deadlines less than 64^(n+1) ticks away, in slots 64^n ticks wide, so each slot is
+// reached (and moved down a level) before any of its deadlines
+static void timer_wheel_insert(Timer_Wheel* wheel, uint32 timer)
+{
+	uint64 deadline = wheel->deadlines[timer];
+	if (deadline <= wheel->now)
+	{
+		timer_wheel_link(wheel, timer, c_timer_wheel_expired_list);
+		return;
+	}
+
+	uint64 delay = deadline - wheel->now;
+	uint32 level = 0;
+	while (delay >> (c_timer_wheel_slot_bits * (level + 1)))
+	{
+		++level;
+	}
+	uint32 slot = (uint32)(deadline >> (c_timer_wheel_slot_bits * level)) & c_timer_wheel_slot_mask;
+	timer_wheel_link(wheel, timer, (level * c_timer_wheel_slots) + slot);
+}
+
+// moves everything in the level's current slot down to the levels below
+static void timer_wheel_cascade(Timer_Wheel* wheel, uint32 level)
+{
+	uint32 slot = (uint32)(wheel->now >> (c_timer_wheel_slot_bits * level)) & c_timer_wheel_slot_mask;
+	uint32 list = (level * c_timer_wheel_slots) + slot;
+	uint32 timer = wheel->heads[list];
+	wheel->heads[list] = c_timer_wheel_no_timer;
+	while (timer != c_timer_wheel_no_timer)
+	{
+		uint32 next = wheel->nexts[timer];
+		timer_wheel_insert(wheel, timer);
+		timer = next;
+	}
+}
+
+
+void timer_wheel_create(Timer_Wheel* wheel, uint32 max_timers, uint64 now, Linear_Allocator* allocator)
+{
+	wheel->now = now;
+	wheel->num_scheduled = 0;
+	for (uint32 i = 0; i < (c_timer_wheel_levels * c_timer_wheel_slots) + 1; ++i)
+	{
+		wheel->heads[i] = c_timer_wheel_no_timer;
+	}
+	wheel->nexts		= (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * max_timers);
+	wheel->prevs		= (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * max_timers);
+	wheel->lists		= (uint32*)linear_allocator_alloc(allocator, sizeof(uint32) * max_timers);
+	wheel->deadlines	= (uint64*)linear_allocator_alloc(allocator, sizeof(uint64) * max_timers);
+	for (uint32 i = 0; i < max_timers; ++i)
+	{
+		wheel->lists[i] = c_timer_wheel_no_timer;
+	}
+}
+
+void timer_wheel_schedule(Timer_Wheel* wheel, uint32 timer, uint64 deadline)
+{
+	if (wheel->lists[timer] != c_timer_wheel_no_timer)
+	{
+		timer_wheel_unlink(wheel, timer);
+	}
+	else
+	{
+		++wheel->num_scheduled;
+	}
+
+	if (deadline > wheel->now + c_timer_wheel_max_delay)
+	{
+		deadline = wheel->now + c_timer_wheel_max_delay;
+	}
+	wheel->deadlines[timer] = deadline;
+	timer_wheel_insert(wheel, timer);
+}
+
+void timer_wheel_cancel(Timer_Wheel* wheel, uint32 timer)
+{
+	if (wheel->lists[timer] != c_timer_wheel_no_timer)
+	{
+		timer_wheel_unlink(wheel, timer);
+		--wheel->num_scheduled;
+	}
+}
+
+bool32 timer_wheel_is_scheduled(Timer_Wheel* wheel, uint32 timer)
+{
+	return wheel->lists[timer] != c_timer_wheel_no_timer;
+}
+
+void timer_wheel_advance(Timer_Wheel* wheel, uint64 now)
+{
+	while (wheel->now < now)
+	{
+		if (!wheel->num_scheduled)
+		{
+			// nothing to move through the slots, so skip straight there
+			wheel->now = now;
+			return;
+		}
+
+		++wheel->now;
+
+		// at the start of each lap of a level, bring the next slot of the level above down into it
+		for (uint32 level = 1; level < c_timer_wheel_levels; ++level)
+		{
+			if ((wheel->now >> (c_timer_wheel_slot_bits * (level - 1))) & c_timer_wheel_slot_mask)
+			{
+				break;
+			}
+			timer_wheel_cascade(wheel, level);
+		}
+
+		// everything in the current level 0 slot is due now
+		uint32 list = (uint32)wheel->now & c_timer_wheel_slot_mask;
+		uint32 timer = wheel->heads[list];
+		wheel->heads[list] = c_timer_wheel_no_timer;
+		while (timer != c_timer_wheel_no_timer)
+		{
+			uint32 next = wheel->nexts[timer];
+			timer_wheel_link(wheel, timer, c_timer_wheel_expired_list);
+			timer = next;
+		}
+	}
+}
+
+bool32 timer_wheel_pop_expired(Timer_Wheel* wheel, uint32* out_timer)
+{
+	uint32 timer = wheel->heads[c_timer_wheel_expired_list];
+	if (timer == c_timer_wheel_no_timer)
+	{
+		return false;
+	}
+
+	timer_wheel_unlink(wheel, timer);
+	--wheel->num_scheduled;
+	*out_timer = timer;
+	return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "core.h"
+
+
+
+// hierarchical timing wheel, for lots of timers which mostly get pushed back or cancelled before they
+// fire, like timeouts, retransmits and handshakes. Timers are indices in [0, max_timers) which the caller
+// picks (e.g. a connection id), and time is in whole ticks of whatever length the caller likes.
+// Scheduling and cancelling are O(1), and advancing only visits due timers, plus timers moving down a
+// level every 64 ticks at the most
+constexpr uint32 c_timer_wheel_slot_bits	= 6;
+constexpr uint32 c_timer_wheel_slots		= 1 << c_timer_wheel_slot_bits;
+constexpr uint32 c_timer_wheel_levels		= 4;
+constexpr uint64 c_timer_wheel_max_delay	= ((uint64)1 << (c_timer_wheel_slot_bits * c_timer_wheel_levels)) - 1; // later deadlines are brought in to this
+constexpr uint32 c_timer_wheel_no_timer		= (uint32)-1;
+
+struct Timer_Wheel
+{
+	uint64 now; // ticks
+	uint32 num_scheduled; // including expired ones not yet popped
+	uint32 heads[(c_timer_wheel_levels * c_timer_wheel_slots) + 1]; // a list per slot per level, then the expired list
+	// by timer
+	uint32* nexts;
+	uint32* prevs;
+	uint32* lists; // which list the timer is in, c_timer_wheel_no_timer if not scheduled
+	uint64* deadlines;
+};
+
+void	timer_wheel_create(Timer_Wheel* wheel, uint32 max_timers, uint64 now, Linear_Allocator* allocator);
+// schedules the timer, or moves it if it's already scheduled, deadlines already passed expire on the next advance
+void	timer_wheel_schedule(Timer_Wheel* wheel, uint32 timer, uint64 deadline);
+void	timer_wheel_cancel(Timer_Wheel* wheel, uint32 timer);
+bool32	timer_wheel_is_scheduled(Timer_Wheel* wheel, uint32 timer);
+// moves time forward, timers which are due can then be taken with timer_wheel_pop_expired
+void	timer_wheel_advance(Timer_Wheel* wheel, uint64 now);
+// returns false once there are no more, a popped timer is no longer scheduled
+bool32	timer_wheel_pop_expired(Timer_Wheel* wheel, uint32* out_timer);